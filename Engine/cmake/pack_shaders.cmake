@@ -0,0 +1,41 @@
+# Packs compiled SPIR-V modules into a C++ source embedding all of them in a
+# single blob, with an index sorted by shader name for lookups.
+# cmake -DSHADERS="a.spv|b.spv" -DOUTPUT=archive.cpp -P pack_shaders.cmake
+
+# Lists can't be passed through a custom command as is
+string(REPLACE "|" ";" SHADERS "${SHADERS}")
+# Shaders share a directory, sorting paths sorts names
+list(SORT SHADERS)
+
+set(OFFSET 0)
+set(DATA "")
+set(ENTRIES "")
+foreach(SHADER IN LISTS SHADERS)
+  get_filename_component(NAME ${SHADER} NAME_WLE)
+  file(READ ${SHADER} HEX HEX)
+  string(LENGTH "${HEX}" HEX_LENGTH)
+  math(EXPR SIZE "${HEX_LENGTH} / 2")
+  string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," BYTES "${HEX}")
+  string(APPEND DATA "    // ${NAME}\n    ${BYTES}\n")
+  string(APPEND ENTRIES "    { \"${NAME}\", ${OFFSET}, ${SIZE} },\n")
+  # SPIR-V is made of words, so every module stays 4 bytes aligned
+  math(EXPR OFFSET "${OFFSET} + ${SIZE}")
+endforeach()
+list(LENGTH SHADERS COUNT)
+
+file(
+  WRITE ${OUTPUT}
+  "// Generated by pack_shaders.cmake, do not edit\n"
+  "#include \"renderer/vulkan/vk_shaders.hpp\"\n\n"
+  "namespace baldwin {\n"
+  "namespace vk {\n\n"
+  "alignas(4) const unsigned char SHADER_ARCHIVE_DATA[] = {\n"
+  "${DATA}"
+  "    0x00\n"
+  "};\n\n"
+  "const ShaderArchiveEntry SHADER_ARCHIVE_ENTRIES[] = {\n"
+  "${ENTRIES}"
+  "};\n\n"
+  "const uint32_t SHADER_ARCHIVE_ENTRY_COUNT = ${COUNT};\n\n"
+  "} // namespace vk\n"
+  "} // namespace baldwin\n")
@@ -0,0 +1,137 @@
+#version 460
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_samplerless_texture_functions : require
+#extension GL_GOOGLE_include_directive : require
+#pragma shader_stage(compute)
+
+// One invocation per task, dispatched indirectly over the tasks cull.comp
+// appended, see CLUSTER_WORKGROUP
+layout (local_size_x_id = 0, local_size_y_id = 1, local_size_z = 1) in;
+
+#include "include/culling.glsl"
+
+layout (push_constant) uniform Constants {
+    FrameConstants frame;
+    Meshes meshes;
+    Instances instances;
+    Meshlets meshlets;
+    // Draws and count of this phase
+    DrawCommands draws;
+    Counter drawCount;
+    Statistics statistics;
+    // Tasks of this phase and their dispatch
+    ClusterTasks tasks;
+    TaskDispatch dispatch;
+    // Where the early phase sends the meshlets it finds occluded
+    ClusterTasks lateTasks;
+    TaskDispatch lateDispatch;
+    // 0 for the early phase, testing against last frame's pyramid, 1 for the
+    // late one, testing against this frame's
+    uint phase;
+    // Depth pyramid to test against, see Pyramid
+    uint pyramid;
+    uint pyramidLevels;
+    uint pyramidWidth;
+    uint pyramidHeight;
+    uint taskCapacity;
+    uint drawCapacity;
+} constants;
+
+shared uint groupDraws;
+shared uint groupTriangles;
+shared uint groupRetests;
+shared uint groupFirstDraw;
+shared uint groupFirstRetest;
+
+// Whether every triangle of the cluster faces away from the camera, given
+// the cone holding their normals and the sphere bounding them. The cone
+// test of meshoptimizer's meshopt_computeMeshletBounds.
+bool isBackfacing(vec4 cone, vec4 sphere, vec3 camera)
+{
+    vec3 v = sphere.xyz - camera;
+    return dot(v, cone.xyz) >= cone.w * length(v) + sphere.w;
+}
+
+void main()
+{
+    if (gl_LocalInvocationIndex == 0) {
+        groupDraws = 0;
+        groupTriangles = 0;
+        groupRetests = 0;
+    }
+    barrier();
+
+    uint index = gl_GlobalInvocationID.x;
+    uint taskCount = min(constants.dispatch.taskCount, constants.taskCapacity);
+    bool early = constants.phase == 0;
+    bool visible = false;
+    bool retest = false;
+    uvec2 task;
+    Mesh mesh;
+    Meshlet meshlet;
+    if (index < taskCount) {
+        task = constants.tasks.tasks[index];
+        Instance instance = constants.instances.instances[task.x];
+        mesh = constants.meshes.meshes[instance.mesh];
+        meshlet = constants.meshlets.meshlets[task.y];
+
+        // Instances only translate and scale uniformly, cones are unchanged
+        float scale = instance.transform.w;
+        vec4 sphere = vec4(instance.transform.xyz + meshlet.sphere.xyz * scale,
+                           meshlet.sphere.w * scale);
+        visible = inFrustum(constants.frame, sphere) &&
+                  !isBackfacing(meshlet.cone, sphere,
+                                constants.frame.cameraPosition.xyz);
+
+        // The early phase only has a pyramid when the late one runs, and
+        // what it hides may show up in this frame's
+        Pyramid pyramid = Pyramid(constants.pyramid, constants.pyramidLevels,
+                                  uvec2(constants.pyramidWidth,
+                                        constants.pyramidHeight));
+        bool occluded = false;
+        if (visible) {
+            occluded = early ? isOccluded(pyramid, sphere,
+                                          constants.frame.prevView,
+                                          constants.frame.prevProjection)
+                             : isOccluded(pyramid, sphere,
+                                          constants.frame.view,
+                                          constants.frame.projection);
+        }
+        retest = early && occluded;
+        visible = visible && !occluded;
+    }
+
+    // Compacted like the instances in cull.comp
+    uint slot = 0;
+    if (visible) {
+        slot = atomicAdd(groupDraws, 1);
+        atomicAdd(groupTriangles, meshlet.indexCount / 3);
+    } else if (retest) {
+        slot = atomicAdd(groupRetests, 1);
+    }
+    barrier();
+    if (gl_LocalInvocationIndex == 0) {
+        if (groupDraws > 0) {
+            groupFirstDraw = atomicAdd(constants.drawCount.value, groupDraws);
+            atomicAdd(constants.statistics.clustersDrawn, groupDraws);
+            atomicAdd(constants.statistics.trianglesDrawn, groupTriangles);
+        }
+        if (groupRetests > 0) {
+            groupFirstRetest = appendTasks(constants.lateDispatch,
+                                           groupRetests,
+                                           constants.taskCapacity);
+        }
+    }
+    barrier();
+
+    // Past the capacities, draws are ignored by the draw count's maximum and
+    // tasks by the late dispatch
+    if (visible && groupFirstDraw + slot < constants.drawCapacity) {
+        constants.draws.commands[groupFirstDraw + slot] =
+            DrawCommand(meshlet.indexCount, 1,
+                        mesh.firstIndex + meshlet.firstIndex,
+                        mesh.vertexOffset, task.x);
+    }
+    if (retest && groupFirstRetest + slot < constants.taskCapacity)
+        constants.lateTasks.tasks[groupFirstRetest + slot] = task;
+}
@@ -0,0 +1,146 @@
+#version 460
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_samplerless_texture_functions : require
+#extension GL_GOOGLE_include_directive : require
+#pragma shader_stage(compute)
+
+// One invocation per instance, specialized at pipeline creation with a one
+// row workgroup, see WorkgroupSize
+layout (local_size_x_id = 0, local_size_y_id = 1, local_size_z = 1) in;
+
+#include "include/culling.glsl"
+
+// Set by the early phase for the instances it found occluded
+layout (buffer_reference, std430) buffer OcclusionFlags {
+    uint occluded[];
+};
+
+layout (push_constant) uniform Constants {
+    FrameConstants frame;
+    Meshes meshes;
+    Instances instances;
+    // Draws and count of this phase, the count is cleared before the early
+    // phase
+    DrawCommands draws;
+    Counter drawCount;
+    Statistics statistics;
+    OcclusionFlags flags;
+    // Tasks of this phase and their dispatch, when clusters are culled
+    ClusterTasks tasks;
+    TaskDispatch dispatch;
+    uint instanceCount;
+    // 0 for the early phase, testing against last frame's pyramid, 1 for the
+    // late one, retesting the instances it rejected against this frame's
+    uint phase;
+    // Depth pyramid to test against, see Pyramid
+    uint pyramid;
+    uint pyramidLevels;
+    uint pyramidWidth;
+    uint pyramidHeight;
+    // Visible instances append their meshlets to the tasks instead of
+    // drawing whole when not 0
+    uint clusterCulling;
+    uint taskCapacity;
+} constants;
+
+shared uint groupVisible;
+shared uint groupFrustumVisible;
+shared uint groupClusters;
+shared uint groupTriangles;
+shared uint groupFirst;
+
+void main()
+{
+    if (gl_LocalInvocationIndex == 0) {
+        groupVisible = 0;
+        groupFrustumVisible = 0;
+        groupClusters = 0;
+        groupTriangles = 0;
+    }
+    barrier();
+
+    uint index = gl_GlobalInvocationID.x;
+    bool early = constants.phase == 0;
+    bool clusters = constants.clusterCulling != 0;
+    bool visible = false;
+    Instance instance;
+    Mesh mesh;
+    if (index < constants.instanceCount) {
+        instance = constants.instances.instances[index];
+        // The late phase only retests what the early one rejected
+        visible = early ? inFrustum(constants.frame, instance.sphere)
+                        : constants.flags.occluded[index] != 0;
+        Pyramid pyramid = Pyramid(constants.pyramid, constants.pyramidLevels,
+                                  uvec2(constants.pyramidWidth,
+                                        constants.pyramidHeight));
+        bool occluded = false;
+        if (visible) {
+            occluded = early ? isOccluded(pyramid, instance.sphere,
+                                          constants.frame.prevView,
+                                          constants.frame.prevProjection)
+                             : isOccluded(pyramid, instance.sphere,
+                                          constants.frame.view,
+                                          constants.frame.projection);
+        }
+        if (early) {
+            if (visible)
+                atomicAdd(groupFrustumVisible, 1);
+            constants.flags.occluded[index] = occluded ? 1 : 0;
+        }
+        visible = visible && !occluded;
+        if (visible) {
+            mesh = constants.meshes.meshes[instance.mesh];
+            atomicAdd(groupTriangles, mesh.indexCount / 3);
+        }
+    }
+
+    // Survivors are compacted with one global atomic per workgroup instead
+    // of one per instance. With cluster culling, the same goes for their
+    // meshlets' tasks.
+    uint slot = 0;
+    if (visible) {
+        slot = atomicAdd(groupVisible, 1);
+        if (clusters)
+            slot = atomicAdd(groupClusters, mesh.meshletCount);
+    }
+    barrier();
+    if (gl_LocalInvocationIndex == 0) {
+        if (clusters && groupClusters > 0) {
+            groupFirst = appendTasks(constants.dispatch, groupClusters,
+                                     constants.taskCapacity);
+        } else if (!clusters && groupVisible > 0) {
+            groupFirst = atomicAdd(constants.drawCount.value, groupVisible);
+        }
+        if (groupVisible > 0) {
+            atomicAdd(constants.statistics.drawn, groupVisible);
+            // Whole instances are clusters of their own
+            uint groupDraws = clusters ? groupClusters : groupVisible;
+            atomicAdd(constants.statistics.clusters, groupDraws);
+            atomicAdd(constants.statistics.triangles, groupTriangles);
+            if (!clusters) {
+                atomicAdd(constants.statistics.clustersDrawn, groupDraws);
+                atomicAdd(constants.statistics.trianglesDrawn, groupTriangles);
+            }
+        }
+        if (groupFrustumVisible > 0)
+            atomicAdd(constants.statistics.frustumVisible, groupFrustumVisible);
+    }
+    barrier();
+
+    if (!visible)
+        return;
+    if (clusters) {
+        // Meshes are mostly a handful of meshlets, larger ones make their
+        // invocation loop longer
+        for (uint i = 0; i < mesh.meshletCount; i++) {
+            uint task = groupFirst + slot + i;
+            if (task >= constants.taskCapacity)
+                break;
+            constants.tasks.tasks[task] = uvec2(index, mesh.firstMeshlet + i);
+        }
+    } else {
+        constants.draws.commands[groupFirst + slot] =
+            DrawCommand(mesh.indexCount, 1, mesh.firstIndex,
+                        mesh.vertexOffset, index);
+    }
+}
@@ -0,0 +1,208 @@
+// Scene layouts and visibility tests shared by cull.comp and cluster.comp.
+// Includers enable GL_EXT_buffer_reference and
+// GL_EXT_samplerless_texture_functions.
+
+// Matches GpuMesh in vk_gpu_scene.hpp
+struct Mesh {
+    uint firstIndex;
+    uint indexCount;
+    int vertexOffset;
+    uint firstMeshlet;
+    vec4 positionOffset;
+    vec4 positionScale;
+    vec4 sphere;
+    uint meshletCount;
+};
+
+// Matches GpuInstance in vk_gpu_scene.hpp
+struct Instance {
+    // Translation and uniform scale
+    vec4 transform;
+    // Bounding sphere in world space
+    vec4 sphere;
+    uint mesh;
+};
+
+// Matches Meshlet in mesh_data.hpp
+struct Meshlet {
+    // In mesh space
+    vec4 sphere;
+    // Axis and sine of the half angle
+    vec4 cone;
+    // Relative to the mesh's first index
+    uint firstIndex;
+    uint indexCount;
+};
+
+// Matches VkDrawIndexedIndirectCommand
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+// Bindless sampled images, see BindlessHeap
+layout (set = 0, binding = 0) uniform texture2D sampledImages[];
+
+layout (buffer_reference, std430) readonly buffer FrameConstants {
+    vec4 clearColor;
+    uint frameNum;
+    uint renderWidth;
+    uint renderHeight;
+    mat4 view;
+    mat4 viewProj;
+    // Normalized, pointing inwards
+    vec4 frustum[6];
+    // x and y scales, near and far, see CameraMatrices
+    vec4 projection;
+    // Camera of the previous frame
+    mat4 prevView;
+    vec4 prevProjection;
+    vec4 cameraPosition;
+};
+
+layout (buffer_reference, std430) readonly buffer Meshes {
+    Mesh meshes[];
+};
+
+layout (buffer_reference, std430) readonly buffer Instances {
+    Instance instances[];
+};
+
+layout (buffer_reference, std430) readonly buffer Meshlets {
+    Meshlet meshlets[];
+};
+
+layout (buffer_reference, std430) writeonly buffer DrawCommands {
+    DrawCommand commands[];
+};
+
+layout (buffer_reference, std430) buffer Counter {
+    uint value;
+};
+
+// Host visible, accumulated for CullStatistics
+layout (buffer_reference, std430) buffer Statistics {
+    uint frustumVisible;
+    uint drawn;
+    uint clusters;
+    uint clustersDrawn;
+    uint triangles;
+    uint trianglesDrawn;
+};
+
+// Instance and meshlet index of each task, see GpuScene
+layout (buffer_reference, std430) buffer ClusterTasks {
+    uvec2 tasks[];
+};
+
+// Matches GpuScene::ClusterDispatch, the groups cover taskCount
+layout (buffer_reference, std430) buffer TaskDispatch {
+    uint groupsX;
+    uint groupsY;
+    uint groupsZ;
+    uint taskCount;
+};
+
+// Invocations per workgroup of cluster.comp, see CLUSTER_WORKGROUP
+const uint CLUSTER_GROUP_SIZE = 64;
+
+// Reserves count tasks of a phase's list holding at most capacity, and grows
+// its dispatch to cover them. Returns the first one, tasks past the capacity
+// are dropped.
+uint appendTasks(TaskDispatch dispatch, uint count, uint capacity)
+{
+    uint first = atomicAdd(dispatch.taskCount, count);
+    uint end = min(first + count, capacity);
+    if (end > first) {
+        atomicMax(dispatch.groupsX,
+                  (end + CLUSTER_GROUP_SIZE - 1) / CLUSTER_GROUP_SIZE);
+        // Cleared to 0 with the rest
+        dispatch.groupsY = 1;
+        dispatch.groupsZ = 1;
+    }
+    return first;
+}
+
+bool inFrustum(FrameConstants frame, vec4 sphere)
+{
+    bool visible = true;
+    for (int i = 0; i < 6; i++) {
+        vec4 plane = frame.frustum[i];
+        visible = visible && dot(plane.xyz, sphere.xyz) + plane.w > -sphere.w;
+    }
+    return visible;
+}
+
+// Screen space bounds of a view space sphere in front of the near plane, as
+// uv min and max. 2D Polyhedral Bounds of a Clipped, Perspective-Projected 3D
+// Sphere, Mara and McGuire 2013.
+vec4 projectSphere(vec3 c, float r, vec2 scale)
+{
+    vec3 cr = c * r;
+    float czr2 = c.z * c.z - r * r;
+    float vx = sqrt(c.x * c.x + czr2);
+    float minX = (vx * c.x - cr.z) / (vx * c.z + cr.x);
+    float maxX = (vx * c.x + cr.z) / (vx * c.z - cr.x);
+    float vy = sqrt(c.y * c.y + czr2);
+    float minY = (vy * c.y - cr.z) / (vy * c.z + cr.y);
+    float maxY = (vy * c.y + cr.z) / (vy * c.z - cr.y);
+    // y goes down on screen
+    vec4 bounds = vec4(minX * scale.x, maxY * scale.y,
+                       maxX * scale.x, minY * scale.y);
+    return bounds * vec4(0.5, -0.5, 0.5, -0.5) + 0.5;
+}
+
+// Depth pyramid to test against: its sampled handle, its level count, 0 when
+// there is none, and the extent of the depth it was built from
+struct Pyramid {
+    uint handle;
+    uint levels;
+    uvec2 size;
+};
+
+float pyramidTexel(Pyramid pyramid, ivec2 p, int level)
+{
+    return texelFetch(sampledImages[pyramid.handle], p, level).x;
+}
+
+// Whether the pyramid proves the sphere hidden when seen by that camera.
+// Depth is reversed, so the farthest depth of a footprint is its minimum.
+bool isOccluded(Pyramid pyramid, vec4 sphere, mat4 view, vec4 projection)
+{
+    if (pyramid.levels == 0)
+        return false;
+    vec3 center = (view * vec4(sphere.xyz, 1.0)).xyz;
+    // View space is scaled to the scene
+    float radius = sphere.w * length(view[0].xyz);
+    float near = projection.z;
+    float far = projection.w;
+    if (center.z - radius < near)
+        return false;
+
+    vec4 bounds = clamp(projectSphere(center, radius, projection.xy), 0.0, 1.0);
+    vec2 size = vec2(pyramid.size);
+    // Footprint in texels of the first level, which halves the depth, picks
+    // the level where it spans at most 2x2 texels
+    vec2 footprint = (bounds.zw - bounds.xy) * size * 0.5;
+    float level = max(ceil(log2(max(footprint.x, footprint.y))), 0.0);
+    if (level >= float(pyramid.levels))
+        return false;
+
+    int l = int(level);
+    ivec2 levelSize = ivec2(((pyramid.size - 1u) >> (l + 1)) + 1u);
+    vec2 scale = size / float(2 << l);
+    ivec2 lo = min(ivec2(bounds.xy * scale), levelSize - 1);
+    ivec2 hi = min(ivec2(bounds.zw * scale), levelSize - 1);
+    float farthest = min(min(pyramidTexel(pyramid, lo, l),
+                             pyramidTexel(pyramid, ivec2(hi.x, lo.y), l)),
+                         min(pyramidTexel(pyramid, ivec2(lo.x, hi.y), l),
+                             pyramidTexel(pyramid, hi, l)));
+
+    // Reversed depth of the closest point of the sphere
+    float z = center.z - radius;
+    float depth = near * (far - z) / ((far - near) * z);
+    return depth < farthest;
+}
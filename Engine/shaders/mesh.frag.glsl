@@ -0,0 +1,17 @@
+#version 460
+#pragma shader_stage(fragment)
+
+layout (location = 0) in vec3 inNormal;
+layout (location = 1) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main()
+{
+    // No materials yet, normals are shaded with a light behind the camera
+    // Interpolated normals can cancel out
+    vec3 normal = dot(inNormal, inNormal) > 0.0 ? normalize(inNormal)
+                                                : vec3(0.0, 0.0, -1.0);
+    float light = 0.2 + 0.8 * max(dot(normal, vec3(0.0, 0.0, -1.0)), 0.0);
+    outFragColor = vec4((normal * 0.5 + 0.5) * light, 1.0);
+}
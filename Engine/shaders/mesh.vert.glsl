@@ -0,0 +1,92 @@
+#version 460
+#extension GL_EXT_buffer_reference : require
+#pragma shader_stage(vertex)
+
+// Matches PackedVertex in mesh_data.hpp, read as 32 bit words: unorm16
+// position, octahedral snorm16 normal and half float UV
+struct PackedVertex {
+    uint positionXY;
+    uint positionZ;
+    uint normal;
+    uint uv;
+};
+
+// Matches GpuMesh in vk_gpu_scene.hpp
+struct Mesh {
+    uint firstIndex;
+    uint indexCount;
+    int vertexOffset;
+    uint firstMeshlet;
+    // Bounds the positions are quantized in
+    vec4 positionOffset;
+    vec4 positionScale;
+    vec4 sphere;
+    uint meshletCount;
+};
+
+// Matches GpuInstance in vk_gpu_scene.hpp
+struct Instance {
+    // Translation and uniform scale
+    vec4 transform;
+    vec4 sphere;
+    uint mesh;
+};
+
+// Every mesh lives in the same pool buffer, gl_VertexIndex already includes
+// the mesh's vertex offset
+layout (buffer_reference, std430) readonly buffer Vertices {
+    PackedVertex vertices[];
+};
+
+layout (buffer_reference, std430) readonly buffer Meshes {
+    Mesh meshes[];
+};
+
+layout (buffer_reference, std430) readonly buffer Instances {
+    Instance instances[];
+};
+
+layout (buffer_reference, std430) readonly buffer FrameConstants {
+    vec4 clearColor;
+    uint frameNum;
+    uint renderWidth;
+    uint renderHeight;
+    mat4 view;
+    mat4 viewProj;
+};
+
+layout (push_constant) uniform Constants {
+    FrameConstants frame;
+    Vertices vertices;
+    Meshes meshes;
+    Instances instances;
+} constants;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec2 outUV;
+
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+void main()
+{
+    // Draws pass the index of their instance as their first instance
+    Instance instance = constants.instances.instances[gl_InstanceIndex];
+    Mesh mesh = constants.meshes.meshes[instance.mesh];
+    PackedVertex v = constants.vertices.vertices[gl_VertexIndex];
+
+    vec3 position = vec3(unpackUnorm2x16(v.positionXY),
+                         unpackUnorm2x16(v.positionZ).x);
+    position = mesh.positionOffset.xyz + position * mesh.positionScale.xyz;
+    position = instance.transform.xyz + position * instance.transform.w;
+
+    gl_Position = constants.frame.viewProj * vec4(position, 1.0);
+    outNormal = mat3(constants.frame.view) *
+                decodeOctahedral(unpackSnorm2x16(v.normal));
+    outUV = unpackHalf2x16(v.uv);
+}
@@ -0,0 +1,148 @@
+#version 460
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_samplerless_texture_functions : require
+#extension GL_KHR_shader_subgroup_clustered : require
+#pragma shader_stage(compute)
+
+// 256 invocations per workgroup, see DepthPyramid::WORKGROUP
+layout (local_size_x_id = 0, local_size_y_id = 1, local_size_z = 1) in;
+
+// Bindless arrays, see BindlessHeap. Levels are written by every workgroup
+// and the last one reads them, so they are coherent.
+layout (set = 0, binding = 0) uniform texture2D sampledImages[];
+layout (set = 0, binding = 1, rg32f) uniform coherent image2D storageImages[];
+
+layout (buffer_reference, std430) buffer Counter {
+    uint value;
+};
+
+layout (push_constant) uniform Constants {
+    Counter counter;
+    // Sampled depth image, only its depthWidth x depthHeight region is read
+    uint depth;
+    uint depthWidth;
+    uint depthHeight;
+    uint levelCount;
+    // Storage handle of each level
+    uint levels[12];
+} constants;
+
+// Levels a workgroup writes from its tile
+const uint TILE_LEVELS = 6;
+
+shared vec2 reduced[64];
+shared bool lastGroup;
+
+// Invocations are laid out in Morton order, so that every 4 consecutive ones
+// hold a 2x2 block of texels, every 16 a 4x4 block, and so on
+uvec2 mortonDecode(uint index)
+{
+    uvec2 v = uvec2(index, index >> 1) & 0x55u;
+    v = (v | (v >> 1)) & 0x33u;
+    v = (v | (v >> 2)) & 0x0fu;
+    return v;
+}
+
+// Same rounding as DepthPyramid
+ivec2 levelSize(uint level)
+{
+    uvec2 size = uvec2(constants.depthWidth, constants.depthHeight);
+    return ivec2(((size - 1u) >> (level + 1u)) + 1u);
+}
+
+vec2 combine(vec2 a, vec2 b)
+{
+    return vec2(min(a.x, b.x), max(a.y, b.y));
+}
+
+// Reads of the level below are clamped, repeating edge texels changes neither
+// the minimum nor the maximum
+vec2 loadSource(uint level, ivec2 p)
+{
+    if (level == 0) {
+        ivec2 size = ivec2(constants.depthWidth, constants.depthHeight);
+        return vec2(texelFetch(sampledImages[constants.depth],
+                               min(p, size - 1), 0).x);
+    }
+    return imageLoad(storageImages[constants.levels[level - 1]],
+                     min(p, levelSize(level - 1) - 1)).xy;
+}
+
+void store(uint level, ivec2 p, vec2 value)
+{
+    if (level < constants.levelCount && all(lessThan(p, levelSize(level))))
+        imageStore(storageImages[constants.levels[level]], p, vec4(value, 0.0, 0.0));
+}
+
+// Writes levels base to base + 5 of a tile of 32x32 texels of base
+void reduceTile(uint base, uvec2 tile)
+{
+    uint index = gl_LocalInvocationIndex;
+    ivec2 texel = ivec2(tile * 16u + mortonDecode(index));
+
+    // Each invocation reduces 4x4 source texels into 2x2 texels of base, and
+    // those into one of base + 1. Depth stays within 0 and 1.
+    vec2 value = vec2(1.0, 0.0);
+    for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 2; x++) {
+            ivec2 p = texel * 2 + ivec2(x, y);
+            vec2 v = combine(combine(loadSource(base, p * 2),
+                                     loadSource(base, p * 2 + ivec2(1, 0))),
+                             combine(loadSource(base, p * 2 + ivec2(0, 1)),
+                                     loadSource(base, p * 2 + ivec2(1, 1))));
+            store(base, p, v);
+            value = combine(value, v);
+        }
+    }
+    store(base + 1, texel, value);
+
+    // 2x2 blocks of invocations share a subgroup cluster
+    value = vec2(subgroupClusteredMin(value.x, 4),
+                 subgroupClusteredMax(value.y, 4));
+    if ((index & 3u) == 0) {
+        store(base + 2, texel >> 1, value);
+        reduced[index >> 2] = value;
+    }
+    barrier();
+
+    // Then through shared memory, down to a single texel
+    for (uint count = 16, level = base + 3; count > 0; count >>= 2, level++) {
+        if (index < count) {
+            value = combine(combine(reduced[index * 4], reduced[index * 4 + 1]),
+                            combine(reduced[index * 4 + 2],
+                                    reduced[index * 4 + 3]));
+        }
+        barrier();
+        if (index < count) {
+            reduced[index] = value;
+            ivec2 p = ivec2(tile * (32u >> (level - base)) + mortonDecode(index));
+            store(level, p, value);
+        }
+        barrier();
+    }
+}
+
+void main()
+{
+    reduceTile(0, gl_WorkGroupID.xy);
+    if (constants.levelCount <= TILE_LEVELS)
+        return;
+
+    // The last workgroup to finish reduces the last level every workgroup
+    // wrote into the remaining ones
+    memoryBarrierImage();
+    barrier();
+    if (gl_LocalInvocationIndex == 0) {
+        uint groups = gl_NumWorkGroups.x * gl_NumWorkGroups.y;
+        lastGroup = atomicAdd(constants.counter.value, 1) == groups - 1;
+    }
+    barrier();
+    if (!lastGroup)
+        return;
+
+    // Ready for the next build
+    if (gl_LocalInvocationIndex == 0)
+        constants.counter.value = 0;
+    memoryBarrierImage();
+    reduceTile(TILE_LEVELS, uvec2(0));
+}
@@ -1,23 +1,43 @@
 #version 460
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_EXT_buffer_reference : require
 #pragma shader_stage(compute)
 
-layout (local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
-layout (set = 0, binding = 0, rgba16) uniform image2D image;
+// Specialized at pipeline creation, see WorkgroupSize
+layout (local_size_x_id = 0, local_size_y_id = 1, local_size_z = 1) in;
+
+// Bindless storage images, see BindlessHeap
+layout (set = 0, binding = 1, rgba16f) uniform image2D storageImages[];
+
+// Written by the CPU each frame in the frame linear allocator
+layout (buffer_reference, std430) readonly buffer FrameConstants {
+    vec4 clearColor;
+    uint frameNum;
+    uint renderWidth;
+    uint renderHeight;
+};
+
+layout (push_constant) uniform Constants {
+    FrameConstants frame;
+    uint image;
+} constants;
 
 void main()
 {
     ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy);
-    ivec2 size = imageSize(image);
+    // Only part of the image is rendered with dynamic resolution
+    ivec2 size = ivec2(constants.frame.renderWidth,
+                       constants.frame.renderHeight);
 
     if(texelCoord.x < size.x && texelCoord.y < size.y)
     {
-        vec4 color = vec4(0.0, 0.0, 0.0, 1.0);
+        vec4 color = vec4(0.0, 0.0, constants.frame.clearColor.b, 1.0);
 
         if(gl_LocalInvocationID.x != 0 && gl_LocalInvocationID.y != 0)
         {
             color.x = float(texelCoord.x)/(size.x);
             color.y = float(texelCoord.y)/(size.y);	
         }
-        imageStore(image, texelCoord, color);
+        imageStore(storageImages[constants.image], texelCoord, color);
     }
 }
@@ -0,0 +1,340 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace baldwin {
+
+// Index of the deque owned by the current thread, the main thread owns 0
+static constexpr uint32_t EXTERNAL_THREAD = UINT32_MAX;
+static thread_local uint32_t threadIndex = EXTERNAL_THREAD;
+// Spins before a worker goes to sleep when there is nothing to steal
+static constexpr int IDLE_SPINS = 64;
+// Jobs allocated at once, and moved between a thread's cache and the shared
+// free list
+static constexpr size_t JOB_BATCH = 64;
+
+bool JobDeque::push(Job* job) {
+    int64_t bottom = _bottom.load(std::memory_order_relaxed);
+    int64_t top = _top.load(std::memory_order_acquire);
+    if (bottom - top >= CAPACITY)
+	return false;
+
+    // Publishes the job to thieves reading _bottom
+    _jobs[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    _bottom.store(bottom + 1, std::memory_order_release);
+    return true;
+}
+
+Job* JobDeque::pop() {
+    int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+    _bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = _top.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+	// Empty
+	_bottom.store(bottom + 1, std::memory_order_relaxed);
+	return nullptr;
+    }
+
+    Job* job = _jobs[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (top == bottom) {
+	// Last job, race thieves for it
+	if (!_top.compare_exchange_strong(top,
+					  top + 1,
+					  std::memory_order_seq_cst,
+					  std::memory_order_relaxed)) {
+	    job = nullptr;
+	}
+	_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job* JobDeque::steal() {
+    int64_t top = _top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = _bottom.load(std::memory_order_acquire);
+    if (top >= bottom)
+	return nullptr;
+
+    Job* job = _jobs[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!_top.compare_exchange_strong(
+	  top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+	return nullptr;
+    }
+    return job;
+}
+
+void JobSystem::init(uint32_t threadCount) {
+    if (threadCount == 0)
+	threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    _stop = false;
+    threadIndex = 0;
+    _jobCaches = std::vector<JobCache>(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++) {
+	_deques.push_back(std::make_unique<JobDeque>());
+    }
+    for (uint32_t i = 1; i < threadCount; i++) {
+	_workers.emplace_back([this, i]() { workerLoop(i); });
+    }
+}
+
+void JobSystem::shutdown() {
+    {
+	std::lock_guard<std::mutex> lock(_sleepMutex);
+	_stop = true;
+    }
+    _wake.notify_all();
+    for (std::thread& worker : _workers) {
+	worker.join();
+    }
+    _workers.clear();
+
+    // Whatever was left behind still runs, counters may be waited on
+    while (Job* job = findJob(threadIndex, true)) {
+	execute(job);
+    }
+    _deques.clear();
+
+    _jobCaches.clear();
+    _freeJobs.clear();
+    _jobBlocks.clear();
+}
+
+void JobSystem::run(std::function<void()>&& fn, JobCounter* counter) {
+    if (counter)
+	counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+    Job* job = allocateJob();
+    job->fn = std::move(fn);
+    job->counter = counter;
+    push(job);
+}
+
+void JobSystem::runBackground(std::function<void()>&& fn,
+			      JobCounter* counter) {
+    if (counter)
+	counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+    Job* job = allocateJob();
+    job->fn = std::move(fn);
+    job->counter = counter;
+    _queued.fetch_add(1);
+    {
+	std::lock_guard<std::mutex> lock(_backgroundMutex);
+	_background.push_back(job);
+	_backgroundCount.fetch_add(1);
+    }
+    wake();
+}
+
+void JobSystem::wait(JobCounter& counter) {
+    while (!counter.done()) {
+	// Jobs may index per-thread resources, none belong to threads outside
+	// the pool. Background jobs of someone else would hold this thread for
+	// long.
+	Job* job = nullptr;
+	if (threadIndex != EXTERNAL_THREAD) {
+	    job = findJob(threadIndex, false);
+	    if (!job)
+		job = takeBackground(&counter);
+	}
+	if (job)
+	    execute(job);
+	else
+	    std::this_thread::yield();
+    }
+
+    if (counter.failed.load(std::memory_order_relaxed)) {
+	std::exception_ptr error = std::exchange(counter.error, nullptr);
+	counter.failed.store(false, std::memory_order_relaxed);
+	std::rethrow_exception(error);
+    }
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t grainSize,
+			    const RangeFn& fn) {
+    if (grainSize == 0)
+	grainSize = std::max(1u, count / (threadCount() * 4));
+
+    JobCounter counter;
+    for (uint32_t begin = 0; begin < count; begin += grainSize) {
+	uint32_t end = std::min(count, begin + grainSize);
+	run([&fn, begin, end]() { fn(begin, end); }, &counter);
+    }
+    wait(counter);
+}
+
+uint32_t JobSystem::currentThreadIndex() { return threadIndex; }
+
+void JobSystem::workerLoop(uint32_t index) {
+    threadIndex = index;
+    int idle = 0;
+    while (!_stop.load(std::memory_order_relaxed)) {
+	if (Job* job = findJob(index, true)) {
+	    execute(job);
+	    idle = 0;
+	    continue;
+	}
+
+	if (++idle < IDLE_SPINS) {
+	    std::this_thread::yield();
+	    continue;
+	}
+
+	// Checking _queued after announcing we sleep pairs with push() reading
+	// _sleeping after queuing, one of the two always sees the other
+	std::unique_lock<std::mutex> lock(_sleepMutex);
+	_sleeping.fetch_add(1);
+	_wake.wait(lock,
+		   [this]() { return _stop.load() || _queued.load() > 0; });
+	_sleeping.fetch_sub(1);
+	idle = 0;
+    }
+}
+
+Job* JobSystem::findJob(uint32_t index, bool background) {
+    Job* job = _deques[index]->pop();
+    if (!job && _injectedCount.load(std::memory_order_relaxed) > 0) {
+	std::lock_guard<std::mutex> lock(_injectedMutex);
+	if (!_injected.empty()) {
+	    job = _injected.front();
+	    _injected.pop_front();
+	    _injectedCount.fetch_sub(1, std::memory_order_relaxed);
+	}
+    }
+    for (uint32_t i = 1; job == nullptr && i < _deques.size(); i++) {
+	job = _deques[(index + i) % _deques.size()]->steal();
+    }
+    if (job) {
+	_queued.fetch_sub(1);
+	return job;
+    }
+    return background ? takeBackground(nullptr) : nullptr;
+}
+
+Job* JobSystem::takeBackground(const JobCounter* counter) {
+    if (_backgroundCount.load(std::memory_order_relaxed) == 0)
+	return nullptr;
+
+    std::lock_guard<std::mutex> lock(_backgroundMutex);
+    // Any job when counter is null, else the oldest one it counts
+    auto it = std::find_if(_background.begin(),
+			   _background.end(),
+			   [counter](const Job* job) {
+			       return !counter || job->counter == counter;
+			   });
+    if (it == _background.end())
+	return nullptr;
+
+    Job* job = *it;
+    _background.erase(it);
+    _backgroundCount.fetch_sub(1, std::memory_order_relaxed);
+    _queued.fetch_sub(1);
+    return job;
+}
+
+void JobSystem::push(Job* job) {
+    // Counted before pushing so that thieves never see it go below zero
+    _queued.fetch_add(1);
+    if (threadIndex == EXTERNAL_THREAD) {
+	std::lock_guard<std::mutex> lock(_injectedMutex);
+	_injected.push_back(job);
+	_injectedCount.fetch_add(1, std::memory_order_relaxed);
+    } else if (!_deques[threadIndex]->push(job)) {
+	// Full deque, the caller does the work itself
+	_queued.fetch_sub(1);
+	execute(job);
+	return;
+    }
+    wake();
+}
+
+void JobSystem::wake() {
+    if (_sleeping.load() > 0) {
+	std::lock_guard<std::mutex> lock(_sleepMutex);
+	_wake.notify_one();
+    }
+}
+
+void JobSystem::execute(Job* job) {
+    std::exception_ptr error;
+    try {
+	job->fn();
+    } catch (...) {
+	error = std::current_exception();
+    }
+    // Released first, so that whatever the job captured is gone by the time
+    // its waiter returns
+    JobCounter* counter = job->counter;
+    releaseJob(job);
+    if (!counter) {
+	// Nobody waits for it, so it propagates to whoever ran it
+	if (error)
+	    std::rethrow_exception(error);
+	return;
+    }
+    if (error && !counter->failed.exchange(true, std::memory_order_relaxed))
+	counter->error = error;
+    counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+Job* JobSystem::allocateJob() {
+    if (threadIndex == EXTERNAL_THREAD) {
+	std::lock_guard<std::mutex> lock(_freeMutex);
+	if (_freeJobs.empty()) {
+	    Job* block = _jobBlocks
+			   .emplace_back(std::make_unique<Job[]>(JOB_BATCH))
+			   .get();
+	    for (size_t i = 0; i < JOB_BATCH; i++)
+		_freeJobs.push_back(&block[i]);
+	}
+	Job* job = _freeJobs.back();
+	_freeJobs.pop_back();
+	return job;
+    }
+
+    std::vector<Job*>& cache = _jobCaches[threadIndex].jobs;
+    if (cache.empty()) {
+	std::lock_guard<std::mutex> lock(_freeMutex);
+	size_t count = std::min(JOB_BATCH, _freeJobs.size());
+	cache.insert(cache.end(), _freeJobs.end() - count, _freeJobs.end());
+	_freeJobs.resize(_freeJobs.size() - count);
+	if (cache.empty()) {
+	    Job* block = _jobBlocks
+			   .emplace_back(std::make_unique<Job[]>(JOB_BATCH))
+			   .get();
+	    for (size_t i = 0; i < JOB_BATCH; i++)
+		cache.push_back(&block[i]);
+	}
+    }
+    Job* job = cache.back();
+    cache.pop_back();
+    return job;
+}
+
+void JobSystem::releaseJob(Job* job) {
+    job->fn = nullptr;
+    job->counter = nullptr;
+
+    if (threadIndex == EXTERNAL_THREAD) {
+	std::lock_guard<std::mutex> lock(_freeMutex);
+	_freeJobs.push_back(job);
+	return;
+    }
+
+    // Hands a batch back once the cache holds two, jobs freed on another
+    // thread than the one allocating them don't pile up here
+    std::vector<Job*>& cache = _jobCaches[threadIndex].jobs;
+    cache.push_back(job);
+    if (cache.size() >= 2 * JOB_BATCH) {
+	std::lock_guard<std::mutex> lock(_freeMutex);
+	_freeJobs.insert(_freeJobs.end(), cache.end() - JOB_BATCH, cache.end());
+	cache.resize(cache.size() - JOB_BATCH);
+    }
+}
+
+} // namespace baldwin
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace baldwin {
+
+// Counts the jobs of a group that have not finished yet. The first exception
+// one of them throws is kept and rethrown by JobSystem::wait.
+struct JobCounter {
+    std::atomic<uint32_t> pending{ 0 };
+    // Written by the job setting failed, before it stops being pending
+    std::atomic<bool> failed{ false };
+    std::exception_ptr error;
+
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+struct Job {
+    std::function<void()> fn;
+    JobCounter* counter = nullptr;
+};
+
+// Chase-Lev work-stealing deque of fixed capacity. Only the owning thread
+// pushes and pops, at the bottom, while any thread can steal from the top.
+class JobDeque {
+  public:
+    static constexpr int64_t CAPACITY = 4096;
+
+    // False when the deque is full
+    bool push(Job* job);
+    Job* pop();
+    Job* steal();
+
+  private:
+    alignas(64) std::atomic<int64_t> _top{ 0 };
+    alignas(64) std::atomic<int64_t> _bottom{ 0 };
+    std::array<std::atomic<Job*>, CAPACITY> _jobs{};
+};
+
+// Work-stealing thread pool. Every worker owns a deque, and so does the main
+// thread, i.e. the one calling init. Jobs submitted by these threads go to
+// their own deque, idle threads steal from the others. Other threads submit
+// through a locked injection queue. Waiting on a counter executes jobs until
+// it reaches zero, so the main thread helps instead of blocking.
+//
+// Background jobs, e.g. loading or compiling, are long enough to stall a
+// frame. They have their own queue, which idle workers take from but
+// waiting threads don't unless they wait for that very job.
+class JobSystem {
+  public:
+    // threadCount includes the main thread, 0 uses every hardware thread
+    void init(uint32_t threadCount = 0);
+    void shutdown();
+
+    void run(std::function<void()>&& fn, JobCounter* counter = nullptr);
+    void runBackground(std::function<void()>&& fn,
+		       JobCounter* counter = nullptr);
+    // Threads outside the pool only yield until the counter reaches zero.
+    // Rethrows what a job of the counter threw, and resets it.
+    void wait(JobCounter& counter);
+    // Splits [0, count) in ranges of grainSize and waits for all of them, a
+    // grainSize of 0 picks one giving a few ranges per thread
+    using RangeFn = std::function<void(uint32_t begin, uint32_t end)>;
+    void parallelFor(uint32_t count, uint32_t grainSize, const RangeFn& fn);
+
+    // Index of the calling thread, 0 for the main thread, lets jobs pick
+    // per-thread resources. UINT32_MAX outside the pool, where no job runs.
+    static uint32_t currentThreadIndex();
+    uint32_t threadCount() const {
+	return static_cast<uint32_t>(_deques.size());
+    }
+
+  private:
+    // Recycled jobs of one thread, exchanged in batches with the shared list
+    struct alignas(64) JobCache {
+	std::vector<Job*> jobs;
+    };
+
+    void workerLoop(uint32_t index);
+    // Own deque, then injected jobs, then the other deques. Background jobs
+    // last when allowed.
+    Job* findJob(uint32_t index, bool background);
+    Job* takeBackground(const JobCounter* counter);
+    void push(Job* job);
+    void wake();
+    void execute(Job* job);
+    Job* allocateJob();
+    void releaseJob(Job* job);
+
+    std::vector<std::unique_ptr<JobDeque>> _deques;
+    // Pushed by threads outside the pool
+    std::mutex _injectedMutex;
+    std::deque<Job*> _injected;
+    std::atomic<uint32_t> _injectedCount{ 0 };
+    std::mutex _backgroundMutex;
+    std::deque<Job*> _background;
+    std::atomic<uint32_t> _backgroundCount{ 0 };
+    // Every job lives in a block, threads cache free ones
+    std::vector<JobCache> _jobCaches;
+    std::mutex _freeMutex;
+    std::vector<Job*> _freeJobs;
+    std::vector<std::unique_ptr<Job[]>> _jobBlocks;
+    std::vector<std::thread> _workers;
+    std::atomic<bool> _stop{ false };
+    // Jobs pushed and not taken yet, lets workers go to sleep
+    std::atomic<uint32_t> _queued{ 0 };
+    std::atomic<uint32_t> _sleeping{ 0 };
+    std::mutex _sleepMutex;
+    std::condition_variable _wake;
+};
+
+} // namespace baldwin
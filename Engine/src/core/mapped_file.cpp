@@ -0,0 +1,70 @@
+#include "mapped_file.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace baldwin {
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : _data(std::exchange(other._data, nullptr))
+  , _size(std::exchange(other._size, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+	close();
+	_data = std::exchange(other._data, nullptr);
+	_size = std::exchange(other._size, 0);
+    }
+    return *this;
+}
+
+void MappedFile::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+	throw std::runtime_error(
+	  std::format("Could not open {} : {}", path, std::strerror(errno)));
+    }
+
+    struct stat info{};
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+	::close(fd);
+	throw std::runtime_error(std::format("Could not map empty {}", path));
+    }
+
+    // The mapping keeps its own reference to the file
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+	throw std::runtime_error(
+	  std::format("Could not map {} : {}", path, std::strerror(errno)));
+    }
+    _data = static_cast<const uint8_t*>(data);
+    _size = static_cast<size_t>(info.st_size);
+}
+
+void MappedFile::close() {
+    if (!_data)
+	return;
+    munmap(const_cast<uint8_t*>(_data), _size);
+    _data = nullptr;
+    _size = 0;
+}
+
+void MappedFile::prefetch() const {
+    if (_data)
+	madvise(const_cast<uint8_t*>(_data), _size, MADV_WILLNEED);
+}
+
+} // namespace baldwin
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace baldwin {
+
+// Read-only mapping of a whole file. Pages are read on first access, so
+// nothing is copied or parsed before the data is used. Unmapped when
+// destroyed, moving transfers the mapping.
+class MappedFile {
+  public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Throws if the file can't be mapped
+    void open(const std::string& path);
+    void close();
+    // Asks the kernel to start reading every page ahead of use
+    void prefetch() const;
+
+    const uint8_t* data() const { return _data; }
+    size_t size() const { return _size; }
+
+  private:
+    const uint8_t* _data = nullptr;
+    size_t _size = 0;
+};
+
+} // namespace baldwin
@@ -1,6 +1,8 @@
 #include "engine.hpp"
 
 #include <cassert>
+#include <cfloat>
+#include <cinttypes>
 #include <iostream>
 #include <memory>
 #include <imgui.h>
@@ -12,10 +14,16 @@ namespace baldwin {
 Engine* loadedEngine = nullptr;
 Engine& get() { return *loadedEngine; }
 
-Engine::Engine(int width, int height, RenderAPI api)
+Engine::Engine(int width, int height, RenderAPI api, RendererSettings settings)
   : _width(width)
   , _height(height)
-  , _api(api) {
+  , _api(api)
+  , _settings(settings)
+  , _framesInFlight(static_cast<int>(settings.framesInFlight))
+  , _presentMode(static_cast<int>(settings.presentMode))
+  , _lowLatency(settings.lowLatency)
+  , _dynamicResolution(settings.dynamicResolution)
+  , _targetFrameMs(static_cast<float>(settings.targetFrameMs)) {
     switch (_api) {
 	    /* Always defaults to vulkan for now */
 	default:
@@ -26,9 +34,12 @@ Engine::Engine(int width, int height, RenderAPI api)
 bool Engine::init() {
     assert(loadedEngine == nullptr);
 
-    assert(initWindow() == true);
-    assert(initImgui() == true);
-    assert(_renderer->init(_window, _width, _height, false) == true);
+    _jobs.init();
+    // Not asserted, release builds would skip initialization altogether
+    if (!initWindow() || !initImgui() ||
+	!_renderer->init(_window, _width, _height, _settings, _jobs)) {
+	return false;
+    }
 
     std::cout << "- Engine init\n";
 
@@ -36,10 +47,14 @@ bool Engine::init() {
 }
 
 bool Engine::initWindow() {
-    assert(glfwInit() == 1);
+    // Platform hints only apply if set before glfwInit. Headless runs use the
+    // null platform so that no display server is required.
+    glfwInitHint(GLFW_PLATFORM,
+		 _settings.headless ? GLFW_PLATFORM_NULL : GLFW_PLATFORM_X11);
+    if (glfwInit() != GLFW_TRUE)
+	return false;
 
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_X11);
     /*glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);*/
     _window = glfwCreateWindow(
       _width, _height, "Baldwin Engine", nullptr, nullptr);
@@ -59,23 +74,174 @@ bool Engine::initImgui() {
 void Engine::run() {
     std::cout << "- Engine run\n";
     while (!glfwWindowShouldClose(_window)) {
-	glfwPollEvents();
-	_renderer->newImguiFrame();
-	ImGui::NewFrame();
-	{
-	    ImGui::Begin("Settings");
-	    ImGui::End();
+	runFrame();
+    }
+}
+
+void Engine::runFrame() {
+    // Input is sampled once the renderer is ready to record, so that it is as
+    // recent as possible when the frame is presented
+    _renderer->waitForNextFrame();
+    glfwPollEvents();
+    _renderer->newImguiFrame();
+    ImGui::NewFrame();
+    drawSettings();
+    ImGui::EndFrame();
+    ImGui::Render();
+    _renderer->run(_frame);
+    _frame++;
+}
+
+void Engine::drawSettings() {
+    ImGui::Begin("Settings");
+    if (ImGui::CollapsingHeader("Frame pacing",
+				ImGuiTreeNodeFlags_DefaultOpen)) {
+	if (ImGui::SliderInt("Frames in flight", &_framesInFlight, 1, 4)) {
+	    _renderer->setFramesInFlight(
+	      static_cast<uint32_t>(_framesInFlight));
+	}
+	static const char* presentModes[] = {
+	    "Fifo", "Fifo relaxed", "Mailbox", "Immediate"
+	};
+	if (ImGui::Combo("Present mode",
+			 &_presentMode,
+			 presentModes,
+			 IM_ARRAYSIZE(presentModes))) {
+	    _renderer->setPresentMode(static_cast<PresentMode>(_presentMode));
 	}
-	ImGui::EndFrame();
-	ImGui::Render();
-	_renderer->run(_frame);
-	_frame++;
+	if (ImGui::Checkbox("Low latency", &_lowLatency))
+	    _renderer->setLowLatency(_lowLatency);
+
+	FrameTimings timings = _renderer->getFrameTimings();
+	ImGui::Text(
+	  "Active mode : %s",
+	  presentModes[static_cast<int>(_renderer->getPresentMode())]);
+	ImGui::Text("CPU wait : %.3f ms | GPU frame : %.3f ms",
+		    timings.cpuWaitMs,
+		    timings.gpuMs);
+	ImGui::Text("Input to GPU done : %.3f ms", timings.inputLatencyMs);
+    }
+    if (ImGui::CollapsingHeader("Dynamic resolution")) {
+	bool changed = ImGui::Checkbox("Enabled", &_dynamicResolution);
+	changed |= ImGui::SliderFloat(
+	  "Target GPU ms", &_targetFrameMs, 1.0f, 33.3f, "%.1f");
+	if (changed)
+	    _renderer->setDynamicResolution(_dynamicResolution, _targetFrameMs);
+
+	FrameTimings timings = _renderer->getFrameTimings();
+	ImGui::Text("Rendering %ux%u (%.0f%%)",
+		    timings.renderWidth,
+		    timings.renderHeight,
+		    timings.renderScale * 100.0f);
+    }
+    if (ImGui::CollapsingHeader("GPU passes", ImGuiTreeNodeFlags_DefaultOpen)) {
+	for (const PassStatistics& pass : _renderer->getPassStatistics()) {
+	    ImGui::Text("%s : %.3f ms", pass.name.c_str(), pass.lastGpuMs());
+	    ImGui::PlotLines(("##" + pass.name).c_str(),
+			     pass.gpuMs.data(),
+			     PassStatistics::HISTORY_SIZE,
+			     pass.historyOffset,
+			     nullptr,
+			     0.0f,
+			     FLT_MAX,
+			     ImVec2(0.0f, 40.0f));
+	    if (pass.vertexInvocations + pass.fragmentInvocations +
+		  pass.computeInvocations ==
+		0) {
+		continue;
+	    }
+	    ImGui::Text("VS %" PRIu64 " | FS %" PRIu64 " | CS %" PRIu64,
+			pass.vertexInvocations,
+			pass.fragmentInvocations,
+			pass.computeInvocations);
+	}
+    }
+    if (ImGui::CollapsingHeader("Uploads")) {
+	UploadStatistics uploads = _renderer->getUploadStatistics();
+	ImGui::Text("%.2f MB/s | %.2f MB total",
+		    uploads.mbPerSecond,
+		    toMegabytes(uploads.bytesUploaded));
+	ImGui::Text(
+	  "Ring stalls : %u (%.3f ms)", uploads.stalls, uploads.stallMs);
+    }
+    if (ImGui::CollapsingHeader("Pipelines")) {
+	PsoCacheStatistics psos = _renderer->getPsoCacheStatistics();
+	ImGui::Text("Unique : %u graphics | %u compute",
+		    psos.graphicsPipelines,
+		    psos.computePipelines);
+	ImGui::Text(
+	  "Hits %" PRIu64 " | Misses %" PRIu64, psos.hits, psos.misses);
+	StartupTimings startup = _renderer->getStartupTimings();
+	ImGui::Text("Built in %.1f ms (%s cache, %s)",
+		    startup.pipelinesMs,
+		    startup.warmPipelineCache ? "warm" : "cold",
+		    startup.asyncPipelines ? "async" : "sync");
+	ImGui::Text("First frame after %.1f ms", startup.firstFrameMs);
+    }
+    if (ImGui::CollapsingHeader("Render graph")) {
+	RenderGraphStatistics graph = _renderer->getRenderGraphStatistics();
+	ImGui::Text("%u passes | %u culled", graph.passes, graph.culledPasses);
+	ImGui::Text("%u on the compute queue | %u kept on graphics",
+		    graph.computePasses,
+		    graph.computeFallbacks);
+	ImGui::Text("Transient : %.1f MB (%.1f MB without aliasing)",
+		    toMegabytes(graph.transientBytes),
+		    toMegabytes(graph.unaliasedBytes));
     }
+    if (ImGui::CollapsingHeader("Meshes")) {
+	MeshStatistics meshes = _renderer->getMeshStatistics();
+	ImGui::Text("%u meshes | %" PRIu64 " triangles",
+		    meshes.meshes,
+		    meshes.triangles);
+	ImGui::Text("Loaded in %.1f ms | %.1f MB/s",
+		    meshes.loadMs,
+		    meshes.mbPerSecond);
+	ImGui::Text("Pool : %.1f MB", toMegabytes(meshes.poolBytes));
+	CullStatistics culling = _renderer->getCullStatistics();
+	ImGui::Text("%u of %u instances visible (%s culling)",
+		    culling.visibleInstances,
+		    culling.instances,
+		    culling.gpuCulling ? "GPU" : "no");
+	if (culling.gpuCulling) {
+	    ImGui::Text("%u frustum culled, %u occlusion culled%s",
+			culling.frustumCulled,
+			culling.occlusionCulled,
+			culling.occlusionCulling ? "" : " (disabled)");
+	    ImGui::Text("%u of %u clusters, %llu of %llu triangles drawn%s",
+			culling.clustersDrawn,
+			culling.clusters,
+			static_cast<unsigned long long>(culling.trianglesDrawn),
+			static_cast<unsigned long long>(culling.triangles),
+			culling.clusterCulling ? "" : " (cluster culling disabled)");
+	}
+    }
+    ImGui::End();
+}
+
+FrameTimings Engine::getFrameTimings() const {
+    return _renderer->getFrameTimings();
+}
+
+StartupTimings Engine::getStartupTimings() const {
+    return _renderer->getStartupTimings();
+}
+
+PsoCacheStatistics Engine::getPsoCacheStatistics() const {
+    return _renderer->getPsoCacheStatistics();
+}
+
+MeshStatistics Engine::getMeshStatistics() const {
+    return _renderer->getMeshStatistics();
+}
+
+CullStatistics Engine::getCullStatistics() const {
+    return _renderer->getCullStatistics();
 }
 
 void Engine::cleanup() {
     std::cout << "- Engine cleanup\n";
     _renderer->cleanup();
+    _jobs.shutdown();
     glfwDestroyWindow(_window);
     glfwTerminate();
 }
@@ -3,6 +3,7 @@
 
 #include <memory>
 
+#include "core/job_system.hpp"
 #include "renderer/renderer.hpp"
 
 namespace baldwin {
@@ -12,21 +13,37 @@ enum RenderAPI { Vulkan, DirectX12 };
 class Engine {
   public:
     static Engine& get();
-    Engine(int width, int height, RenderAPI api);
+    Engine(int width, int height, RenderAPI api,
+	   RendererSettings settings = {});
 
     bool init();
     void run();
+    void runFrame();
     void cleanup();
+    FrameTimings getFrameTimings() const;
+    StartupTimings getStartupTimings() const;
+    PsoCacheStatistics getPsoCacheStatistics() const;
+    MeshStatistics getMeshStatistics() const;
+    CullStatistics getCullStatistics() const;
+    JobSystem& getJobSystem() { return _jobs; }
 
   private:
     bool initWindow();
     bool initImgui();
+    void drawSettings();
 
     int _frame = 0;
     int _width, _height;
     GLFWwindow* _window = nullptr;
     const RenderAPI _api;
+    const RendererSettings _settings;
+    int _framesInFlight;
+    int _presentMode;
+    bool _lowLatency;
+    bool _dynamicResolution;
+    float _targetFrameMs;
     std::unique_ptr<Renderer> _renderer;
+    JobSystem _jobs;
 };
 
 } // namespace baldwin
@@ -0,0 +1,109 @@
+#include "camera.hpp"
+
+#include <cmath>
+
+namespace baldwin {
+
+static constexpr float FOV_Y = 60.0f * 3.14159265f / 180.0f;
+// In scene radii, close enough for a camera inside the scene
+static constexpr float NEAR = 0.01f;
+
+// Row major 4x4, converted when stored
+using Matrix = float[4][4];
+
+static void multiply(const Matrix a, const Matrix b, Matrix out) {
+    for (int r = 0; r < 4; r++) {
+	for (int c = 0; c < 4; c++) {
+	    out[r][c] = 0.0f;
+	    for (int k = 0; k < 4; k++) {
+		out[r][c] += a[r][k] * b[k][c];
+	    }
+	}
+    }
+}
+
+static void storeColumnMajor(const Matrix m, float* out) {
+    for (int r = 0; r < 4; r++) {
+	for (int c = 0; c < 4; c++) {
+	    out[c * 4 + r] = m[r][c];
+	}
+    }
+}
+
+CameraMatrices computeCameraMatrices(const OrbitCamera& camera) {
+    // The whole scene stays in front of the far plane
+    float far = camera.distance + 1.5f;
+    float c = std::cos(camera.angle);
+    float s = std::sin(camera.angle);
+    float invRadius = 1.0f / camera.bounds[3];
+    const float* center = camera.bounds;
+
+    // Rotates around y, scales the scene to a unit sphere and moves it
+    // distance radii away
+    float rotation[3][3] = { { c, 0.0f, s },
+			     { 0.0f, 1.0f, 0.0f },
+			     { -s, 0.0f, c } };
+    Matrix view = {};
+    for (int r = 0; r < 3; r++) {
+	float translation = 0.0f;
+	for (int k = 0; k < 3; k++) {
+	    view[r][k] = rotation[r][k] * invRadius;
+	    translation -= view[r][k] * center[k];
+	}
+	view[r][3] = translation;
+    }
+    view[2][3] += camera.distance;
+    view[3][3] = 1.0f;
+
+    // Vulkan's y axis points down. Depth is reversed, from 1 at NEAR to 0 at
+    // far, which spreads float precision evenly over the distance.
+    float f = 1.0f / std::tan(FOV_Y * 0.5f);
+    Matrix projection = {};
+    projection[0][0] = f / camera.aspect;
+    projection[1][1] = -f;
+    projection[2][2] = -NEAR / (far - NEAR);
+    projection[2][3] = NEAR * far / (far - NEAR);
+    projection[3][2] = 1.0f;
+
+    Matrix viewProj;
+    multiply(projection, view, viewProj);
+
+    CameraMatrices matrices{};
+    storeColumnMajor(view, matrices.view);
+    storeColumnMajor(viewProj, matrices.viewProj);
+    matrices.projection[0] = f / camera.aspect;
+    matrices.projection[1] = f;
+    matrices.projection[2] = NEAR;
+    matrices.projection[3] = far;
+    // Where the view maps the origin, distance radii behind the center
+    float back = camera.distance * camera.bounds[3];
+    matrices.position[0] = center[0] - back * rotation[2][0];
+    matrices.position[1] = center[1] - back * rotation[2][1];
+    matrices.position[2] = center[2] - back * rotation[2][2];
+    matrices.position[3] = 1.0f;
+
+    // Gribb and Hartmann, clip space is -w <= x, y <= w and 0 <= z <= w with
+    // the near plane at z = w
+    const float* row0 = viewProj[0];
+    const float* row1 = viewProj[1];
+    const float* row2 = viewProj[2];
+    const float* row3 = viewProj[3];
+    for (int i = 0; i < 4; i++) {
+	matrices.frustum[0][i] = row3[i] + row0[i];
+	matrices.frustum[1][i] = row3[i] - row0[i];
+	matrices.frustum[2][i] = row3[i] + row1[i];
+	matrices.frustum[3][i] = row3[i] - row1[i];
+	matrices.frustum[4][i] = row3[i] - row2[i];
+	matrices.frustum[5][i] = row2[i];
+    }
+    for (float* plane : matrices.frustum) {
+	float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] +
+				 plane[2] * plane[2]);
+	for (int i = 0; i < 4; i++) {
+	    plane[i] /= length;
+	}
+    }
+    return matrices;
+}
+
+} // namespace baldwin
@@ -0,0 +1,35 @@
+#pragma once
+
+namespace baldwin {
+
+// Camera orbiting around the bounding sphere of the scene, looking at its
+// center. View space is scaled to scene radii, x goes right, y up and z away
+// from the camera.
+struct OrbitCamera {
+    // Center and radius of the scene
+    float bounds[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    // From the camera to the scene center, in scene radii. Below 1 the camera
+    // is inside the scene.
+    float distance = 2.5f;
+    // Around the y axis, in radians
+    float angle = 0.0f;
+    float aspect = 1.0f;
+};
+
+// Matrices are column major, as GLSL reads them
+struct CameraMatrices {
+    float view[16];
+    float viewProj[16];
+    // World space planes, normals pointing inwards and normalized: left,
+    // right, bottom, top, near and far
+    float frustum[6][4];
+    // Scales of x and y, near and far distances, for projecting bounds
+    // without the full matrix. Depth is reversed, 1 at near and 0 at far.
+    float projection[4];
+    // World space position of the camera, w unused
+    float position[4];
+};
+
+CameraMatrices computeCameraMatrices(const OrbitCamera& camera);
+
+} // namespace baldwin
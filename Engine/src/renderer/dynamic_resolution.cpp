@@ -0,0 +1,23 @@
+#include "dynamic_resolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace baldwin {
+
+void ResolutionController::update(double gpuMs) {
+    if (gpuMs <= 0.0)
+	return;
+
+    double ratio = _targetMs / gpuMs;
+    if (ratio > 1.0 && ratio * HEADROOM < 1.0)
+	return; // Within budget, with too little headroom to grow
+    if (ratio > 1.0)
+	ratio *= HEADROOM;
+
+    float desired = _scale * static_cast<float>(std::sqrt(ratio));
+    _scale += (desired - _scale) * DAMPING;
+    _scale = std::clamp(_scale, _minScale, 1.0f);
+}
+
+} // namespace baldwin
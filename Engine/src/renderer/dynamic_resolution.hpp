@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+namespace baldwin {
+
+// Picks the fraction of the full resolution to render at so that GPU frame
+// times stay within a budget. The pixel count, and so roughly the GPU cost,
+// goes with the square of the scale.
+class ResolutionController {
+  public:
+    // Scales move by a fraction of the correction each sample, since GPU
+    // timings come back a few frames late and are noisy
+    static constexpr float DAMPING = 0.25f;
+    // Scales only grow back once frames are this far under budget, which
+    // keeps them from oscillating around it
+    static constexpr float HEADROOM = 0.9f;
+
+    void setBudget(double targetMs, float minScale) {
+	_targetMs = targetMs;
+	_minScale = minScale;
+    }
+    // Feeds the GPU time of a frame rendered at the current scale
+    void update(double gpuMs);
+    void reset() { _scale = 1.0f; }
+    float scale() const { return _scale; }
+
+  private:
+    double _targetMs = 16.6;
+    float _minScale = 0.5f;
+    float _scale = 1.0f;
+};
+
+} // namespace baldwin
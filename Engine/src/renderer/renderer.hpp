@@ -2,15 +2,217 @@
 
 #include <GLFW/glfw3.h>
 
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
 namespace baldwin {
 
+class JobSystem;
+
+// Modes that are not supported fall back to the closest one, down to Fifo
+// which always is
+enum class PresentMode { Fifo, FifoRelaxed, Mailbox, Immediate };
+
+struct RendererSettings {
+    // Frames the CPU may record ahead of the GPU, from 1 to 4. More frames
+    // keep the GPU busier at the cost of input latency
+    uint32_t framesInFlight = 2;
+    PresentMode presentMode = PresentMode::Fifo;
+    // Wait for the previous frame to complete before sampling input, instead
+    // of only for the frame whose resources are reused
+    bool lowLatency = false;
+    // Render offscreen into the draw image, without any surface or swapchain
+    bool headless = false;
+    // Collect shader invocation counts per pass when the device supports it
+    bool pipelineStatistics = true;
+    // Where the pipeline cache is persisted, empty to disable persistence
+    std::string pipelineCachePath = "pipeline_cache.bin";
+    // Record large passes on every job thread through secondary command
+    // buffers
+    bool parallelRecording = true;
+    // How many times the test triangle is drawn, to stress draw recording
+    uint32_t triangleDraws = 1;
+    // Run compute passes on a separate compute queue when the device has
+    // one, overlapping them with graphics work of the previous frame
+    bool asyncCompute = true;
+    // Time every candidate workgroup size of compute kernels at startup and
+    // keep the fastest, instead of reusing earlier results
+    bool tuneCompute = false;
+    // Where tuned workgroup sizes are persisted, empty to disable persistence
+    std::string computeTuningPath = "compute_tuning.txt";
+    // Compile pipelines on the job threads and draw fallbacks until they are
+    // ready, instead of waiting for them before the first frame
+    bool asyncPipelines = true;
+    // Render at a fraction of the full resolution, adjusted from GPU frame
+    // times to stay within targetFrameMs, and upscale when presenting
+    bool dynamicResolution = false;
+    double targetFrameMs = 16.6;
+    float minRenderScale = 0.5f;
+    // glTF or cooked .bmesh scene loaded in the background and drawn once
+    // uploaded, empty for none
+    std::string scenePath;
+    // Instances of procedural meshes drawn instead of scenePath, 0 for none
+    uint32_t instancedScene = 0;
+    // Cull instances against the frustum in a compute pass that writes the
+    // draws of the visible ones, submitted with a single indirect draw.
+    // Otherwise every instance is drawn from the CPU.
+    bool gpuCulling = true;
+    // With GPU culling, also cull instances hidden behind others against a
+    // hierarchical depth pyramid
+    bool occlusionCulling = true;
+    // With GPU culling, also cull the meshlets of visible instances against
+    // the frustum, their normal cones and the depth pyramid, and draw each
+    // remaining one on its own
+    bool clusterCulling = true;
+    // Instances the GPU-driven buffers have room for, the rest are dropped
+    uint32_t maxInstances = 65536;
+    // Meshlets of visible instances culled and drawn per phase, the rest
+    // are dropped
+    uint32_t maxClusters = 1 << 19;
+    // From the camera to the center of the scene, in scene radii
+    float cameraDistance = 2.5f;
+};
+
+struct StartupTimings {
+    // From the first pipeline compilation to the last one being ready
+    double pipelinesMs = 0.0;
+    // From the start of init to the first frame being submitted
+    double firstFrameMs = 0.0;
+    bool asyncPipelines = true;
+    // Whether pipelines were built on top of a cache loaded from disk
+    bool warmPipelineCache = false;
+};
+
+struct FrameTimings {
+    // Frame number the GPU timing belongs to, -1 until one is available
+    int gpuFrame = -1;
+    double gpuMs = 0.0;
+    // Time the CPU spent waiting for the GPU before recording the last frame
+    double cpuWaitMs = 0.0;
+    uint32_t framesInFlight = 0;
+    // From input sampling to the CPU seeing the frame's GPU work completed,
+    // which is checked after each present and before each frame. Excludes
+    // the time the image then waits for the display.
+    double inputLatencyMs = 0.0;
+    // Size of the region rendered this frame, over the full resolution
+    float renderScale = 1.0f;
+    uint32_t renderWidth = 0;
+    uint32_t renderHeight = 0;
+};
+
+struct PassStatistics {
+    static constexpr int HISTORY_SIZE = 120;
+
+    std::string name;
+    // Rolling window of GPU times in ms, the oldest sample is at historyOffset
+    std::array<float, HISTORY_SIZE> gpuMs{};
+    int historyOffset = 0;
+    uint64_t vertexInvocations = 0;
+    uint64_t fragmentInvocations = 0;
+    uint64_t computeInvocations = 0;
+
+    float lastGpuMs() const {
+	return gpuMs[(historyOffset + HISTORY_SIZE - 1) % HISTORY_SIZE];
+    }
+};
+
+// Statistics count decimal megabytes
+inline double toMegabytes(uint64_t bytes) { return bytes / 1e6; }
+inline double megabytesPerSecond(uint64_t bytes, double seconds) {
+    return seconds > 0.0 ? toMegabytes(bytes) / seconds : 0.0;
+}
+
+struct UploadStatistics {
+    // Bytes whose copy has completed on the GPU
+    uint64_t bytesUploaded = 0;
+    // Throughput over the last measured second
+    double mbPerSecond = 0.0;
+    // Times an upload had to wait for the staging ring to drain
+    uint32_t stalls = 0;
+    double stallMs = 0.0;
+};
+
+struct MeshStatistics {
+    uint32_t meshes = 0;
+    uint64_t triangles = 0;
+    // Size of the source files
+    uint64_t bytesLoaded = 0;
+    // From the load request to every upload being recorded, 0 until then
+    double loadMs = 0.0;
+    double mbPerSecond = 0.0;
+    double trianglesPerSecond = 0.0;
+    // Space used in the shared vertex and index buffers
+    uint64_t poolBytes = 0;
+};
+
+struct CullStatistics {
+    uint32_t instances = 0;
+    // Instances that passed culling in the last completed frame, all of them
+    // without GPU culling
+    uint32_t visibleInstances = 0;
+    // Rejected by each test, in that order
+    uint32_t frustumCulled = 0;
+    uint32_t occlusionCulled = 0;
+    // Meshlets and triangles of the visible instances, then those left once
+    // meshlets are culled, equal without cluster culling
+    uint32_t clusters = 0;
+    uint32_t clustersDrawn = 0;
+    uint64_t triangles = 0;
+    uint64_t trianglesDrawn = 0;
+    bool gpuCulling = true;
+    bool occlusionCulling = true;
+    bool clusterCulling = true;
+};
+
+// As of the last time the graph was compiled
+struct RenderGraphStatistics {
+    uint32_t passes = 0;
+    uint32_t culledPasses = 0;
+    // Passes on the async compute queue, and async passes that had to stay
+    // on the graphics one
+    uint32_t computePasses = 0;
+    uint32_t computeFallbacks = 0;
+    // Memory backing transient resources, and what it would take if none of
+    // them shared it
+    uint64_t transientBytes = 0;
+    uint64_t unaliasedBytes = 0;
+};
+
+// Pipelines created once per unique state, the rest being reused
+struct PsoCacheStatistics {
+    uint32_t graphicsPipelines = 0;
+    uint32_t computePipelines = 0;
+    // Requests served by an existing pipeline, or one still compiling
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
 class Renderer {
   public:
     virtual bool init(GLFWwindow* window, int width, int height,
-		      bool tripleBuffering = false) = 0;
+		      const RendererSettings& settings, JobSystem& jobs) = 0;
     virtual void run(int frame) = 0;
     virtual void newImguiFrame() = 0;
     virtual void cleanup() = 0;
+    virtual void setFramesInFlight(uint32_t count) = 0;
+    // Blocks until the next frame can be recorded, input should be sampled
+    // right after
+    virtual void waitForNextFrame() = 0;
+    virtual void setPresentMode(PresentMode mode) = 0;
+    // The mode actually in use after fallbacks
+    virtual PresentMode getPresentMode() const = 0;
+    virtual void setLowLatency(bool enabled) = 0;
+    virtual void setDynamicResolution(bool enabled, double targetMs) = 0;
+    virtual FrameTimings getFrameTimings() const = 0;
+    virtual StartupTimings getStartupTimings() const = 0;
+    virtual const std::vector<PassStatistics>& getPassStatistics() const = 0;
+    virtual UploadStatistics getUploadStatistics() const = 0;
+    virtual PsoCacheStatistics getPsoCacheStatistics() const = 0;
+    virtual MeshStatistics getMeshStatistics() const = 0;
+    virtual CullStatistics getCullStatistics() const = 0;
+    virtual RenderGraphStatistics getRenderGraphStatistics() const = 0;
 };
 
 } // namespace baldwin
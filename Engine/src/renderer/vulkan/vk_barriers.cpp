@@ -0,0 +1,255 @@
+#include "vk_barriers.hpp"
+
+#include "vk_images.hpp"
+
+namespace baldwin {
+namespace vk {
+
+static constexpr VkAccessFlags2 WRITE_ACCESSES =
+  VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+  VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+  VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+  VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT |
+  VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+// Whether a read adds stages or accesses the last write was not made visible
+// to yet
+template <typename State>
+static bool readsUnsynchronized(const State& state, const State& next) {
+    return state.writeStage != VK_PIPELINE_STAGE_2_NONE &&
+	   ((next.stage & ~state.stage) != 0 ||
+	    (next.access & ~state.access) != 0);
+}
+
+// The state after a barrier to next, remembering the last write
+template <typename State>
+static State afterBarrier(const State& state, State next) {
+    if ((next.access & WRITE_ACCESSES) != 0) {
+	next.writeStage = next.stage;
+	next.writeAccess = next.access & WRITE_ACCESSES;
+    } else if ((state.access & WRITE_ACCESSES) != 0) {
+	next.writeStage = state.stage;
+	next.writeAccess = state.access & WRITE_ACCESSES;
+    } else {
+	next.writeStage = state.writeStage;
+	next.writeAccess = state.writeAccess;
+    }
+    return next;
+}
+
+ImageState getImageUsageState(ImageUsage usage) {
+    switch (usage) {
+	case ImageUsage::TransferSrc:
+	    return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		     VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT,
+		     VK_ACCESS_2_TRANSFER_READ_BIT };
+	case ImageUsage::TransferDst:
+	    return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		     VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT,
+		     VK_ACCESS_2_TRANSFER_WRITE_BIT };
+	case ImageUsage::ComputeRead:
+	    // Images in the general layout can be sampled as well
+	    return { VK_IMAGE_LAYOUT_GENERAL,
+		     VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		     VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+		       VK_ACCESS_2_SHADER_SAMPLED_READ_BIT };
+	case ImageUsage::ComputeWrite:
+	    return { VK_IMAGE_LAYOUT_GENERAL,
+		     VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		     VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+	case ImageUsage::ComputeReadWrite:
+	    return { VK_IMAGE_LAYOUT_GENERAL,
+		     VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		     VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+		       VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+	case ImageUsage::ComputeSampled:
+	    return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		     VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		     VK_ACCESS_2_SHADER_SAMPLED_READ_BIT };
+	case ImageUsage::FragmentSampled:
+	    return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		     VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+		     VK_ACCESS_2_SHADER_SAMPLED_READ_BIT };
+	case ImageUsage::ColorAttachment:
+	    return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		     VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		     VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT |
+		       VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT };
+	case ImageUsage::DepthAttachment:
+	    return { VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+		     VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+		       VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+		     VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+		       VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT };
+	case ImageUsage::Present:
+	    // Presentation is ordered by the render semaphore, not by stages
+	    return { VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+		     VK_PIPELINE_STAGE_2_NONE,
+		     VK_ACCESS_2_NONE };
+    }
+    return {};
+}
+
+BufferState getBufferUsageState(BufferUsage usage) {
+    switch (usage) {
+	case BufferUsage::TransferSrc:
+	    return { VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT,
+		     VK_ACCESS_2_TRANSFER_READ_BIT };
+	case BufferUsage::TransferDst:
+	    return { VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT,
+		     VK_ACCESS_2_TRANSFER_WRITE_BIT };
+	case BufferUsage::ComputeRead:
+	    return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		     VK_ACCESS_2_SHADER_STORAGE_READ_BIT };
+	case BufferUsage::ComputeWrite:
+	    return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		     VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+	case BufferUsage::ComputeReadWrite:
+	    return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		     VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+		       VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+	case BufferUsage::VertexRead:
+	    return { VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+		     VK_ACCESS_2_SHADER_STORAGE_READ_BIT };
+	case BufferUsage::IndexRead:
+	    return { VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT,
+		     VK_ACCESS_2_INDEX_READ_BIT };
+	case BufferUsage::IndirectRead:
+	    return { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+		     VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT };
+	case BufferUsage::IndirectComputeRead:
+	    return { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT |
+		       VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		     VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT |
+		       VK_ACCESS_2_SHADER_STORAGE_READ_BIT };
+	case BufferUsage::HostRead:
+	    return { VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT };
+    }
+    return {};
+}
+
+void BarrierBatch::transition(VkCommandBuffer cmd, VkImage image,
+			      ImageState& state, ImageUsage usage,
+			      bool discard, VkImageAspectFlags aspect) {
+    ImageState next = getImageUsageState(usage);
+    VkImageLayout oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED
+				      : state.layout;
+    bool layoutChange = oldLayout != next.layout;
+    bool prevWrites = (state.access & WRITE_ACCESSES) != 0;
+    bool nextWrites = (next.access & WRITE_ACCESSES) != 0;
+
+    // Read after read in the same layout needs no barrier, but later writers
+    // must wait on every reader, so the reads are accumulated. A read at a
+    // new stage still waits for the last write.
+    if (!layoutChange && !prevWrites && !nextWrites) {
+	if (readsUnsynchronized(state, next)) {
+	    if (imageBarrierCount == MAX_BARRIERS)
+		flush(cmd);
+	    imageBarriers[imageBarrierCount++] = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+		.srcStageMask = state.writeStage,
+		.srcAccessMask = state.writeAccess,
+		.dstStageMask = next.stage,
+		.dstAccessMask = next.access,
+		.oldLayout = state.layout,
+		.newLayout = state.layout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image,
+		.subresourceRange = getImageSubresourceRange(aspect),
+	    };
+	}
+	state.stage |= next.stage;
+	state.access |= next.access;
+	return;
+    }
+
+    if (imageBarrierCount == MAX_BARRIERS)
+	flush(cmd);
+
+    // Write after read only needs an execution dependency, anything else must
+    // make the previous writes available to the next accesses
+    imageBarriers[imageBarrierCount++] = {
+	.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+	.srcStageMask = state.stage,
+	.srcAccessMask = state.access & WRITE_ACCESSES,
+	.dstStageMask = next.stage,
+	.dstAccessMask = (layoutChange || prevWrites) ? next.access
+						      : VK_ACCESS_2_NONE,
+	.oldLayout = oldLayout,
+	.newLayout = next.layout,
+	.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	.image = image,
+	.subresourceRange = getImageSubresourceRange(aspect),
+    };
+
+    state = discard ? afterBarrier(ImageState{}, next)
+		    : afterBarrier(state, next);
+}
+
+void BarrierBatch::transition(VkCommandBuffer cmd, VkBuffer buffer,
+			      BufferState& state, BufferUsage usage) {
+    BufferState next = getBufferUsageState(usage);
+    bool prevWrites = (state.access & WRITE_ACCESSES) != 0;
+    bool nextWrites = (next.access & WRITE_ACCESSES) != 0;
+
+    if (!prevWrites && !nextWrites) {
+	if (readsUnsynchronized(state, next)) {
+	    if (bufferBarrierCount == MAX_BARRIERS)
+		flush(cmd);
+	    bufferBarriers[bufferBarrierCount++] = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+		.srcStageMask = state.writeStage,
+		.srcAccessMask = state.writeAccess,
+		.dstStageMask = next.stage,
+		.dstAccessMask = next.access,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer = buffer,
+		.offset = 0,
+		.size = VK_WHOLE_SIZE,
+	    };
+	}
+	state.stage |= next.stage;
+	state.access |= next.access;
+	return;
+    }
+
+    if (bufferBarrierCount == MAX_BARRIERS)
+	flush(cmd);
+
+    bufferBarriers[bufferBarrierCount++] = {
+	.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+	.srcStageMask = state.stage,
+	.srcAccessMask = state.access & WRITE_ACCESSES,
+	.dstStageMask = next.stage,
+	.dstAccessMask = prevWrites ? next.access : VK_ACCESS_2_NONE,
+	.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	.buffer = buffer,
+	.offset = 0,
+	.size = VK_WHOLE_SIZE,
+    };
+
+    state = afterBarrier(state, next);
+}
+
+void BarrierBatch::flush(VkCommandBuffer cmd) {
+    if (imageBarrierCount == 0 && bufferBarrierCount == 0)
+	return;
+
+    VkDependencyInfo depInfo = {
+	.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+	.bufferMemoryBarrierCount = bufferBarrierCount,
+	.pBufferMemoryBarriers = bufferBarriers.data(),
+	.imageMemoryBarrierCount = imageBarrierCount,
+	.pImageMemoryBarriers = imageBarriers.data(),
+    };
+    vkCmdPipelineBarrier2(cmd, &depInfo);
+    imageBarrierCount = 0;
+    bufferBarrierCount = 0;
+}
+
+} // namespace vk
+} // namespace baldwin
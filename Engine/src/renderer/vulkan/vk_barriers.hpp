@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+namespace baldwin {
+namespace vk {
+
+// Last known layout of an image and the accesses made to it since the last
+// barrier. Every tracked image owns one, which is what lets barriers be
+// derived instead of hand written.
+//
+// The last write is kept as well. Reads following it only see it at the
+// stages and accesses they were synchronized for, a read at another one
+// needs its own barrier.
+struct ImageState {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 access = VK_ACCESS_2_NONE;
+    VkPipelineStageFlags2 writeStage = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+};
+
+// Same as ImageState, buffers simply have no layout
+struct BufferState {
+    VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 access = VK_ACCESS_2_NONE;
+    VkPipelineStageFlags2 writeStage = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+};
+
+// Ways an image can be used by a command, each mapping to a layout, stage and
+// access triple
+enum class ImageUsage {
+    TransferSrc,
+    TransferDst,
+    ComputeRead,
+    ComputeWrite,
+    ComputeReadWrite,
+    ComputeSampled,
+    FragmentSampled,
+    ColorAttachment,
+    DepthAttachment,
+    Present,
+};
+
+enum class BufferUsage {
+    TransferSrc,
+    TransferDst,
+    ComputeRead,
+    ComputeWrite,
+    ComputeReadWrite,
+    VertexRead,
+    IndexRead,
+    IndirectRead,
+    // Dispatch arguments the dispatched shader reads as well
+    IndirectComputeRead,
+    HostRead,
+};
+
+ImageState getImageUsageState(ImageUsage usage);
+BufferState getBufferUsageState(BufferUsage usage);
+
+// Collects image and buffer transitions and submits them with a single
+// vkCmdPipelineBarrier2
+struct BarrierBatch {
+    static constexpr uint32_t MAX_BARRIERS = 16;
+
+    std::array<VkImageMemoryBarrier2, MAX_BARRIERS> imageBarriers;
+    std::array<VkBufferMemoryBarrier2, MAX_BARRIERS> bufferBarriers;
+    uint32_t imageBarrierCount = 0;
+    uint32_t bufferBarrierCount = 0;
+
+    // Declares the next use of an image, recording the narrowest barrier
+    // needed from its tracked state. Discarding skips preserving the current
+    // content.
+    void transition(VkCommandBuffer cmd, VkImage image, ImageState& state,
+		    ImageUsage usage, bool discard = false,
+		    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT);
+    void transition(VkCommandBuffer cmd, VkBuffer buffer, BufferState& state,
+		    BufferUsage usage);
+    void flush(VkCommandBuffer cmd);
+};
+
+} // namespace vk
+} // namespace baldwin
@@ -0,0 +1,212 @@
+#include "vk_bindless.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include "graphics_macros.hpp"
+#include "vk_descriptors.hpp"
+
+namespace baldwin {
+namespace vk {
+
+static constexpr VkDescriptorType DESCRIPTOR_TYPES[] = {
+    VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+    VK_DESCRIPTOR_TYPE_SAMPLER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+};
+// Wanted array sizes, lowered to what the device supports
+static constexpr uint32_t DESIRED_CAPACITIES[] = { 16384, 4096, 256, 16384 };
+
+void BindlessHeap::init(VkDevice device, VkPhysicalDevice gpu,
+			uint32_t framesInFlight) {
+    _framesInFlight = framesInFlight;
+
+    VkPhysicalDeviceVulkan12Properties properties12 = {
+	.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES
+    };
+    VkPhysicalDeviceProperties2 properties = {
+	.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+	.pNext = &properties12
+    };
+    vkGetPhysicalDeviceProperties2(gpu, &properties);
+    const VkPhysicalDeviceVulkan12Properties& p = properties12;
+    uint32_t limits[] = {
+	std::min(p.maxDescriptorSetUpdateAfterBindSampledImages,
+		 p.maxPerStageDescriptorUpdateAfterBindSampledImages),
+	std::min(p.maxDescriptorSetUpdateAfterBindStorageImages,
+		 p.maxPerStageDescriptorUpdateAfterBindStorageImages),
+	std::min(p.maxDescriptorSetUpdateAfterBindSamplers,
+		 p.maxPerStageDescriptorUpdateAfterBindSamplers),
+	std::min(p.maxDescriptorSetUpdateAfterBindStorageBuffers,
+		 p.maxPerStageDescriptorUpdateAfterBindStorageBuffers),
+    };
+
+    DescriptorLayoutBuilder builder{};
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    for (uint32_t type = 0; type < TYPE_COUNT; type++) {
+	uint32_t capacity = std::min(DESIRED_CAPACITIES[type], limits[type]);
+	_slots[type].capacity = capacity;
+	builder.addBinding(type, DESCRIPTOR_TYPES[type], capacity);
+	poolSizes.push_back(VkDescriptorPoolSize{
+	  .type = DESCRIPTOR_TYPES[type], .descriptorCount = capacity });
+    }
+
+    // Slots are written while the set is bound, and most of them never are
+    VkDescriptorBindingFlags bindingFlags[TYPE_COUNT];
+    std::fill_n(bindingFlags,
+		TYPE_COUNT,
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+		  VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+		  VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT);
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {
+	.sType =
+	  VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+	.bindingCount = TYPE_COUNT,
+	.pBindingFlags = bindingFlags
+    };
+    layout = builder.build(
+      device,
+      VK_SHADER_STAGE_ALL,
+      &bindingFlagsInfo,
+      VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
+
+    VkDescriptorPoolCreateInfo poolInfo = {
+	.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+	.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+	.maxSets = 1,
+	.poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+	.pPoolSizes = poolSizes.data(),
+    };
+    VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool),
+	     "Could not create bindless descriptor pool");
+
+    VkDescriptorSetAllocateInfo allocInfo = {
+	.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+	.descriptorPool = pool,
+	.descriptorSetCount = 1,
+	.pSetLayouts = &layout,
+    };
+    VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &set),
+	     "Could not allocate bindless descriptor set");
+
+    VkPushConstantRange pushConstants = { .stageFlags = VK_SHADER_STAGE_ALL,
+					  .offset = 0,
+					  .size = PUSH_CONSTANTS_SIZE };
+    VkPipelineLayoutCreateInfo layoutInfo = {
+	.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+	.setLayoutCount = 1,
+	.pSetLayouts = &layout,
+	.pushConstantRangeCount = 1,
+	.pPushConstantRanges = &pushConstants
+    };
+    VK_CHECK(
+      vkCreatePipelineLayout(device, &layoutInfo, nullptr, &pipelineLayout),
+      "Could not create bindless pipeline layout");
+}
+
+void BindlessHeap::destroy(VkDevice device) {
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(device, pool, nullptr);
+    vkDestroyDescriptorSetLayout(device, layout, nullptr);
+}
+
+uint32_t BindlessHeap::addSampledImage(VkDevice device, VkImageView view,
+				       VkImageLayout imageLayout) {
+    uint32_t handle = allocate(BindlessType::SampledImage);
+    writeImage(device, BindlessType::SampledImage, handle, view, imageLayout);
+    return handle;
+}
+
+uint32_t BindlessHeap::addStorageImage(VkDevice device, VkImageView view) {
+    uint32_t handle = allocate(BindlessType::StorageImage);
+    writeImage(device,
+	       BindlessType::StorageImage,
+	       handle,
+	       view,
+	       VK_IMAGE_LAYOUT_GENERAL);
+    return handle;
+}
+
+uint32_t BindlessHeap::addSampler(VkDevice device, VkSampler sampler) {
+    uint32_t handle = allocate(BindlessType::Sampler);
+    VkDescriptorImageInfo samplerInfo = { .sampler = sampler };
+    VkWriteDescriptorSet writeInfo = {
+	.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+	.dstSet = set,
+	.dstBinding = static_cast<uint32_t>(BindlessType::Sampler),
+	.dstArrayElement = handle,
+	.descriptorCount = 1,
+	.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER,
+	.pImageInfo = &samplerInfo
+    };
+    vkUpdateDescriptorSets(device, 1, &writeInfo, 0, nullptr);
+    return handle;
+}
+
+uint32_t BindlessHeap::addStorageBuffer(VkDevice device, VkBuffer buffer,
+					VkDeviceSize offset,
+					VkDeviceSize range) {
+    uint32_t handle = allocate(BindlessType::StorageBuffer);
+    VkDescriptorBufferInfo bufferInfo = { .buffer = buffer,
+					  .offset = offset,
+					  .range = range };
+    VkWriteDescriptorSet writeInfo = {
+	.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+	.dstSet = set,
+	.dstBinding = static_cast<uint32_t>(BindlessType::StorageBuffer),
+	.dstArrayElement = handle,
+	.descriptorCount = 1,
+	.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+	.pBufferInfo = &bufferInfo
+    };
+    vkUpdateDescriptorSets(device, 1, &writeInfo, 0, nullptr);
+    return handle;
+}
+
+void BindlessHeap::release(BindlessType type, uint32_t handle) {
+    _slots[static_cast<uint32_t>(type)].released.push_back(
+      Released{ .frameNum = _frameNum, .handle = handle });
+}
+
+void BindlessHeap::beginFrame(uint64_t frameNum) {
+    _frameNum = frameNum;
+    for (Slots& slots : _slots) {
+	while (!slots.released.empty() &&
+	       slots.released.front().frameNum + _framesInFlight <= frameNum) {
+	    slots.free.push_back(slots.released.front().handle);
+	    slots.released.pop_front();
+	}
+    }
+}
+
+uint32_t BindlessHeap::allocate(BindlessType type) {
+    Slots& slots = _slots[static_cast<uint32_t>(type)];
+    if (!slots.free.empty()) {
+	uint32_t handle = slots.free.back();
+	slots.free.pop_back();
+	return handle;
+    }
+    if (slots.next == slots.capacity)
+	throw std::runtime_error("Bindless descriptor array is full");
+    return slots.next++;
+}
+
+void BindlessHeap::writeImage(VkDevice device, BindlessType type,
+			      uint32_t handle, VkImageView view,
+			      VkImageLayout imageLayout) {
+    VkDescriptorImageInfo imageInfo = { .imageView = view,
+					.imageLayout = imageLayout };
+    VkWriteDescriptorSet writeInfo = {
+	.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+	.dstSet = set,
+	.dstBinding = static_cast<uint32_t>(type),
+	.dstArrayElement = handle,
+	.descriptorCount = 1,
+	.descriptorType = DESCRIPTOR_TYPES[static_cast<uint32_t>(type)],
+	.pImageInfo = &imageInfo
+    };
+    vkUpdateDescriptorSets(device, 1, &writeInfo, 0, nullptr);
+}
+
+} // namespace vk
+} // namespace baldwin
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace baldwin {
+namespace vk {
+
+// Binding of each resource array in the bindless set, which is also the type
+// of the handles indexing it
+enum class BindlessType : uint32_t {
+    SampledImage = 0,
+    StorageImage = 1,
+    Sampler = 2,
+    StorageBuffer = 3,
+};
+
+// One global update-after-bind descriptor set holding arrays of every
+// resource type, bound once at set 0 through a shared pipeline layout.
+// Shaders index the arrays with integer handles passed by push constants, so
+// nothing is bound per draw.
+//
+// Handles are slots in the arrays. A released slot is only recycled once the
+// frames in flight that may still read it are done. Not thread safe.
+struct BindlessHeap {
+    static constexpr uint32_t TYPE_COUNT = 4;
+    // Size of the push constant range of the shared layout, the guaranteed
+    // minimum
+    static constexpr uint32_t PUSH_CONSTANTS_SIZE = 128;
+
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+
+    void init(VkDevice device, VkPhysicalDevice gpu, uint32_t framesInFlight);
+    void destroy(VkDevice device);
+
+    uint32_t addSampledImage(VkDevice device, VkImageView view,
+			     VkImageLayout imageLayout);
+    uint32_t addStorageImage(VkDevice device, VkImageView view);
+    uint32_t addSampler(VkDevice device, VkSampler sampler);
+    uint32_t addStorageBuffer(VkDevice device, VkBuffer buffer,
+			      VkDeviceSize offset = 0,
+			      VkDeviceSize range = VK_WHOLE_SIZE);
+    void release(BindlessType type, uint32_t handle);
+
+    // Recycles the handles released long enough ago for the frame about to
+    // be recorded to be the only one using them
+    void beginFrame(uint64_t frameNum);
+
+    uint32_t capacity(BindlessType type) const {
+	return _slots[static_cast<uint32_t>(type)].capacity;
+    }
+
+  private:
+    struct Released {
+	uint64_t frameNum;
+	uint32_t handle;
+    };
+    struct Slots {
+	uint32_t capacity = 0;
+	uint32_t next = 0;
+	std::vector<uint32_t> free;
+	std::deque<Released> released;
+    };
+
+    uint32_t allocate(BindlessType type);
+    void writeImage(VkDevice device, BindlessType type, uint32_t handle,
+		    VkImageView view, VkImageLayout imageLayout);
+
+    std::array<Slots, TYPE_COUNT> _slots{};
+    uint32_t _framesInFlight = 2;
+    uint64_t _frameNum = 0;
+};
+
+} // namespace vk
+} // namespace baldwin
@@ -0,0 +1,45 @@
+#include "vk_buffers.hpp"
+
+#include "graphics_macros.hpp"
+
+namespace baldwin {
+namespace vk {
+
+AllocatedBuffer createBuffer(VmaAllocator allocator, VkDeviceSize size,
+			     VkBufferUsageFlags usage,
+			     VmaMemoryUsage memoryUsage,
+			     VmaAllocationCreateFlags flags,
+			     const std::vector<uint32_t>& queueFamilies) {
+    VkBufferCreateInfo bufferInfo = {
+	.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+	.size = size,
+	.usage = usage,
+	.sharingMode = VK_SHARING_MODE_EXCLUSIVE
+    };
+    if (queueFamilies.size() > 1) {
+	bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+	bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(
+	  queueFamilies.size());
+	bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+    }
+
+    VmaAllocationCreateInfo allocInfo = { .flags = flags,
+					  .usage = memoryUsage };
+
+    AllocatedBuffer buffer{};
+    VK_CHECK(vmaCreateBuffer(allocator,
+			     &bufferInfo,
+			     &allocInfo,
+			     &buffer.buffer,
+			     &buffer.allocation,
+			     &buffer.info),
+	     "Could not create buffer");
+    return buffer;
+}
+
+void destroyBuffer(VmaAllocator allocator, const AllocatedBuffer& buffer) {
+    vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+}
+
+} // namespace vk
+} // namespace baldwin
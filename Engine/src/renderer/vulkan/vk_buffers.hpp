@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+namespace baldwin {
+namespace vk {
+
+struct AllocatedBuffer {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VmaAllocation allocation = VK_NULL_HANDLE;
+    // Holds the mapped pointer of persistently mapped buffers
+    VmaAllocationInfo info{};
+};
+
+// Buffers written from other queue families, e.g. by the uploader on a
+// dedicated transfer queue, list every family using them
+AllocatedBuffer createBuffer(VmaAllocator allocator, VkDeviceSize size,
+			     VkBufferUsageFlags usage,
+			     VmaMemoryUsage memoryUsage,
+			     VmaAllocationCreateFlags flags = 0,
+			     const std::vector<uint32_t>& queueFamilies = {});
+void destroyBuffer(VmaAllocator allocator, const AllocatedBuffer& buffer);
+
+} // namespace vk
+} // namespace baldwin
@@ -0,0 +1,244 @@
+#include "vk_compute_tuner.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include "graphics_macros.hpp"
+#include "vk_infos.hpp"
+
+namespace baldwin {
+namespace vk {
+
+// Timed dispatches per candidate, after as many untimed ones
+static constexpr uint32_t TUNING_RUNS = 8;
+
+void ComputeTuner::init(VkDevice device, VkPhysicalDevice gpu, VkQueue queue,
+			uint32_t queueFamily, const std::string& path) {
+    _device = device;
+    _queue = queue;
+    _queueFamily = queueFamily;
+    _path = path;
+
+    VkPhysicalDeviceSubgroupProperties subgroupProps = {
+	.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES
+    };
+    VkPhysicalDeviceProperties2 props = {
+	.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+	.pNext = &subgroupProps
+    };
+    vkGetPhysicalDeviceProperties2(gpu, &props);
+    const VkPhysicalDeviceLimits& limits = props.properties.limits;
+    _timestampPeriod = limits.timestampPeriod;
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(
+      gpu, &familyCount, families.data());
+    _timestampValidBits = families[queueFamily].timestampValidBits;
+
+    std::ostringstream key;
+    key << props.properties.vendorID << ' ' << props.properties.deviceID << ' '
+	<< props.properties.driverVersion;
+    _deviceKey = key.str();
+
+    WorkgroupSize sizes[] = {
+	{ 8, 8 }, { 16, 16 }, { 32, 8 }, { subgroupProps.subgroupSize, 1 }
+    };
+    for (WorkgroupSize size : sizes) {
+	bool fits = size.x > 0 && size.x <= limits.maxComputeWorkGroupSize[0] &&
+		    size.y <= limits.maxComputeWorkGroupSize[1] &&
+		    size.x * size.y <= limits.maxComputeWorkGroupInvocations;
+	if (fits && std::find(_candidates.begin(), _candidates.end(), size) ==
+		      _candidates.end()) {
+	    _candidates.push_back(size);
+	}
+    }
+
+    load();
+}
+
+WorkgroupSize ComputeTuner::lookup(const std::string& kernel,
+				   WorkgroupSize fallback) const {
+    auto it = _choices.find(kernel);
+    return it != _choices.end() ? it->second : fallback;
+}
+
+WorkgroupSize ComputeTuner::tune(const std::string& kernel,
+				 WorkgroupSize fallback, const BuildFn& build,
+				 const DispatchFn& dispatch) {
+    if (_timestampValidBits == 0)
+	return lookup(kernel, fallback);
+
+    VkCommandPool pool = VK_NULL_HANDLE;
+    VkQueryPool queries = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    auto destroy = [&]() {
+	vkDestroyPipeline(_device, pipeline, nullptr);
+	vkDestroyFence(_device, fence, nullptr);
+	vkDestroyQueryPool(_device, queries, nullptr);
+	vkDestroyCommandPool(_device, pool, nullptr);
+    };
+
+    // Timestamps wrap around past their valid bits
+    uint64_t timestampMask = _timestampValidBits >= 64
+			       ? ~uint64_t{ 0 }
+			       : (uint64_t{ 1 } << _timestampValidBits) - 1;
+    WorkgroupSize best = _candidates.front();
+    double bestMs = std::numeric_limits<double>::max();
+    try {
+	VkCommandPoolCreateInfo poolInfo = {
+	    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+	    .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+	    .queueFamilyIndex = _queueFamily
+	};
+	VK_CHECK(vkCreateCommandPool(_device, &poolInfo, nullptr, &pool),
+		 "Could not create tuning command pool");
+	VkCommandBufferAllocateInfo bufferInfo = {
+	    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+	    .commandPool = pool,
+	    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+	    .commandBufferCount = 1,
+	};
+	VkCommandBuffer cmd;
+	VK_CHECK(vkAllocateCommandBuffers(_device, &bufferInfo, &cmd),
+		 "Could not allocate tuning command buffer");
+	VkQueryPoolCreateInfo queryInfo = {
+	    .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+	    .queryType = VK_QUERY_TYPE_TIMESTAMP,
+	    .queryCount = 2,
+	};
+	VK_CHECK(vkCreateQueryPool(_device, &queryInfo, nullptr, &queries),
+		 "Could not create tuning query pool");
+	VkFenceCreateInfo fenceInfo = {
+	    .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO
+	};
+	VK_CHECK(vkCreateFence(_device, &fenceInfo, nullptr, &fence),
+		 "Could not create tuning fence");
+
+	for (WorkgroupSize candidate : _candidates) {
+	    pipeline = build(candidate);
+
+	    VkCommandBufferBeginInfo beginInfo = getCommandBufferBeginInfo(
+	      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	    VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo),
+		     "Could not begin tuning commands");
+	    vkCmdResetQueryPool(cmd, queries, 0, 2);
+	    // Warms caches and clocks up before measuring
+	    for (uint32_t i = 0; i < TUNING_RUNS; i++) {
+		dispatch(cmd, pipeline, candidate);
+	    }
+	    vkCmdWriteTimestamp2(
+	      cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, queries, 0);
+	    for (uint32_t i = 0; i < TUNING_RUNS; i++) {
+		dispatch(cmd, pipeline, candidate);
+	    }
+	    vkCmdWriteTimestamp2(
+	      cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, queries, 1);
+	    VK_CHECK(vkEndCommandBuffer(cmd), "Could not end tuning commands");
+
+	    VkCommandBufferSubmitInfo cmdInfo = getCommandBufferSubmitInfo(cmd);
+	    VkSubmitInfo2 submitInfo =
+	      getSubmitInfo(&cmdInfo, nullptr, nullptr);
+	    VK_CHECK(vkQueueSubmit2(_queue, 1, &submitInfo, fence),
+		     "Could not submit tuning commands");
+	    VK_CHECK(vkWaitForFences(_device, 1, &fence, VK_TRUE, UINT64_MAX),
+		     "Could not wait for tuning commands");
+	    VK_CHECK(vkResetFences(_device, 1, &fence),
+		     "Could not reset tuning fence");
+	    VK_CHECK(vkResetCommandPool(_device, pool, 0),
+		     "Could not reset tuning command pool");
+
+	    uint64_t timestamps[2];
+	    VK_CHECK(vkGetQueryPoolResults(_device,
+					   queries,
+					   0,
+					   2,
+					   sizeof(timestamps),
+					   timestamps,
+					   sizeof(uint64_t),
+					   VK_QUERY_RESULT_64_BIT |
+					     VK_QUERY_RESULT_WAIT_BIT),
+		     "Could not read tuning timestamps");
+	    uint64_t ticks = (timestamps[1] - timestamps[0]) & timestampMask;
+	    double ms = static_cast<double>(ticks) * _timestampPeriod /
+			1000000.0 / TUNING_RUNS;
+	    if (ms < bestMs) {
+		bestMs = ms;
+		best = candidate;
+	    }
+	    vkDestroyPipeline(_device, pipeline, nullptr);
+	    pipeline = VK_NULL_HANDLE;
+	}
+    } catch (...) {
+	// Submitted commands may still use them
+	vkQueueWaitIdle(_queue);
+	destroy();
+	throw;
+    }
+    destroy();
+
+    _choices[kernel] = best;
+    save();
+    return best;
+}
+
+void ComputeTuner::load() {
+    std::ifstream file(_path);
+    std::string line;
+    while (std::getline(file, line)) {
+	// vendor device driver kernel x y
+	std::istringstream fields(line);
+	std::string vendor, deviceID, driver, kernel;
+	WorkgroupSize size;
+	if (!(fields >> vendor >> deviceID >> driver >> kernel >> size.x >>
+	      size.y)) {
+	    continue;
+	}
+	if (vendor + ' ' + deviceID + ' ' + driver != _deviceKey) {
+	    _otherLines.push_back(line);
+	    continue;
+	}
+	// Files edited by hand or written by other builds are not trusted
+	if (std::find(_candidates.begin(), _candidates.end(), size) !=
+	    _candidates.end()) {
+	    _choices[kernel] = size;
+	}
+    }
+}
+
+void ComputeTuner::save() const {
+    if (_path.empty())
+	return;
+
+    // Same write then rename as the pipeline cache
+    std::string tmpPath = _path + ".tmp";
+    {
+	std::ofstream file(tmpPath, std::ios::trunc);
+	for (const std::string& line : _otherLines) {
+	    file << line << '\n';
+	}
+	for (const auto& [kernel, size] : _choices) {
+	    file << _deviceKey << ' ' << kernel << ' ' << size.x << ' '
+		 << size.y << '\n';
+	}
+	if (!file) {
+	    std::cerr << "Could not write compute tuning " << tmpPath
+		      << std::endl;
+	    return;
+	}
+    }
+
+    std::error_code err;
+    std::filesystem::rename(tmpPath, _path, err);
+    if (err) {
+	std::cerr << "Could not replace compute tuning " << _path << " : "
+		  << err.message() << std::endl;
+    }
+}
+
+} // namespace vk
+} // namespace baldwin
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "renderer/vulkan/vk_pipelines.hpp"
+
+namespace baldwin {
+namespace vk {
+
+// Finds the fastest workgroup size of compute kernels on the current device
+// by timing every candidate with GPU timestamps. Choices are persisted in a
+// text file, one line per device, driver and kernel, so each kernel is only
+// tuned once per device.
+class ComputeTuner {
+  public:
+    // Builds the kernel's pipeline specialized for a workgroup size
+    using BuildFn = std::function<VkPipeline(WorkgroupSize workgroup)>;
+    // Records one dispatch over the kernel's whole domain, including the
+    // barriers it needs against the previous one
+    using DispatchFn = std::function<void(
+      VkCommandBuffer cmd, VkPipeline pipeline, WorkgroupSize workgroup)>;
+
+    void init(VkDevice device, VkPhysicalDevice gpu, VkQueue queue,
+	      uint32_t queueFamily, const std::string& path);
+
+    // 8x8, 16x16, 32x8 and one subgroup wide row, within device limits
+    const std::vector<WorkgroupSize>& candidates() const {
+	return _candidates;
+    }
+    // The persisted choice, or fallback when the kernel was never tuned on
+    // this device
+    WorkgroupSize lookup(const std::string& kernel,
+			 WorkgroupSize fallback) const;
+    // Times every candidate, then persists and returns the fastest. Blocks
+    // until the GPU is done. Queues without timestamps can not time
+    // anything, the kernel is then looked up with fallback.
+    WorkgroupSize tune(const std::string& kernel, WorkgroupSize fallback,
+		       const BuildFn& build, const DispatchFn& dispatch);
+
+  private:
+    void load();
+    void save() const;
+
+    VkDevice _device = VK_NULL_HANDLE;
+    VkQueue _queue = VK_NULL_HANDLE;
+    uint32_t _queueFamily = 0;
+    float _timestampPeriod = 1.0f;
+    uint32_t _timestampValidBits = 0;
+    std::string _path;
+    // vendor, device and driver version, prefixing every line of the file
+    std::string _deviceKey;
+    std::vector<WorkgroupSize> _candidates;
+    // Kernel name to choice, for the current device
+    std::map<std::string, WorkgroupSize> _choices;
+    // Lines of other devices, written back untouched
+    std::vector<std::string> _otherLines;
+};
+
+} // namespace vk
+} // namespace baldwin
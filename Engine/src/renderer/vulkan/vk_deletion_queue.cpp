@@ -0,0 +1,164 @@
+#include "vk_deletion_queue.hpp"
+
+#include <algorithm>
+
+namespace baldwin {
+namespace vk {
+
+template <typename T>
+static T toHandle(uint64_t handle) {
+    return reinterpret_cast<T>(handle);
+}
+
+void DeletionQueue::push(VkBuffer buffer, VmaAllocation allocation,
+			 uint64_t retireValue) {
+    pushHandle(Type::Buffer, buffer, allocation, retireValue);
+}
+
+void DeletionQueue::push(VkImage image, VmaAllocation allocation,
+			 uint64_t retireValue) {
+    pushHandle(Type::Image, image, allocation, retireValue);
+}
+
+void DeletionQueue::push(VmaAllocation allocation, uint64_t retireValue) {
+    pushHandle(Type::Memory, uint64_t{ 0 }, allocation, retireValue);
+}
+
+void DeletionQueue::push(VkImageView view, uint64_t retireValue) {
+    pushHandle(Type::ImageView, view, VK_NULL_HANDLE, retireValue);
+}
+
+void DeletionQueue::push(VkSampler sampler, uint64_t retireValue) {
+    pushHandle(Type::Sampler, sampler, VK_NULL_HANDLE, retireValue);
+}
+
+void DeletionQueue::push(VkPipeline pipeline, uint64_t retireValue) {
+    pushHandle(Type::Pipeline, pipeline, VK_NULL_HANDLE, retireValue);
+}
+
+void DeletionQueue::push(VkPipelineLayout layout, uint64_t retireValue) {
+    pushHandle(Type::PipelineLayout, layout, VK_NULL_HANDLE, retireValue);
+}
+
+void DeletionQueue::push(VkDescriptorSetLayout layout, uint64_t retireValue) {
+    pushHandle(Type::DescriptorSetLayout, layout, VK_NULL_HANDLE, retireValue);
+}
+
+void DeletionQueue::push(VkDescriptorPool pool, uint64_t retireValue) {
+    pushHandle(Type::DescriptorPool, pool, VK_NULL_HANDLE, retireValue);
+}
+
+void DeletionQueue::push(VkCommandPool pool, uint64_t retireValue) {
+    pushHandle(Type::CommandPool, pool, VK_NULL_HANDLE, retireValue);
+}
+
+void DeletionQueue::push(VkQueryPool pool, uint64_t retireValue) {
+    pushHandle(Type::QueryPool, pool, VK_NULL_HANDLE, retireValue);
+}
+
+void DeletionQueue::push(VkFence fence, uint64_t retireValue) {
+    pushHandle(Type::Fence, fence, VK_NULL_HANDLE, retireValue);
+}
+
+void DeletionQueue::push(VkSemaphore semaphore, uint64_t retireValue) {
+    pushHandle(Type::Semaphore, semaphore, VK_NULL_HANDLE, retireValue);
+}
+
+void DeletionQueue::pushFunction(std::function<void()>&& function,
+				 uint64_t retireValue) {
+    _entries.push_back(Entry{ .handle = _functions.size(),
+			      .allocation = VK_NULL_HANDLE,
+			      .retireValue = retireValue,
+			      .type = Type::Function });
+    _functions.push_back(std::move(function));
+}
+
+void DeletionQueue::flush(VkDevice device, VmaAllocator allocator,
+			  uint64_t completedValue) {
+    // Most recent first, objects usually depend on older ones
+    for (auto it = _entries.rbegin(); it != _entries.rend(); it++) {
+	if (it->retireValue <= completedValue)
+	    destroy(device, allocator, *it);
+    }
+    size_t destroyed = std::erase_if(
+      _entries, [completedValue](const Entry& entry) {
+	  return entry.retireValue <= completedValue;
+      });
+    if (destroyed == 0)
+	return;
+
+    // Compacts the remaining functions. Entries keep their push order and
+    // functions are indexed in that order, so each one moves down.
+    size_t live = 0;
+    for (Entry& entry : _entries) {
+	if (entry.type != Type::Function)
+	    continue;
+	if (entry.handle != live)
+	    _functions[live] = std::move(_functions[entry.handle]);
+	entry.handle = live++;
+    }
+    _functions.resize(live);
+}
+
+void DeletionQueue::destroy(VkDevice device, VmaAllocator allocator,
+			    Entry& entry) {
+    switch (entry.type) {
+	case Type::Buffer:
+	    vmaDestroyBuffer(
+	      allocator, toHandle<VkBuffer>(entry.handle), entry.allocation);
+	    break;
+	case Type::Image:
+	    vmaDestroyImage(
+	      allocator, toHandle<VkImage>(entry.handle), entry.allocation);
+	    break;
+	case Type::Memory:
+	    vmaFreeMemory(allocator, entry.allocation);
+	    break;
+	case Type::ImageView:
+	    vkDestroyImageView(
+	      device, toHandle<VkImageView>(entry.handle), nullptr);
+	    break;
+	case Type::Sampler:
+	    vkDestroySampler(
+	      device, toHandle<VkSampler>(entry.handle), nullptr);
+	    break;
+	case Type::Pipeline:
+	    vkDestroyPipeline(
+	      device, toHandle<VkPipeline>(entry.handle), nullptr);
+	    break;
+	case Type::PipelineLayout:
+	    vkDestroyPipelineLayout(
+	      device, toHandle<VkPipelineLayout>(entry.handle), nullptr);
+	    break;
+	case Type::DescriptorSetLayout:
+	    vkDestroyDescriptorSetLayout(
+	      device, toHandle<VkDescriptorSetLayout>(entry.handle), nullptr);
+	    break;
+	case Type::DescriptorPool:
+	    vkDestroyDescriptorPool(
+	      device, toHandle<VkDescriptorPool>(entry.handle), nullptr);
+	    break;
+	case Type::CommandPool:
+	    vkDestroyCommandPool(
+	      device, toHandle<VkCommandPool>(entry.handle), nullptr);
+	    break;
+	case Type::QueryPool:
+	    vkDestroyQueryPool(
+	      device, toHandle<VkQueryPool>(entry.handle), nullptr);
+	    break;
+	case Type::Fence:
+	    vkDestroyFence(device, toHandle<VkFence>(entry.handle), nullptr);
+	    break;
+	case Type::Semaphore:
+	    vkDestroySemaphore(
+	      device, toHandle<VkSemaphore>(entry.handle), nullptr);
+	    break;
+	case Type::Function:
+	    _functions[entry.handle]();
+	    _functions[entry.handle] = nullptr;
+	    break;
+    }
+}
+
+} // namespace vk
+} // namespace baldwin
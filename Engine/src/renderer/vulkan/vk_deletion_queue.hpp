@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+namespace baldwin {
+namespace vk {
+
+// Deferred destruction of Vulkan objects. Handles are stored by value in a
+// flat array, tagged with the frame number or timeline value after which the
+// GPU no longer uses them, so retiring a resource allocates nothing once the
+// array has grown. Flushing destroys every entry retired at or before the
+// completed value, the most recent first.
+//
+// Functions are kept for subsystems tearing down several objects at once, and
+// are meant for init time only.
+class DeletionQueue {
+  public:
+    void push(VkBuffer buffer, VmaAllocation allocation,
+	      uint64_t retireValue = 0);
+    void push(VkImage image, VmaAllocation allocation,
+	      uint64_t retireValue = 0);
+    void push(VmaAllocation allocation, uint64_t retireValue = 0);
+    void push(VkImageView view, uint64_t retireValue = 0);
+    void push(VkSampler sampler, uint64_t retireValue = 0);
+    void push(VkPipeline pipeline, uint64_t retireValue = 0);
+    void push(VkPipelineLayout layout, uint64_t retireValue = 0);
+    void push(VkDescriptorSetLayout layout, uint64_t retireValue = 0);
+    void push(VkDescriptorPool pool, uint64_t retireValue = 0);
+    void push(VkCommandPool pool, uint64_t retireValue = 0);
+    void push(VkQueryPool pool, uint64_t retireValue = 0);
+    void push(VkFence fence, uint64_t retireValue = 0);
+    void push(VkSemaphore semaphore, uint64_t retireValue = 0);
+    void pushFunction(std::function<void()>&& function,
+		      uint64_t retireValue = 0);
+
+    void flush(VkDevice device, VmaAllocator allocator,
+	       uint64_t completedValue = UINT64_MAX);
+    bool empty() const { return _entries.empty(); }
+
+  private:
+    enum class Type : uint8_t {
+	Buffer,
+	Image,
+	Memory,
+	ImageView,
+	Sampler,
+	Pipeline,
+	PipelineLayout,
+	DescriptorSetLayout,
+	DescriptorPool,
+	CommandPool,
+	QueryPool,
+	Fence,
+	Semaphore,
+	Function,
+    };
+
+    struct Entry {
+	// The handle, or the index of the function
+	uint64_t handle;
+	VmaAllocation allocation;
+	uint64_t retireValue;
+	Type type;
+    };
+
+    template <typename T>
+    void pushHandle(Type type, T handle, VmaAllocation allocation,
+		    uint64_t retireValue) {
+	_entries.push_back(
+	  Entry{ .handle = reinterpret_cast<uint64_t>(handle),
+		 .allocation = allocation,
+		 .retireValue = retireValue,
+		 .type = type });
+    }
+    void destroy(VkDevice device, VmaAllocator allocator, Entry& entry);
+
+    std::vector<Entry> _entries;
+    std::vector<std::function<void()>> _functions;
+};
+
+} // namespace vk
+} // namespace baldwin
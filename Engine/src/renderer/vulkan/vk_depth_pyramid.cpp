@@ -0,0 +1,145 @@
+#include "vk_depth_pyramid.hpp"
+
+#include <algorithm>
+#include <bit>
+#include "graphics_macros.hpp"
+#include "vk_infos.hpp"
+
+namespace baldwin {
+namespace vk {
+
+static constexpr VkFormat PYRAMID_FORMAT = VK_FORMAT_R32G32_SFLOAT;
+// Texels of the first level a workgroup reduces on each side
+static constexpr uint32_t TILE_SIZE = 32;
+// Levels a workgroup writes, and the most texels the last one can read on
+// each side of the last of them
+static constexpr uint32_t TILE_LEVELS = 6;
+static constexpr uint32_t LAST_TILE_SIZE = 2 * TILE_SIZE;
+
+static uint32_t levelSize(uint32_t depthSize, uint32_t level) {
+    return ((depthSize - 1) >> (level + 1)) + 1;
+}
+
+void DepthPyramid::init(VkDevice device, VmaAllocator allocator,
+			BindlessHeap& bindless, VkExtent2D maxExtent) {
+    _allocator = allocator;
+    // A new image, possibly replacing one that was resized
+    state = {};
+    // Counted like for any other extent, before anything is allocated
+    _levels = MAX_LEVELS;
+    _levels = levelCount(maxExtent);
+
+    VkImageCreateInfo imgInfo = getImageCreateInfo(
+      PYRAMID_FORMAT,
+      VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+      { levelSize(maxExtent.width, 0), levelSize(maxExtent.height, 0), 1 });
+    imgInfo.mipLevels = _levels;
+    VmaAllocationCreateInfo allocInfo = {
+	.usage = VMA_MEMORY_USAGE_GPU_ONLY,
+	.requiredFlags = VkMemoryPropertyFlags(
+	  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+    };
+    VK_CHECK(vmaCreateImage(
+	       allocator, &imgInfo, &allocInfo, &_image, &_allocation, nullptr),
+	     "Could not create depth pyramid");
+
+    // Levels are written through their own storage views and read together
+    // through a sampled one
+    VkImageViewCreateInfo viewInfo = getImageViewCreateInfo(
+      PYRAMID_FORMAT, _image, VK_IMAGE_ASPECT_COLOR_BIT);
+    viewInfo.subresourceRange.levelCount = _levels;
+    VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &_view),
+	     "Could not create depth pyramid view");
+    _sampledHandle = bindless.addSampledImage(
+      device, _view, VK_IMAGE_LAYOUT_GENERAL);
+    viewInfo.subresourceRange.levelCount = 1;
+    for (uint32_t level = 0; level < _levels; level++) {
+	viewInfo.subresourceRange.baseMipLevel = level;
+	VK_CHECK(vkCreateImageView(
+		   device, &viewInfo, nullptr, &_levelViews[level]),
+		 "Could not create depth pyramid level view");
+	_levelHandles[level] = bindless.addStorageImage(device,
+							_levelViews[level]);
+    }
+
+    _counter = createBuffer(allocator,
+			    sizeof(uint32_t),
+			    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			      VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			    VMA_MEMORY_USAGE_AUTO,
+			    VMA_ALLOCATION_CREATE_MAPPED_BIT |
+			      VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT);
+    *static_cast<uint32_t*>(_counter.info.pMappedData) = 0;
+    vmaFlushAllocation(allocator, _counter.allocation, 0, VK_WHOLE_SIZE);
+    VkBufferDeviceAddressInfo addressInfo = {
+	.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+	.buffer = _counter.buffer
+    };
+    _counterAddress = vkGetBufferDeviceAddress(device, &addressInfo);
+}
+
+void DepthPyramid::destroy(VkDevice device, BindlessHeap& bindless) {
+    DeletionQueue queue;
+    retire(queue, bindless, 0);
+    queue.flush(device, _allocator);
+}
+
+void DepthPyramid::retire(DeletionQueue& queue, BindlessHeap& bindless,
+			  uint64_t retireValue) {
+    // Flushed most recent first, the views go before their image
+    queue.push(_counter.buffer, _counter.allocation, retireValue);
+    queue.push(_image, _allocation, retireValue);
+    queue.push(_view, retireValue);
+    bindless.release(BindlessType::SampledImage, _sampledHandle);
+    for (uint32_t level = 0; level < _levels; level++) {
+	queue.push(_levelViews[level], retireValue);
+	bindless.release(BindlessType::StorageImage, _levelHandles[level]);
+    }
+}
+
+uint32_t DepthPyramid::levelCount(VkExtent2D depthExtent) const {
+    uint32_t largest = std::max(levelSize(depthExtent.width, 0),
+				levelSize(depthExtent.height, 0));
+    uint32_t levels = std::min(
+      static_cast<uint32_t>(std::bit_width(largest)), _levels);
+    uint32_t lastTile = std::max(
+      levelSize(depthExtent.width, TILE_LEVELS - 1),
+      levelSize(depthExtent.height, TILE_LEVELS - 1));
+    if (lastTile > LAST_TILE_SIZE)
+	levels = std::min(levels, TILE_LEVELS);
+    return levels;
+}
+
+void DepthPyramid::build(VkCommandBuffer cmd, VkPipeline pipeline,
+			 VkPipelineLayout layout, uint32_t depthHandle,
+			 VkExtent2D depthExtent) {
+    struct {
+	VkDeviceAddress counter;
+	uint32_t depth;
+	uint32_t depthWidth;
+	uint32_t depthHeight;
+	uint32_t levelCount;
+	uint32_t levels[MAX_LEVELS];
+    } constants = { _counterAddress,
+		    depthHandle,
+		    depthExtent.width,
+		    depthExtent.height,
+		    levelCount(depthExtent) };
+    std::copy_n(_levelHandles, _levels, constants.levels);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdPushConstants(cmd,
+		       layout,
+		       VK_SHADER_STAGE_ALL,
+		       0,
+		       sizeof(constants),
+		       &constants);
+    uint32_t groupsX = (levelSize(depthExtent.width, 0) + TILE_SIZE - 1) /
+		       TILE_SIZE;
+    uint32_t groupsY = (levelSize(depthExtent.height, 0) + TILE_SIZE - 1) /
+		       TILE_SIZE;
+    vkCmdDispatch(cmd, groupsX, groupsY, 1);
+}
+
+} // namespace vk
+} // namespace baldwin
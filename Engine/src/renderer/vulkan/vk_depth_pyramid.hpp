@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+#include "renderer/vulkan/vk_barriers.hpp"
+#include "renderer/vulkan/vk_bindless.hpp"
+#include "renderer/vulkan/vk_buffers.hpp"
+#include "renderer/vulkan/vk_deletion_queue.hpp"
+#include "renderer/vulkan/vk_pipelines.hpp"
+
+namespace baldwin {
+namespace vk {
+
+// Hierarchical depth of the rendered region, the minimum and maximum depth of
+// each texel's footprint in R and G. Each level halves the previous one,
+// rounding up, and the first one halves the depth image, so a texel of level
+// n covers 2^(n + 1) depth texels on each side.
+//
+// The whole pyramid is built by a single dispatch of pyramid.comp: every
+// workgroup reduces a 64x64 depth tile into the first six levels, through
+// subgroup then shared memory reductions, and the last workgroup to finish
+// reduces the sixth level into the remaining ones.
+class DepthPyramid {
+  public:
+    static constexpr uint32_t MAX_LEVELS = 12;
+    // One invocation per texel of the second level of a tile, the shader
+    // relies on it
+    static constexpr WorkgroupSize WORKGROUP = { 256, 1 };
+
+    // Sized for depth images up to maxExtent
+    void init(VkDevice device, VmaAllocator allocator, BindlessHeap& bindless,
+	      VkExtent2D maxExtent);
+    // Releases its bindless handles as well
+    void destroy(VkDevice device, BindlessHeap& bindless);
+    // Same, once the GPU reaches retireValue, e.g. when resizing
+    void retire(DeletionQueue& queue, BindlessHeap& bindless,
+		uint64_t retireValue);
+
+    // Reduces the depthExtent region of the depth image behind depthHandle,
+    // a sampled bindless handle, into every level. The image must be in
+    // ImageUsage::ComputeReadWrite.
+    void build(VkCommandBuffer cmd, VkPipeline pipeline,
+	       VkPipelineLayout layout, uint32_t depthHandle,
+	       VkExtent2D depthExtent);
+
+    // Levels built from a depth image of that extent. A single workgroup
+    // finishes the pyramid, which caps it for depths above 4096 texels.
+    uint32_t levelCount(VkExtent2D depthExtent) const;
+    // Sampled bindless handle of every level, read in the general layout
+    uint32_t handle() const { return _sampledHandle; }
+    VkImage image() const { return _image; }
+    VkImageView view() const { return _view; }
+
+    // Tracked by the render graph, the pyramid outlives frames
+    ImageState state{};
+
+  private:
+    VmaAllocator _allocator = VK_NULL_HANDLE;
+    VkImage _image = VK_NULL_HANDLE;
+    VmaAllocation _allocation = VK_NULL_HANDLE;
+    VkImageView _view = VK_NULL_HANDLE;
+    VkImageView _levelViews[MAX_LEVELS] = {};
+    uint32_t _levelHandles[MAX_LEVELS] = {};
+    uint32_t _sampledHandle = 0;
+    uint32_t _levels = 0;
+    // Counts finished workgroups, reset by the last one
+    AllocatedBuffer _counter{};
+    VkDeviceAddress _counterAddress = 0;
+};
+
+} // namespace vk
+} // namespace baldwin
@@ -40,52 +40,5 @@ VkDescriptorSetLayout DescriptorLayoutBuilder::build(
     return setLayout;
 }
 
-void DescriptorAllocator::initPool(VkDevice device, uint32_t maxSets,
-				   std::span<PoolSizeRatio> poolRatios) {
-    std::vector<VkDescriptorPoolSize> poolSizes;
-    for (PoolSizeRatio ratio : poolRatios) {
-	poolSizes.push_back(VkDescriptorPoolSize{
-	  .type = ratio.type,
-	  .descriptorCount = static_cast<uint32_t>(ratio.ratio * maxSets) });
-    }
-
-    VkDescriptorPoolCreateInfo poolInfo = {
-	.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-	.flags = 0,
-	.maxSets = maxSets,
-	.poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
-	.pPoolSizes = poolSizes.data(),
-    };
-
-    VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool),
-	     "Could not create descriptor pool");
-}
-
-void DescriptorAllocator::clearDescriptors(VkDevice device) {
-    vkResetDescriptorPool(device, pool, 0);
-}
-
-void DescriptorAllocator::destroyPool(VkDevice device) {
-    vkDestroyDescriptorPool(device, pool, nullptr);
-}
-
-VkDescriptorSet DescriptorAllocator::allocate(VkDevice device,
-					      VkDescriptorSetLayout layout,
-					      void* pNext) {
-    VkDescriptorSetAllocateInfo allocInfo = {
-	.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-	.pNext = pNext,
-	.descriptorPool = pool,
-	.descriptorSetCount = 1,
-	.pSetLayouts = &layout,
-    };
-
-    VkDescriptorSet ds;
-    VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &ds),
-	     "Could not allocate descriptor set!");
-
-    return ds;
-}
-
 } // namespace vk
 } // namespace baldwin
@@ -1,7 +1,6 @@
 #pragma once
 
 #include <vector>
-#include <span>
 #include <vulkan/vulkan.h>
 
 namespace baldwin {
@@ -19,22 +18,5 @@ struct DescriptorLayoutBuilder {
 				VkDescriptorSetLayoutCreateFlags flags = 0);
 };
 
-struct DescriptorAllocator {
-    struct PoolSizeRatio {
-	VkDescriptorType type;
-	float ratio;
-    };
-
-    VkDescriptorPool pool;
-
-    void initPool(VkDevice device, uint32_t maxSets,
-		  std::span<PoolSizeRatio> poolRatios);
-    void clearDescriptors(VkDevice device);
-    void destroyPool(VkDevice device);
-
-    VkDescriptorSet allocate(VkDevice device, VkDescriptorSetLayout layout,
-			     void* pNext = nullptr);
-};
-
 } // namespace vk
 } // namespace baldwin
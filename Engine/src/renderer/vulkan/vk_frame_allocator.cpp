@@ -0,0 +1,60 @@
+#include "vk_frame_allocator.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace baldwin {
+namespace vk {
+
+void FrameAllocator::init(VkDevice device, VmaAllocator allocator,
+			  VkDeviceSize capacity) {
+    this->capacity = capacity;
+    // Host visible device local memory is picked when there is some
+    buffer = createBuffer(
+      allocator,
+      capacity,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+	VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+      VMA_MEMORY_USAGE_AUTO,
+      VMA_ALLOCATION_CREATE_MAPPED_BIT |
+	VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+
+    VkBufferDeviceAddressInfo addressInfo = {
+	.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+	.buffer = buffer.buffer
+    };
+    baseAddress = vkGetBufferDeviceAddress(device, &addressInfo);
+    _offset = 0;
+}
+
+void FrameAllocator::destroy(VmaAllocator allocator) {
+    destroyBuffer(allocator, buffer);
+}
+
+FrameAllocation FrameAllocator::allocate(VkDeviceSize size,
+					 VkDeviceSize alignment) {
+    // Reserving size + alignment - 1 leaves room to align whatever offset
+    // the add returns
+    std::atomic_ref<VkDeviceSize> offset(_offset);
+    VkDeviceSize start = offset.fetch_add(size + alignment - 1,
+					  std::memory_order_relaxed);
+    VkDeviceSize aligned = (start + alignment - 1) / alignment * alignment;
+    if (aligned + size > capacity)
+	throw std::runtime_error("Frame allocator is full");
+
+    return FrameAllocation{
+	.data = static_cast<uint8_t*>(buffer.info.pMappedData) + aligned,
+	.address = baseAddress + aligned,
+	.offset = aligned
+    };
+}
+
+void FrameAllocator::flush(VmaAllocator allocator) {
+    VkDeviceSize used = std::min(
+      capacity, std::atomic_ref<VkDeviceSize>(_offset).load());
+    if (used > 0)
+	vmaFlushAllocation(allocator, buffer.allocation, 0, used);
+}
+
+} // namespace vk
+} // namespace baldwin
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+#include "renderer/vulkan/vk_buffers.hpp"
+
+namespace baldwin {
+namespace vk {
+
+struct FrameAllocation {
+    void* data = nullptr;
+    VkDeviceAddress address = 0;
+    VkDeviceSize offset = 0;
+};
+
+// Bump allocator over a persistently mapped buffer, one per frame in flight.
+// Sub-ranges are handed out with a single atomic add, so any job thread can
+// allocate while recording, and are addressed from shaders through their
+// device address. Everything is released at once by reset, once the frame's
+// fence has signalled.
+struct FrameAllocator {
+    static constexpr VkDeviceSize DEFAULT_CAPACITY = 4 * 1024 * 1024;
+
+    AllocatedBuffer buffer{};
+    VkDeviceAddress baseAddress = 0;
+    VkDeviceSize capacity = 0;
+
+    void init(VkDevice device, VmaAllocator allocator,
+	      VkDeviceSize capacity = DEFAULT_CAPACITY);
+    void destroy(VmaAllocator allocator);
+
+    FrameAllocation allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+    template <typename T>
+    FrameAllocation push(const T& value) {
+	FrameAllocation allocation = allocate(sizeof(T), alignof(T) < 16
+							   ? 16
+							   : alignof(T));
+	std::memcpy(allocation.data, &value, sizeof(T));
+	return allocation;
+    }
+
+    // Makes the writes visible to the device when the memory is not coherent
+    void flush(VmaAllocator allocator);
+    void reset() { _offset = 0; }
+
+  private:
+    // Only accessed atomically, through atomic_ref so that FrameData stays
+    // copyable
+    alignas(std::atomic_ref<VkDeviceSize>::required_alignment)
+      VkDeviceSize _offset = 0;
+};
+
+} // namespace vk
+} // namespace baldwin
@@ -0,0 +1,140 @@
+#include "vk_gpu_scene.hpp"
+
+#include <algorithm>
+
+namespace baldwin {
+namespace vk {
+
+static VkDeviceAddress getAddress(VkDevice device, VkBuffer buffer) {
+    VkBufferDeviceAddressInfo addressInfo = {
+	.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+	.buffer = buffer
+    };
+    return vkGetBufferDeviceAddress(device, &addressInfo);
+}
+
+void GpuScene::init(VkDevice device, VmaAllocator allocator,
+		    const std::vector<uint32_t>& queueFamilies,
+		    uint32_t instanceCapacity, uint32_t clusterCapacity,
+		    uint32_t meshCapacity, uint32_t meshletCapacity) {
+    _allocator = allocator;
+    _meshCapacity = std::max(meshCapacity, 1u);
+    _instanceCapacity = std::max(instanceCapacity, 1u);
+    _meshletCapacity = std::max(meshletCapacity, 1u);
+    _clusterCapacity = std::max(clusterCapacity, 1u);
+    _drawCapacity = std::max(_instanceCapacity, clusterCapacity);
+
+    VkBufferUsageFlags tableUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+				    VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+				    VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+    _meshes = createBuffer(allocator,
+			   VkDeviceSize{ _meshCapacity } * sizeof(GpuMesh),
+			   tableUsage,
+			   VMA_MEMORY_USAGE_GPU_ONLY,
+			   0,
+			   queueFamilies);
+    _instances = createBuffer(allocator,
+			      VkDeviceSize{ _instanceCapacity } *
+				sizeof(GpuInstance),
+			      tableUsage,
+			      VMA_MEMORY_USAGE_GPU_ONLY,
+			      0,
+			      queueFamilies);
+    _meshlets = createBuffer(allocator,
+			     VkDeviceSize{ _meshletCapacity } * sizeof(Meshlet),
+			     tableUsage,
+			     VMA_MEMORY_USAGE_GPU_ONLY,
+			     0,
+			     queueFamilies);
+
+    // Only ever touched by the graphics queue
+    VkBufferUsageFlags drawUsage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+				   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+				   VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+				   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+    _draws = createBuffer(allocator,
+			  drawOffset(PHASE_COUNT),
+			  drawUsage,
+			  VMA_MEMORY_USAGE_GPU_ONLY);
+    _drawCount = createBuffer(allocator,
+			      drawCountOffset(PHASE_COUNT),
+			      drawUsage,
+			      VMA_MEMORY_USAGE_GPU_ONLY);
+    _occlusion = createBuffer(allocator,
+			      VkDeviceSize{ _instanceCapacity } *
+				sizeof(uint32_t),
+			      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+				VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			      VMA_MEMORY_USAGE_GPU_ONLY);
+    _clusterTasks = createBuffer(allocator,
+				 VkDeviceSize{ PHASE_COUNT } *
+				   _clusterCapacity * 2 * sizeof(uint32_t),
+				 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+				   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+				 VMA_MEMORY_USAGE_GPU_ONLY);
+    for (uint32_t phase = 0; phase < PHASE_COUNT; phase++) {
+	_clusterDispatches[phase] = createBuffer(allocator,
+						 sizeof(ClusterDispatch),
+						 drawUsage,
+						 VMA_MEMORY_USAGE_GPU_ONLY);
+	_clusterDispatchAddresses[phase] = getAddress(
+	  device, _clusterDispatches[phase].buffer);
+    }
+
+    _meshAddress = getAddress(device, _meshes.buffer);
+    _instanceAddress = getAddress(device, _instances.buffer);
+    _meshletAddress = getAddress(device, _meshlets.buffer);
+    _drawAddress = getAddress(device, _draws.buffer);
+    _drawCountAddress = getAddress(device, _drawCount.buffer);
+    _occlusionAddress = getAddress(device, _occlusion.buffer);
+    _clusterTaskAddress = getAddress(device, _clusterTasks.buffer);
+}
+
+void GpuScene::destroy() {
+    destroyBuffer(_allocator, _meshes);
+    destroyBuffer(_allocator, _instances);
+    destroyBuffer(_allocator, _meshlets);
+    destroyBuffer(_allocator, _draws);
+    destroyBuffer(_allocator, _drawCount);
+    destroyBuffer(_allocator, _occlusion);
+    destroyBuffer(_allocator, _clusterTasks);
+    for (AllocatedBuffer& dispatch : _clusterDispatches) {
+	destroyBuffer(_allocator, dispatch);
+    }
+}
+
+uint32_t GpuScene::addMeshlets(Uploader& uploader,
+			       std::span<const Meshlet> meshlets) {
+    if (meshlets.size() > _meshletCapacity - _meshletCount)
+	return UINT32_MAX;
+    uint32_t first = _meshletCount;
+    if (!meshlets.empty()) {
+	uploader.uploadBuffer(_meshlets.buffer,
+			      VkDeviceSize{ first } * sizeof(Meshlet),
+			      meshlets.data(),
+			      meshlets.size_bytes());
+    }
+    _meshletCount += static_cast<uint32_t>(meshlets.size());
+    return first;
+}
+
+void GpuScene::upload(Uploader& uploader, const std::vector<GpuMesh>& meshes,
+		      const std::vector<GpuInstance>& instances) {
+    _meshCount = std::min(static_cast<uint32_t>(meshes.size()),
+			  _meshCapacity);
+    _instanceCount = std::min(static_cast<uint32_t>(instances.size()),
+			      _instanceCapacity);
+    if (_meshCount > 0) {
+	uploader.uploadBuffer(
+	  _meshes.buffer, 0, meshes.data(), _meshCount * sizeof(GpuMesh));
+    }
+    if (_instanceCount > 0) {
+	uploader.uploadBuffer(_instances.buffer,
+			      0,
+			      instances.data(),
+			      _instanceCount * sizeof(GpuInstance));
+    }
+}
+
+} // namespace vk
+} // namespace baldwin
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+#include "renderer/vulkan/vk_barriers.hpp"
+#include "renderer/vulkan/vk_buffers.hpp"
+#include "renderer/vulkan/vk_upload.hpp"
+#include "scene/mesh_data.hpp"
+
+namespace baldwin {
+namespace vk {
+
+// Matches Mesh in the shaders, std430 layout
+struct GpuMesh {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t vertexOffset;
+    // In the meshlet table, see GpuScene::addMeshlets
+    uint32_t firstMeshlet;
+    // Dequantizes positions, xyz used
+    float positionOffset[4];
+    float positionScale[4];
+    // Bounding sphere in mesh space, center and radius
+    float sphere[4];
+    uint32_t meshletCount;
+    uint32_t pad[3];
+};
+static_assert(sizeof(GpuMesh) == 80);
+
+// Matches Instance in the shaders, std430 layout
+struct GpuInstance {
+    // Translation in xyz, uniform scale in w
+    float transform[4];
+    // Bounding sphere in world space, center and radius
+    float sphere[4];
+    uint32_t mesh;
+    uint32_t pad[3];
+};
+static_assert(sizeof(GpuInstance) == 48);
+
+// Meshes and instances of the scene in storage buffers, read through their
+// device addresses by the culling pass and the mesh vertex shader, along with
+// the indirect draws the culling pass writes for the visible instances. Each
+// draw is an instance, whose index is passed as its first instance.
+//
+// Culling runs in two phases, each with its own list of draws and count: the
+// early one draws what last frame's depth pyramid does not hide, the late one
+// what this frame's pyramid shows among the rest. Instances are flagged
+// between both.
+//
+// With cluster culling, visible instances instead append one task per
+// meshlet to their phase's task list, and the cluster pass turns the tasks
+// whose meshlet survives into draws. Each phase has its own indirect
+// dispatch for them. Meshlets the early phase finds occluded are appended
+// to the late phase's tasks to be tested again.
+//
+// Capacities are fixed at init like the mesh pool's.
+class GpuScene {
+  public:
+    static constexpr uint32_t DEFAULT_MESH_CAPACITY = 65536;
+    // Enough for the mesh pool's default index capacity in full meshlets
+    static constexpr uint32_t DEFAULT_MESHLET_CAPACITY = 262144;
+    static constexpr uint32_t PHASE_COUNT = 2;
+
+    // Matches TaskDispatch in the shaders
+    struct ClusterDispatch {
+	VkDispatchIndirectCommand command;
+	uint32_t taskCount;
+    };
+
+    // Tables are shared with every family in queueFamilies, the uploader's
+    // included. Phases have room for as many draws as instances or
+    // clusters, whichever is larger.
+    void init(VkDevice device, VmaAllocator allocator,
+	      const std::vector<uint32_t>& queueFamilies,
+	      uint32_t instanceCapacity, uint32_t clusterCapacity,
+	      uint32_t meshCapacity = DEFAULT_MESH_CAPACITY,
+	      uint32_t meshletCapacity = DEFAULT_MESHLET_CAPACITY);
+    void destroy();
+
+    // Appends the meshlets of a mesh to the table and returns the index of
+    // the first one, UINT32_MAX when they don't fit
+    uint32_t addMeshlets(Uploader& uploader,
+			 std::span<const Meshlet> meshlets);
+    // Replaces the meshes and instances, copies go through the uploader.
+    // Whatever is past the capacities is dropped, instances must only
+    // reference meshes that are kept.
+    void upload(Uploader& uploader, const std::vector<GpuMesh>& meshes,
+		const std::vector<GpuInstance>& instances);
+
+    uint32_t meshCount() const { return _meshCount; }
+    uint32_t instanceCount() const { return _instanceCount; }
+    uint32_t meshletCount() const { return _meshletCount; }
+    uint32_t meshCapacity() const { return _meshCapacity; }
+    uint32_t instanceCapacity() const { return _instanceCapacity; }
+    uint32_t clusterCapacity() const { return _clusterCapacity; }
+    // Per phase
+    uint32_t drawCapacity() const { return _drawCapacity; }
+    VkDeviceAddress meshAddress() const { return _meshAddress; }
+    VkDeviceAddress instanceAddress() const { return _instanceAddress; }
+    VkDeviceAddress meshletAddress() const { return _meshletAddress; }
+    VkDeviceAddress occlusionAddress() const { return _occlusionAddress; }
+    // Draws and count of a phase, at these offsets of their buffers
+    VkDeviceSize drawOffset(uint32_t phase) const {
+	return VkDeviceSize{ phase } * _drawCapacity *
+	       sizeof(VkDrawIndexedIndirectCommand);
+    }
+    VkDeviceSize drawCountOffset(uint32_t phase) const {
+	return phase * sizeof(uint32_t);
+    }
+    VkDeviceAddress drawAddress(uint32_t phase) const {
+	return _drawAddress + drawOffset(phase);
+    }
+    VkDeviceAddress drawCountAddress(uint32_t phase) const {
+	return _drawCountAddress + drawCountOffset(phase);
+    }
+    VkBuffer drawBuffer() const { return _draws.buffer; }
+    VkBuffer drawCountBuffer() const { return _drawCount.buffer; }
+    VkBuffer occlusionBuffer() const { return _occlusion.buffer; }
+    // Tasks of a phase, clusterCapacity of them, as pairs of instance and
+    // meshlet indices. Every phase is in the same buffer.
+    VkDeviceAddress clusterTaskAddress(uint32_t phase) const {
+	return _clusterTaskAddress +
+	       VkDeviceSize{ phase } * _clusterCapacity * 2 * sizeof(uint32_t);
+    }
+    VkBuffer clusterTaskBuffer() const { return _clusterTasks.buffer; }
+    VkDeviceAddress clusterDispatchAddress(uint32_t phase) const {
+	return _clusterDispatchAddresses[phase];
+    }
+    VkBuffer clusterDispatchBuffer(uint32_t phase) const {
+	return _clusterDispatches[phase].buffer;
+    }
+
+    // Tracked by the render graph, these buffers are written every frame
+    BufferState drawState{};
+    BufferState drawCountState{};
+    BufferState occlusionState{};
+    BufferState clusterTaskState{};
+    BufferState clusterDispatchStates[PHASE_COUNT]{};
+
+  private:
+    VmaAllocator _allocator = VK_NULL_HANDLE;
+    AllocatedBuffer _meshes{};
+    AllocatedBuffer _instances{};
+    AllocatedBuffer _meshlets{};
+    AllocatedBuffer _draws{};
+    AllocatedBuffer _drawCount{};
+    // One flag per instance, set when the early phase found it occluded
+    AllocatedBuffer _occlusion{};
+    AllocatedBuffer _clusterTasks{};
+    AllocatedBuffer _clusterDispatches[PHASE_COUNT]{};
+    VkDeviceAddress _meshAddress = 0;
+    VkDeviceAddress _instanceAddress = 0;
+    VkDeviceAddress _meshletAddress = 0;
+    VkDeviceAddress _drawAddress = 0;
+    VkDeviceAddress _drawCountAddress = 0;
+    VkDeviceAddress _occlusionAddress = 0;
+    VkDeviceAddress _clusterTaskAddress = 0;
+    VkDeviceAddress _clusterDispatchAddresses[PHASE_COUNT]{};
+    uint32_t _meshCapacity = 0;
+    uint32_t _instanceCapacity = 0;
+    uint32_t _meshletCapacity = 0;
+    uint32_t _clusterCapacity = 0;
+    uint32_t _drawCapacity = 0;
+    uint32_t _meshCount = 0;
+    uint32_t _instanceCount = 0;
+    uint32_t _meshletCount = 0;
+};
+
+} // namespace vk
+} // namespace baldwin
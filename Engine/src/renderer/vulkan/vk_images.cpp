@@ -1,4 +1,4 @@
-#include <vulkan/vulkan.h>
+#include "vk_images.hpp"
 
 namespace baldwin {
 namespace vk {
@@ -16,67 +16,6 @@ VkImageSubresourceRange getImageSubresourceRange(
     return subImage;
 }
 
-// TODO Auto-trach iamge layout
-void createImageBarrier(VkCommandBuffer cmd, VkImage image,
-			VkImageLayout imageLayout) {
-
-    VkImageMemoryBarrier2 imageBarrier = {
-	.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-	.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-	.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
-	.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-	.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT |
-			 VK_ACCESS_2_MEMORY_READ_BIT,
-	.oldLayout = imageLayout,
-	.newLayout = imageLayout,
-	.image = image
-    };
-
-    VkImageAspectFlags aspectMask = (imageLayout ==
-				     VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL)
-				      ? VK_IMAGE_ASPECT_DEPTH_BIT
-				      : VK_IMAGE_ASPECT_COLOR_BIT;
-    imageBarrier.subresourceRange = getImageSubresourceRange(aspectMask);
-
-    VkDependencyInfo depInfo = {
-	.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-	.imageMemoryBarrierCount = 1,
-	.pImageMemoryBarriers = &imageBarrier,
-    };
-
-    vkCmdPipelineBarrier2(cmd, &depInfo);
-}
-
-void createImageBarrierWithTransition(VkCommandBuffer cmd, VkImage image,
-				      VkImageLayout currentLayout,
-				      VkImageLayout newLayout) {
-    VkImageMemoryBarrier2 imageBarrier = {
-	.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-	.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-	.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
-	.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-	.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT |
-			 VK_ACCESS_2_MEMORY_READ_BIT,
-	.oldLayout = currentLayout,
-	.newLayout = newLayout,
-	.image = image
-    };
-
-    VkImageAspectFlags aspectMask = (newLayout ==
-				     VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL)
-				      ? VK_IMAGE_ASPECT_DEPTH_BIT
-				      : VK_IMAGE_ASPECT_COLOR_BIT;
-    imageBarrier.subresourceRange = getImageSubresourceRange(aspectMask);
-
-    VkDependencyInfo depInfo = {
-	.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-	.imageMemoryBarrierCount = 1,
-	.pImageMemoryBarriers = &imageBarrier,
-    };
-
-    vkCmdPipelineBarrier2(cmd, &depInfo);
-}
-
 void copyImageToImage(VkCommandBuffer cmd, VkImage source, VkImage destination,
 		      VkExtent2D srcSize, VkExtent2D dstSize) {
     VkImageBlit2 blitRegion = {
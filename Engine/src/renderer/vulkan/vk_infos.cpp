@@ -28,6 +28,18 @@ VkCommandBufferBeginInfo getCommandBufferBeginInfo(
     return info;
 }
 
+VkCommandBufferInheritanceRenderingInfo getInheritanceRenderingInfo(
+  const VkFormat* colorFormat, VkFormat depthFormat) {
+    VkCommandBufferInheritanceRenderingInfo info = {
+	.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+	.colorAttachmentCount = 1,
+	.pColorAttachmentFormats = colorFormat,
+	.depthAttachmentFormat = depthFormat,
+	.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT
+    };
+    return info;
+}
+
 VkCommandBufferSubmitInfo getCommandBufferSubmitInfo(VkCommandBuffer cmd) {
     VkCommandBufferSubmitInfo info = {
 	.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
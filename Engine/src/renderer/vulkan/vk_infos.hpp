@@ -8,6 +8,8 @@ VkSemaphoreSubmitInfo getSemaphoreSubmitInfo(VkPipelineStageFlags2 stageMask,
 					     VkSemaphore semaphore);
 VkCommandBufferBeginInfo getCommandBufferBeginInfo(
   VkCommandBufferUsageFlags flags);
+VkCommandBufferInheritanceRenderingInfo getInheritanceRenderingInfo(
+  const VkFormat* colorFormat, VkFormat depthFormat);
 VkCommandBufferSubmitInfo getCommandBufferSubmitInfo(VkCommandBuffer cmd);
 VkSubmitInfo2 getSubmitInfo(VkCommandBufferSubmitInfo* cmd,
 			    VkSemaphoreSubmitInfo* signalSemaphoreInfo,
@@ -0,0 +1,104 @@
+#include "vk_mesh_pool.hpp"
+
+#include "graphics_macros.hpp"
+#include "scene/mesh_data.hpp"
+
+namespace baldwin {
+namespace vk {
+
+void MeshPool::init(VkDevice device, VmaAllocator allocator,
+		    const std::vector<uint32_t>& queueFamilies,
+		    VkDeviceSize vertexCapacity, VkDeviceSize indexCapacity) {
+    _allocator = allocator;
+    _vertices = createBuffer(allocator,
+			     vertexCapacity,
+			     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			       VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+			       VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			     VMA_MEMORY_USAGE_GPU_ONLY,
+			     0,
+			     queueFamilies);
+    _indices = createBuffer(allocator,
+			    indexCapacity,
+			    VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+			      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			      VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			    VMA_MEMORY_USAGE_GPU_ONLY,
+			    0,
+			    queueFamilies);
+
+    VkBufferDeviceAddressInfo addressInfo = {
+	.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+	.buffer = _vertices.buffer
+    };
+    _vertexAddress = vkGetBufferDeviceAddress(device, &addressInfo);
+
+    VmaVirtualBlockCreateInfo blockInfo = { .size = vertexCapacity };
+    VK_CHECK(vmaCreateVirtualBlock(&blockInfo, &_vertexBlock),
+	     "Could not create vertex virtual block");
+    blockInfo.size = indexCapacity;
+    VK_CHECK(vmaCreateVirtualBlock(&blockInfo, &_indexBlock),
+	     "Could not create index virtual block");
+}
+
+void MeshPool::destroy() {
+    // Meshes are not freed one by one on shutdown
+    vmaClearVirtualBlock(_vertexBlock);
+    vmaClearVirtualBlock(_indexBlock);
+    vmaDestroyVirtualBlock(_vertexBlock);
+    vmaDestroyVirtualBlock(_indexBlock);
+    destroyBuffer(_allocator, _vertices);
+    destroyBuffer(_allocator, _indices);
+}
+
+bool MeshPool::allocate(uint32_t vertexCount, uint32_t indexCount,
+			MeshAllocation& allocation) {
+    // Aligned on the element size, so offsets convert to element indices
+    VmaVirtualAllocationCreateInfo vertexInfo = {
+	.size = VkDeviceSize{ vertexCount } * sizeof(PackedVertex),
+	.alignment = sizeof(PackedVertex)
+    };
+    VmaVirtualAllocationCreateInfo indexInfo = {
+	.size = VkDeviceSize{ indexCount } * sizeof(uint32_t),
+	.alignment = sizeof(uint32_t)
+    };
+
+    std::lock_guard lock(_mutex);
+    VkDeviceSize vertexOffset, indexOffset;
+    if (vmaVirtualAllocate(
+	  _vertexBlock, &vertexInfo, &allocation.vertices, &vertexOffset) !=
+	VK_SUCCESS) {
+	return false;
+    }
+    if (vmaVirtualAllocate(
+	  _indexBlock, &indexInfo, &allocation.indices, &indexOffset) !=
+	VK_SUCCESS) {
+	vmaVirtualFree(_vertexBlock, allocation.vertices);
+	return false;
+    }
+
+    allocation.firstVertex = static_cast<uint32_t>(vertexOffset /
+						   sizeof(PackedVertex));
+    allocation.firstIndex = static_cast<uint32_t>(indexOffset /
+						  sizeof(uint32_t));
+    allocation.vertexCount = vertexCount;
+    allocation.indexCount = indexCount;
+    return true;
+}
+
+void MeshPool::free(const MeshAllocation& allocation) {
+    std::lock_guard lock(_mutex);
+    vmaVirtualFree(_vertexBlock, allocation.vertices);
+    vmaVirtualFree(_indexBlock, allocation.indices);
+}
+
+VkDeviceSize MeshPool::usedBytes() const {
+    std::lock_guard lock(_mutex);
+    VmaStatistics vertexStats, indexStats;
+    vmaGetVirtualBlockStatistics(_vertexBlock, &vertexStats);
+    vmaGetVirtualBlockStatistics(_indexBlock, &indexStats);
+    return vertexStats.allocationBytes + indexStats.allocationBytes;
+}
+
+} // namespace vk
+} // namespace baldwin
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+#include "renderer/vulkan/vk_buffers.hpp"
+
+namespace baldwin {
+namespace vk {
+
+// Place of a mesh in the pool buffers, in elements so that it can be passed
+// to indexed draws as is
+struct MeshAllocation {
+    VmaVirtualAllocation vertices = VK_NULL_HANDLE;
+    VmaVirtualAllocation indices = VK_NULL_HANDLE;
+    uint32_t firstVertex = 0;
+    uint32_t firstIndex = 0;
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+};
+
+// One large vertex buffer and one large index buffer shared by every mesh,
+// so that all of them are drawn without rebinding anything. Space is
+// suballocated with VMA virtual blocks. Shaders fetch vertices through the
+// vertex buffer's device address, indices go through the regular index
+// buffer binding. Allocating and freeing is thread safe.
+class MeshPool {
+  public:
+    static constexpr VkDeviceSize DEFAULT_VERTEX_CAPACITY = 256 * 1024 * 1024;
+    static constexpr VkDeviceSize DEFAULT_INDEX_CAPACITY = 128 * 1024 * 1024;
+
+    // Buffers are shared with every family in queueFamilies, the uploader's
+    // included
+    void init(VkDevice device, VmaAllocator allocator,
+	      const std::vector<uint32_t>& queueFamilies,
+	      VkDeviceSize vertexCapacity = DEFAULT_VERTEX_CAPACITY,
+	      VkDeviceSize indexCapacity = DEFAULT_INDEX_CAPACITY);
+    void destroy();
+
+    // False when either buffer has no room left
+    bool allocate(uint32_t vertexCount, uint32_t indexCount,
+		  MeshAllocation& allocation);
+    // The GPU must be done with the mesh, see DeletionQueue::pushFunction
+    void free(const MeshAllocation& allocation);
+
+    VkBuffer vertexBuffer() const { return _vertices.buffer; }
+    VkBuffer indexBuffer() const { return _indices.buffer; }
+    VkDeviceAddress vertexAddress() const { return _vertexAddress; }
+    // Bytes allocated in both buffers
+    VkDeviceSize usedBytes() const;
+
+  private:
+    VmaAllocator _allocator = VK_NULL_HANDLE;
+    AllocatedBuffer _vertices{};
+    AllocatedBuffer _indices{};
+    VkDeviceAddress _vertexAddress = 0;
+
+    // Virtual blocks are not thread safe
+    mutable std::mutex _mutex;
+    VmaVirtualBlock _vertexBlock = VK_NULL_HANDLE;
+    VmaVirtualBlock _indexBlock = VK_NULL_HANDLE;
+};
+
+} // namespace vk
+} // namespace baldwin
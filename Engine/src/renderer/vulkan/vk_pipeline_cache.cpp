@@ -0,0 +1,130 @@
+#include "vk_pipeline_cache.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include "graphics_macros.hpp"
+
+namespace baldwin {
+namespace vk {
+
+static constexpr uint32_t CACHE_FILE_MAGIC = 0x43504c42; // "BLPC"
+
+// Validates the header Vulkan puts in front of every pipeline cache blob
+static bool isCompatibleBlob(const std::vector<char>& data,
+			     const VkPhysicalDeviceProperties& props) {
+    VkPipelineCacheHeaderVersionOne header;
+    if (data.size() < sizeof(header))
+	return false;
+
+    std::memcpy(&header, data.data(), sizeof(header));
+    return header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+	   header.vendorID == props.vendorID &&
+	   header.deviceID == props.deviceID &&
+	   std::memcmp(header.pipelineCacheUUID,
+		       props.pipelineCacheUUID,
+		       VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::init(VkDevice device, VkPhysicalDevice gpu,
+			 const std::string& cachePath) {
+    path = cachePath;
+
+    VkPhysicalDeviceIDProperties idProps = {
+	.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES
+    };
+    VkPhysicalDeviceProperties2 props = {
+	.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+	.pNext = &idProps
+    };
+    vkGetPhysicalDeviceProperties2(gpu, &props);
+
+    _identity = {
+	.magic = CACHE_FILE_MAGIC,
+	.vendorID = props.properties.vendorID,
+	.deviceID = props.properties.deviceID,
+	.driverVersion = props.properties.driverVersion,
+    };
+    std::memcpy(_identity.driverUUID, idProps.driverUUID, VK_UUID_SIZE);
+    std::memcpy(_identity.pipelineCacheUUID,
+		props.properties.pipelineCacheUUID,
+		VK_UUID_SIZE);
+
+    // Anything that does not exactly match the current device and driver is
+    // thrown away, the driver would reject it anyway
+    std::vector<char> data;
+    std::ifstream file(path, std::ios::binary);
+    FileHeader header{};
+    if (!path.empty() && file.is_open() &&
+	file.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+	header.magic == _identity.magic &&
+	header.vendorID == _identity.vendorID &&
+	header.deviceID == _identity.deviceID &&
+	header.driverVersion == _identity.driverVersion &&
+	std::memcmp(header.driverUUID, _identity.driverUUID, VK_UUID_SIZE) ==
+	  0 &&
+	std::memcmp(header.pipelineCacheUUID,
+		    _identity.pipelineCacheUUID,
+		    VK_UUID_SIZE) == 0) {
+	data.resize(header.dataSize);
+	if (!file.read(data.data(), header.dataSize) ||
+	    !isCompatibleBlob(data, props.properties)) {
+	    data.clear();
+	}
+    }
+    warm = !data.empty();
+
+    VkPipelineCacheCreateInfo info = {
+	.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+	.initialDataSize = data.size(),
+	.pInitialData = data.empty() ? nullptr : data.data(),
+    };
+    VK_CHECK(vkCreatePipelineCache(device, &info, nullptr, &cache),
+	     "Could not create pipeline cache");
+}
+
+void PipelineCache::save(VkDevice device) {
+    if (path.empty() || cache == VK_NULL_HANDLE)
+	return;
+
+    size_t size = 0;
+    VK_CHECK(vkGetPipelineCacheData(device, cache, &size, nullptr),
+	     "Could not query pipeline cache size");
+    std::vector<char> data(size);
+    VK_CHECK(vkGetPipelineCacheData(device, cache, &size, data.data()),
+	     "Could not read pipeline cache data");
+
+    FileHeader header = _identity;
+    header.dataSize = static_cast<uint32_t>(size);
+
+    // Write next to the destination then rename over it, so a crash never
+    // leaves a truncated cache behind
+    std::string tmpPath = path + ".tmp";
+    {
+	std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(data.data(), static_cast<std::streamsize>(size));
+	if (!file) {
+	    std::cerr << "Could not write pipeline cache " << tmpPath
+		      << std::endl;
+	    return;
+	}
+    }
+
+    std::error_code err;
+    std::filesystem::rename(tmpPath, path, err);
+    if (err) {
+	std::cerr << "Could not replace pipeline cache " << path << " : "
+		  << err.message() << std::endl;
+    }
+}
+
+void PipelineCache::destroy(VkDevice device) {
+    vkDestroyPipelineCache(device, cache, nullptr);
+    cache = VK_NULL_HANDLE;
+}
+
+} // namespace vk
+} // namespace baldwin
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vulkan/vulkan.h>
+
+namespace baldwin {
+namespace vk {
+
+// Engine wide VkPipelineCache persisted across runs. The blob on disk is
+// prefixed with the identity of the device and driver that produced it, and is
+// discarded when it does not match the current ones.
+struct PipelineCache {
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    std::string path;
+    // True when valid data was loaded from disk
+    bool warm = false;
+
+    void init(VkDevice device, VkPhysicalDevice gpu, const std::string& path);
+    void save(VkDevice device);
+    void destroy(VkDevice device);
+
+  private:
+    struct FileHeader {
+	uint32_t magic;
+	uint32_t dataSize;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t driverUUID[VK_UUID_SIZE];
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    };
+
+    FileHeader _identity{};
+};
+
+} // namespace vk
+} // namespace baldwin
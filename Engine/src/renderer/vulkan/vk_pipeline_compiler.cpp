@@ -0,0 +1,202 @@
+#include "vk_pipeline_compiler.hpp"
+
+#include "vk_shaders.hpp"
+
+namespace baldwin {
+namespace vk {
+
+void PipelineCompiler::init(VkDevice device, VkPipelineCache cache,
+			    JobSystem& jobs) {
+    _device = device;
+    _cache = cache;
+    _jobs = &jobs;
+}
+
+void PipelineCompiler::destroy() {
+    _jobs->wait(_counter);
+    for (VkPipeline pipeline : _pipelines) {
+	vkDestroyPipeline(_device, pipeline, nullptr);
+    }
+    _pipelines.clear();
+    _graphicsPipelines.clear();
+    _computePipelines.clear();
+}
+
+PipelineHandle PipelineCompiler::compileGraphics(
+    const GraphicsPipelineBuilder& builder, std::string vertexShader,
+    std::string fragmentShader) {
+    GraphicsPipelineKey key = builder.getKey(vertexShader, fragmentShader);
+    PipelineHandle handle;
+    {
+	std::lock_guard lock(_mutex);
+	auto it = _graphicsPipelines.find(key);
+	if (it != _graphicsPipelines.end()) {
+	    _hits++;
+	    it->second.hits++;
+	    return it->second.handle;
+	}
+	_misses++;
+	handle = newHandle();
+	_graphicsPipelines.emplace(std::move(key), Entry{ handle });
+    }
+
+    auto compile = [this,
+		    builder = GraphicsPipelineBuilder(builder),
+		    vertexShader = std::move(vertexShader),
+		    fragmentShader = std::move(fragmentShader)]() mutable {
+	// Both lookups may throw, done before any module needs destroying
+	std::span<const uint32_t> vertCode = getShaderCode(vertexShader);
+	std::span<const uint32_t> fragCode = getShaderCode(fragmentShader);
+	VkShaderModule vertModule = createShaderModule(_device, vertCode);
+	VkShaderModule fragModule = VK_NULL_HANDLE;
+	try {
+	    fragModule = createShaderModule(_device, fragCode);
+	} catch (...) {
+	    vkDestroyShaderModule(_device, vertModule, nullptr);
+	    throw;
+	}
+	builder.setShaders(vertModule, fragModule);
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	try {
+	    pipeline = builder.build(_device, _cache);
+	} catch (...) {
+	    vkDestroyShaderModule(_device, vertModule, nullptr);
+	    vkDestroyShaderModule(_device, fragModule, nullptr);
+	    throw;
+	}
+	vkDestroyShaderModule(_device, vertModule, nullptr);
+	vkDestroyShaderModule(_device, fragModule, nullptr);
+	return pipeline;
+    };
+    submit(handle, std::move(compile));
+    return handle;
+}
+
+PipelineHandle PipelineCompiler::compileCompute(std::string shader,
+						VkPipelineLayout layout,
+						WorkgroupSize workgroup) {
+    ComputePipelineKey key = { shader, layout, workgroup };
+    PipelineHandle handle;
+    {
+	std::lock_guard lock(_mutex);
+	auto it = _computePipelines.find(key);
+	if (it != _computePipelines.end()) {
+	    _hits++;
+	    it->second.hits++;
+	    return it->second.handle;
+	}
+	_misses++;
+	handle = newHandle();
+	_computePipelines.emplace(std::move(key), Entry{ handle });
+    }
+
+    auto compile = [this, shader = std::move(shader), layout, workgroup]() {
+	VkShaderModule module =
+	  createShaderModule(_device, getShaderCode(shader));
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	try {
+	    pipeline =
+	      createComputePipeline(_device, _cache, layout, module, workgroup);
+	} catch (...) {
+	    vkDestroyShaderModule(_device, module, nullptr);
+	    throw;
+	}
+	vkDestroyShaderModule(_device, module, nullptr);
+	return pipeline;
+    };
+    submit(handle, std::move(compile));
+    return handle;
+}
+
+PipelineHandle PipelineCompiler::newHandle() {
+    PipelineHandle handle;
+    handle._pipeline = std::make_shared<std::atomic<VkPipeline>>(
+      VK_NULL_HANDLE);
+    if (_counter.done())
+	_startedAt = std::chrono::steady_clock::now();
+    return handle;
+}
+
+void PipelineCompiler::submit(const PipelineHandle& handle,
+			      std::function<VkPipeline()>&& compile) {
+    // Pipeline caches are internally synchronized, so every job can share
+    // the renderer's
+    _jobs->runBackground(
+      [this, compile = std::move(compile), result = handle._pipeline]() {
+	  VkPipeline pipeline = VK_NULL_HANDLE;
+	  std::exception_ptr error;
+	  try {
+	      pipeline = compile();
+	  } catch (...) {
+	      error = std::current_exception();
+	  }
+
+	  std::lock_guard lock(_mutex);
+	  if (pipeline != VK_NULL_HANDLE)
+	      _pipelines.push_back(pipeline);
+	  if (error && !_error)
+	      _error = error;
+	  _finishedAt = std::chrono::steady_clock::now();
+	  result->store(pipeline, std::memory_order_release);
+      },
+      &_counter);
+}
+
+void PipelineCompiler::update() {
+    if (_jobs->threadCount() == 1)
+	_jobs->wait(_counter);
+
+    std::exception_ptr error;
+    {
+	std::lock_guard lock(_mutex);
+	std::swap(error, _error);
+    }
+    if (error)
+	std::rethrow_exception(error);
+}
+
+void PipelineCompiler::waitAll() {
+    _jobs->wait(_counter);
+    update();
+}
+
+double PipelineCompiler::compileMs() const {
+    std::lock_guard lock(_mutex);
+    return std::chrono::duration<double, std::milli>(_finishedAt - _startedAt)
+      .count();
+}
+
+PsoCacheStatistics PipelineCompiler::getStatistics() const {
+    std::lock_guard lock(_mutex);
+    PsoCacheStatistics statistics = {
+	.graphicsPipelines = static_cast<uint32_t>(_graphicsPipelines.size()),
+	.computePipelines = static_cast<uint32_t>(_computePipelines.size()),
+	.hits = _hits,
+	.misses = _misses
+    };
+    return statistics;
+}
+
+void PipelineCompiler::dumpStatistics(std::ostream& out) const {
+    std::lock_guard lock(_mutex);
+    out << "Unique pipelines : " << _graphicsPipelines.size()
+	<< " graphics, " << _computePipelines.size() << " compute (" << _hits
+	<< " hits, " << _misses << " misses)\n";
+    for (const auto& [key, entry] : _graphicsPipelines) {
+	out << "  graphics " << key.vertexShader << " + " << key.fragmentShader
+	    << " | topology " << key.topology << ", polygon "
+	    << key.polygonMode << ", cull " << key.cullMode << ", samples "
+	    << key.samples << ", blend " << key.blend.blendEnable
+	    << ", depth " << key.depthTest << "/" << key.depthWrite
+	    << ", formats " << key.colorFormat << "/" << key.depthFormat
+	    << " | " << entry.hits << " hits\n";
+    }
+    for (const auto& [key, entry] : _computePipelines) {
+	out << "  compute " << key.shader << " | workgroup "
+	    << key.workgroup.x << "x" << key.workgroup.y << " | " << entry.hits
+	    << " hits\n";
+    }
+}
+
+} // namespace vk
+} // namespace baldwin
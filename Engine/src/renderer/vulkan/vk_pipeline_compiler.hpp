@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "../renderer.hpp"
+#include "core/job_system.hpp"
+#include "renderer/vulkan/vk_pipelines.hpp"
+
+namespace baldwin {
+namespace vk {
+
+// Future-like handle to a pipeline compiled on a job thread. Copies share the
+// same pipeline.
+class PipelineHandle {
+  public:
+    bool ready() const { return get() != VK_NULL_HANDLE; }
+    // VK_NULL_HANDLE until the pipeline is compiled
+    VkPipeline get() const {
+	return _pipeline ? _pipeline->load(std::memory_order_acquire)
+			 : VK_NULL_HANDLE;
+    }
+
+  private:
+    friend class PipelineCompiler;
+    std::shared_ptr<std::atomic<VkPipeline>> _pipeline;
+};
+
+// Creates shader modules and pipelines on the job system, so that startup
+// doesn't wait on them one after another. Callers keep rendering with
+// fallbacks until their handles are ready. Pipelines are owned by the
+// compiler and destroyed with it.
+// Pipelines are deduplicated by their state, requesting one that was already
+// requested, compiled or not, returns the same handle. Any thread can
+// request pipelines.
+class PipelineCompiler {
+  public:
+    void init(VkDevice device, VkPipelineCache cache, JobSystem& jobs);
+    // Waits for pending compilations before destroying every pipeline
+    void destroy();
+
+    // Shaders are named as in the shader archive, the builder's own shaders
+    // are replaced
+    PipelineHandle compileGraphics(const GraphicsPipelineBuilder& builder,
+				   std::string vertexShader,
+				   std::string fragmentShader);
+    PipelineHandle compileCompute(std::string shader, VkPipelineLayout layout,
+				  WorkgroupSize workgroup);
+
+    // Called once per frame, rethrows compilation errors on the calling
+    // thread. Without worker threads, nothing else would run the jobs, so
+    // they are completed here.
+    void update();
+    // Blocks until every pipeline is compiled, helping with the jobs
+    void waitAll();
+    bool idle() const { return _counter.done(); }
+    // From the first compilation to the end of the last one
+    double compileMs() const;
+
+    PsoCacheStatistics getStatistics() const;
+    // Every unique pipeline with its state and how often it was reused
+    void dumpStatistics(std::ostream& out) const;
+
+  private:
+    // Called with the lock held, for a key that is not in the maps yet
+    PipelineHandle newHandle();
+    // Called without the lock, queues a background job since compiling may
+    // take longer than a frame
+    void submit(const PipelineHandle& handle,
+		std::function<VkPipeline()>&& compile);
+
+    struct Entry {
+	PipelineHandle handle;
+	uint32_t hits = 0;
+    };
+
+    VkDevice _device = VK_NULL_HANDLE;
+    VkPipelineCache _cache = VK_NULL_HANDLE;
+    JobSystem* _jobs = nullptr;
+    JobCounter _counter;
+
+    // Everything below is shared with the jobs
+    mutable std::mutex _mutex;
+    std::vector<VkPipeline> _pipelines;
+    std::unordered_map<GraphicsPipelineKey,
+		       Entry,
+		       PipelineKeyHash>
+      _graphicsPipelines;
+    std::unordered_map<ComputePipelineKey,
+		       Entry,
+		       PipelineKeyHash>
+      _computePipelines;
+    uint64_t _hits = 0;
+    uint64_t _misses = 0;
+    std::exception_ptr _error;
+    std::chrono::steady_clock::time_point _startedAt{};
+    std::chrono::steady_clock::time_point _finishedAt{};
+};
+
+} // namespace vk
+} // namespace baldwin
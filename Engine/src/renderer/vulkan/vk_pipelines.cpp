@@ -1,6 +1,10 @@
 #include "vk_pipelines.hpp"
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
 #include <stdexcept>
 #include <sys/types.h>
 #include <vulkan/vulkan_core.h>
@@ -95,7 +99,25 @@ void GraphicsPipelineBuilder::disableDepthTest() {
     _depthStencil.maxDepthBounds = 1.0f;
 }
 
-VkPipeline GraphicsPipelineBuilder::build(const VkDevice& device) {
+void GraphicsPipelineBuilder::enableDepthTest(bool depthWriteEnable,
+					      VkCompareOp op) {
+    _depthStencil.depthTestEnable = VK_TRUE;
+    _depthStencil.depthWriteEnable = depthWriteEnable;
+    _depthStencil.depthCompareOp = op;
+    _depthStencil.depthBoundsTestEnable = VK_FALSE;
+    _depthStencil.stencilTestEnable = VK_FALSE;
+    _depthStencil.front = {};
+    _depthStencil.back = {};
+    _depthStencil.minDepthBounds = 0.0f;
+    _depthStencil.maxDepthBounds = 1.0f;
+}
+
+VkPipeline GraphicsPipelineBuilder::build(const VkDevice& device,
+					  VkPipelineCache cache) {
+    // The builder may have been copied since the format was set
+    if (_renderInfo.colorAttachmentCount > 0)
+	_renderInfo.pColorAttachmentFormats = &_colorAttachmentformat;
+
     // We use dynamic viewprt state so only counts are required
     VkPipelineViewportStateCreateInfo viewportInfo = {
 	.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
@@ -106,8 +128,7 @@ VkPipeline GraphicsPipelineBuilder::build(const VkDevice& device) {
     // We only render opaque objects for now
     // And to one attachment
     VkPipelineColorBlendStateCreateInfo blendInfo = {
-	.sType =
-	  VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_ADVANCED_STATE_CREATE_INFO_EXT,
+	.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
 	.logicOpEnable = VK_FALSE,
 	.logicOp = VK_LOGIC_OP_COPY,
 	.attachmentCount = 1,
@@ -145,12 +166,120 @@ VkPipeline GraphicsPipelineBuilder::build(const VkDevice& device) {
 
     VkPipeline newPipeline = VK_NULL_HANDLE;
     if (vkCreateGraphicsPipelines(
-	  device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &newPipeline) !=
+	  device, cache, 1, &pipelineInfo, nullptr, &newPipeline) !=
 	VK_SUCCESS) {
 	throw(std::runtime_error("Failed to create graphics pipeline"));
     }
     return newPipeline;
 }
 
+GraphicsPipelineKey GraphicsPipelineBuilder::getKey(
+  std::string vertexShader, std::string fragmentShader) const {
+    return {
+	.vertexShader = std::move(vertexShader),
+	.fragmentShader = std::move(fragmentShader),
+	.layout = _pipelineLayout,
+	.topology = _inputAssembly.topology,
+	.polygonMode = _rasterizer.polygonMode,
+	.cullMode = _rasterizer.cullMode,
+	.frontFace = _rasterizer.frontFace,
+	.samples = _multisampling.rasterizationSamples,
+	.blend = _colorBlendAttachment,
+	.depthTest = _depthStencil.depthTestEnable,
+	.depthWrite = _depthStencil.depthWriteEnable,
+	.depthCompare = _depthStencil.depthCompareOp,
+	.colorFormat = _renderInfo.colorAttachmentCount > 0
+			 ? _colorAttachmentformat
+			 : VK_FORMAT_UNDEFINED,
+	.depthFormat = _renderInfo.depthAttachmentFormat,
+    };
+}
+
+bool GraphicsPipelineKey::operator==(const GraphicsPipelineKey& other) const {
+    // The blend state is plain data without padding
+    return vertexShader == other.vertexShader &&
+	   fragmentShader == other.fragmentShader && layout == other.layout &&
+	   topology == other.topology && polygonMode == other.polygonMode &&
+	   cullMode == other.cullMode && frontFace == other.frontFace &&
+	   samples == other.samples &&
+	   std::memcmp(&blend, &other.blend, sizeof(blend)) == 0 &&
+	   depthTest == other.depthTest && depthWrite == other.depthWrite &&
+	   depthCompare == other.depthCompare &&
+	   colorFormat == other.colorFormat && depthFormat == other.depthFormat;
+}
+
+// Boost's hash_combine
+static void combine(size_t& seed, size_t value) {
+    seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+size_t PipelineKeyHash::operator()(const GraphicsPipelineKey& key) const {
+    size_t seed = std::hash<std::string>{}(key.vertexShader);
+    combine(seed, std::hash<std::string>{}(key.fragmentShader));
+    combine(seed, std::hash<VkPipelineLayout>{}(key.layout));
+    combine(seed, key.topology);
+    combine(seed, key.polygonMode);
+    combine(seed, key.cullMode);
+    combine(seed, key.frontFace);
+    combine(seed, key.samples);
+    combine(seed, key.blend.blendEnable);
+    combine(seed, key.blend.srcColorBlendFactor);
+    combine(seed, key.blend.dstColorBlendFactor);
+    combine(seed, key.blend.colorBlendOp);
+    combine(seed, key.blend.srcAlphaBlendFactor);
+    combine(seed, key.blend.dstAlphaBlendFactor);
+    combine(seed, key.blend.alphaBlendOp);
+    combine(seed, key.blend.colorWriteMask);
+    combine(seed, key.depthTest);
+    combine(seed, key.depthWrite);
+    combine(seed, key.depthCompare);
+    combine(seed, key.colorFormat);
+    combine(seed, key.depthFormat);
+    return seed;
+}
+
+size_t PipelineKeyHash::operator()(const ComputePipelineKey& key) const {
+    size_t seed = std::hash<std::string>{}(key.shader);
+    combine(seed, std::hash<VkPipelineLayout>{}(key.layout));
+    combine(seed, key.workgroup.x);
+    combine(seed, key.workgroup.y);
+    return seed;
+}
+
+VkPipeline createComputePipeline(VkDevice device, VkPipelineCache cache,
+				 VkPipelineLayout layout, VkShaderModule module,
+				 WorkgroupSize workgroup) {
+    VkSpecializationMapEntry entries[] = {
+	{ .constantID = 0,
+	  .offset = offsetof(WorkgroupSize, x),
+	  .size = sizeof(uint32_t) },
+	{ .constantID = 1,
+	  .offset = offsetof(WorkgroupSize, y),
+	  .size = sizeof(uint32_t) },
+    };
+    VkSpecializationInfo specialization = {
+	.mapEntryCount = static_cast<uint32_t>(std::size(entries)),
+	.pMapEntries = entries,
+	.dataSize = sizeof(workgroup),
+	.pData = &workgroup,
+    };
+    VkPipelineShaderStageCreateInfo
+      stageInfo = getPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT,
+						   module);
+    stageInfo.pSpecializationInfo = &specialization;
+
+    VkComputePipelineCreateInfo info = {
+	.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+	.stage = stageInfo,
+	.layout = layout
+    };
+    VkPipeline pipeline;
+    if (vkCreateComputePipelines(device, cache, 1, &info, nullptr, &pipeline) !=
+	VK_SUCCESS) {
+	throw std::runtime_error("Could not create compute pipeline");
+    }
+    return pipeline;
+}
+
 } // namespace vk
 } // namespace baldwin
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
 #include <vector>
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_core.h>
@@ -7,6 +10,56 @@
 namespace baldwin {
 namespace vk {
 
+// Workgroup dimensions of a 2D compute kernel. Shaders declare them with
+// local_size_x_id = 0 and local_size_y_id = 1, so that dispatches are always
+// derived from the size the pipeline was specialized with.
+struct WorkgroupSize {
+    uint32_t x = 16;
+    uint32_t y = 16;
+
+    uint32_t groupsX(uint32_t width) const { return (width + x - 1) / x; }
+    uint32_t groupsY(uint32_t height) const { return (height + y - 1) / y; }
+    bool operator==(const WorkgroupSize&) const = default;
+};
+
+// Canonical state of a graphics pipeline, equal keys build equal pipelines.
+// Shaders are named as in the shader archive.
+struct GraphicsPipelineKey {
+    std::string vertexShader;
+    std::string fragmentShader;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_NONE;
+    VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    VkPipelineColorBlendAttachmentState blend{};
+    VkBool32 depthTest = VK_FALSE;
+    VkBool32 depthWrite = VK_FALSE;
+    VkCompareOp depthCompare = VK_COMPARE_OP_NEVER;
+    VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+
+    bool operator==(const GraphicsPipelineKey& other) const;
+};
+
+struct ComputePipelineKey {
+    std::string shader;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    WorkgroupSize workgroup{};
+
+    bool operator==(const ComputePipelineKey&) const = default;
+};
+
+struct PipelineKeyHash {
+    size_t operator()(const GraphicsPipelineKey& key) const;
+    size_t operator()(const ComputePipelineKey& key) const;
+};
+
+VkPipeline createComputePipeline(VkDevice device, VkPipelineCache cache,
+				 VkPipelineLayout layout, VkShaderModule module,
+				 WorkgroupSize workgroup);
+
 class GraphicsPipelineBuilder {
   public:
     GraphicsPipelineBuilder() { clear(); }
@@ -20,7 +73,12 @@ class GraphicsPipelineBuilder {
     void setColorAttachment(VkFormat format);
     void setDepthFormat(VkFormat format);
     void disableDepthTest();
-    VkPipeline build(const VkDevice& device);
+    void enableDepthTest(bool depthWriteEnable, VkCompareOp op);
+    VkPipeline build(const VkDevice& device,
+		     VkPipelineCache cache = VK_NULL_HANDLE);
+    // Everything build uses, with the shaders it will be given
+    GraphicsPipelineKey getKey(std::string vertexShader,
+			       std::string fragmentShader) const;
 
     VkPipelineLayout _pipelineLayout;
 
@@ -0,0 +1,176 @@
+#include "vk_profiler.hpp"
+
+#include <algorithm>
+#include <array>
+#include "graphics_macros.hpp"
+
+namespace baldwin {
+namespace vk {
+
+// Query 0 and 1 bracket the graphics command buffer, 2 and 3 the compute
+// one, scope i uses 4 + 2i and 5 + 2i
+static constexpr uint32_t FIRST_SCOPE_QUERY = 4;
+static constexpr uint32_t TIMESTAMP_COUNT = FIRST_SCOPE_QUERY +
+					    2 * GpuProfiler::MAX_SCOPES;
+static constexpr uint32_t STATISTICS_COUNT = 3;
+
+void GpuProfiler::init(VkDevice device, bool pipelineStatistics) {
+    VkQueryPoolCreateInfo timestampInfo = {
+	.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+	.queryType = VK_QUERY_TYPE_TIMESTAMP,
+	.queryCount = TIMESTAMP_COUNT,
+    };
+    VK_CHECK(
+      vkCreateQueryPool(device, &timestampInfo, nullptr, &timestampPool),
+      "Could not create timestamp query pool");
+
+    if (!pipelineStatistics)
+	return;
+
+    // Results come back in bit order : vertex, fragment, compute
+    VkQueryPoolCreateInfo statisticsInfo = {
+	.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+	.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+	.queryCount = MAX_SCOPES,
+	.pipelineStatistics =
+	  VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+	  VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+	  VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT,
+    };
+    VK_CHECK(
+      vkCreateQueryPool(device, &statisticsInfo, nullptr, &statisticsPool),
+      "Could not create pipeline statistics query pool");
+}
+
+void GpuProfiler::destroy(VkDevice device) {
+    vkDestroyQueryPool(device, timestampPool, nullptr);
+    vkDestroyQueryPool(device, statisticsPool, nullptr);
+}
+
+void GpuProfiler::beginFrame(VkDevice device, VkCommandBuffer cmd,
+			     VkCommandBuffer computeCmd) {
+    scopeNames.clear();
+    scopeStatistics.clear();
+    // On the host, a reset recorded on one queue would race the queries
+    // the other one writes
+    vkResetQueryPool(device, timestampPool, 0, TIMESTAMP_COUNT);
+    if (statisticsPool != VK_NULL_HANDLE)
+	vkResetQueryPool(device, statisticsPool, 0, MAX_SCOPES);
+    written = false;
+    computeWritten = false;
+
+    vkCmdWriteTimestamp2(
+      cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, timestampPool, 0);
+    if (computeCmd != VK_NULL_HANDLE) {
+	vkCmdWriteTimestamp2(
+	  computeCmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, timestampPool, 2);
+    }
+}
+
+void GpuProfiler::endFrame(VkCommandBuffer cmd, VkCommandBuffer computeCmd) {
+    vkCmdWriteTimestamp2(
+      cmd, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, timestampPool, 1);
+    if (computeCmd != VK_NULL_HANDLE) {
+	vkCmdWriteTimestamp2(
+	  computeCmd, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, timestampPool, 3);
+	computeWritten = true;
+    }
+    written = true;
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer cmd, const char* name,
+				 bool graphicsQueue) {
+    uint32_t scope = static_cast<uint32_t>(scopeNames.size());
+    if (scope >= MAX_SCOPES)
+	return MAX_SCOPES;
+
+    scopeNames.push_back(name);
+    scopeStatistics.push_back(statisticsPool != VK_NULL_HANDLE &&
+			      graphicsQueue);
+    vkCmdWriteTimestamp2(cmd,
+			 VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT,
+			 timestampPool,
+			 FIRST_SCOPE_QUERY + 2 * scope);
+    if (scopeStatistics[scope])
+	vkCmdBeginQuery(cmd, statisticsPool, scope, 0);
+
+    return scope;
+}
+
+void GpuProfiler::endScope(VkCommandBuffer cmd, uint32_t scope) {
+    if (scope >= MAX_SCOPES)
+	return;
+
+    if (scopeStatistics[scope])
+	vkCmdEndQuery(cmd, statisticsPool, scope);
+    vkCmdWriteTimestamp2(cmd,
+			 VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT,
+			 timestampPool,
+			 FIRST_SCOPE_QUERY + 2 * scope + 1);
+}
+
+bool GpuProfiler::resolve(VkDevice device, float timestampPeriod,
+			  double& frameMs, double& computeMs,
+			  std::vector<ProfilerScopeResult>& scopes) {
+    scopes.clear();
+    if (!written)
+	return false;
+
+    // The compute bracket is only available when it was written, so ranges
+    // are read separately
+    uint32_t scopeCount = static_cast<uint32_t>(scopeNames.size());
+    std::array<uint64_t, TIMESTAMP_COUNT> timestamps{};
+    auto read = [&](uint32_t first, uint32_t count) {
+	return count == 0 ||
+	       vkGetQueryPoolResults(device,
+				     timestampPool,
+				     first,
+				     count,
+				     count * sizeof(uint64_t),
+				     &timestamps[first],
+				     sizeof(uint64_t),
+				     VK_QUERY_RESULT_64_BIT) == VK_SUCCESS;
+    };
+    if (!read(0, 2) || (computeWritten && !read(2, 2)) ||
+	!read(FIRST_SCOPE_QUERY, 2 * scopeCount)) {
+	return false;
+    }
+
+    // Queries that were never begun are not available, so scopes are read
+    // one by one
+    std::array<uint64_t, STATISTICS_COUNT * MAX_SCOPES> statistics{};
+    for (uint32_t i = 0; i < scopeCount; i++) {
+	if (scopeStatistics[i] &&
+	    vkGetQueryPoolResults(device,
+				  statisticsPool,
+				  i,
+				  1,
+				  STATISTICS_COUNT * sizeof(uint64_t),
+				  &statistics[STATISTICS_COUNT * i],
+				  STATISTICS_COUNT * sizeof(uint64_t),
+				  VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+	    std::fill_n(&statistics[STATISTICS_COUNT * i], STATISTICS_COUNT, 0);
+	}
+    }
+
+    auto toMs = [timestampPeriod](uint64_t begin, uint64_t end) {
+	return static_cast<double>(end - begin) * timestampPeriod / 1000000.0;
+    };
+
+    frameMs = toMs(timestamps[0], timestamps[1]);
+    computeMs = computeWritten ? toMs(timestamps[2], timestamps[3]) : 0.0;
+    for (uint32_t i = 0; i < scopeCount; i++) {
+	uint32_t query = FIRST_SCOPE_QUERY + 2 * i;
+	scopes.push_back(ProfilerScopeResult{
+	  .name = scopeNames[i].c_str(),
+	  .gpuMs = toMs(timestamps[query], timestamps[query + 1]),
+	  .vertexInvocations = statistics[STATISTICS_COUNT * i],
+	  .fragmentInvocations = statistics[STATISTICS_COUNT * i + 1],
+	  .computeInvocations = statistics[STATISTICS_COUNT * i + 2] });
+    }
+
+    return true;
+}
+
+} // namespace vk
+} // namespace baldwin
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace baldwin {
+namespace vk {
+
+struct ProfilerScopeResult {
+    // Owned by the profiler, valid until its next beginFrame
+    const char* name;
+    double gpuMs;
+    uint64_t vertexInvocations;
+    uint64_t fragmentInvocations;
+    uint64_t computeInvocations;
+};
+
+// Timestamp and pipeline statistics queries of one frame in flight. Every
+// FrameData owns one, and results are read back only after that frame's fence
+// has signalled, so resolving never stalls.
+struct GpuProfiler {
+    static constexpr uint32_t MAX_SCOPES = 32;
+
+    VkQueryPool timestampPool = VK_NULL_HANDLE;
+    VkQueryPool statisticsPool = VK_NULL_HANDLE;
+    // Copied, the render graph may be rebuilt before the frame is resolved
+    std::vector<std::string> scopeNames;
+    // Scopes recorded on a compute only queue have no statistics, the pool
+    // also counts graphics invocations
+    std::vector<bool> scopeStatistics;
+    bool written = false;
+    // Whether the frame also had a compute queue command buffer
+    bool computeWritten = false;
+
+    void init(VkDevice device, bool pipelineStatistics);
+    void destroy(VkDevice device);
+
+    // Scopes can not be nested and must be opened and closed outside of
+    // rendering. Pools are reset from the host, so beginFrame must only be
+    // called once the frame's previous submissions have completed. Each
+    // queue brackets its own command buffer, since timestamps of different
+    // queues can not be compared.
+    void beginFrame(VkDevice device, VkCommandBuffer cmd,
+		    VkCommandBuffer computeCmd = VK_NULL_HANDLE);
+    void endFrame(VkCommandBuffer cmd,
+		  VkCommandBuffer computeCmd = VK_NULL_HANDLE);
+    uint32_t beginScope(VkCommandBuffer cmd, const char* name,
+			bool graphicsQueue = true);
+    void endScope(VkCommandBuffer cmd, uint32_t scope);
+
+    // frameMs spans the graphics queue's command buffer, computeMs the
+    // compute queue's, 0 without one
+    bool resolve(VkDevice device, float timestampPeriod, double& frameMs,
+		 double& computeMs, std::vector<ProfilerScopeResult>& scopes);
+};
+
+} // namespace vk
+} // namespace baldwin
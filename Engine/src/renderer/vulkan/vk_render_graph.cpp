@@ -0,0 +1,604 @@
+#include "vk_render_graph.hpp"
+
+#include <algorithm>
+#include <utility>
+#include "graphics_macros.hpp"
+#include "vk_images.hpp"
+#include "vk_infos.hpp"
+#include "vk_profiler.hpp"
+
+namespace baldwin {
+namespace vk {
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read(RGResource image,
+							 ImageUsage usage) {
+    _graph._passes[_pass].accesses.push_back(Access{ .resource = image,
+						     .write = false,
+						     .discard = false,
+						     .imageUsage = usage });
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::write(RGResource image,
+							  ImageUsage usage,
+							  bool discard) {
+    _graph._passes[_pass].accesses.push_back(Access{ .resource = image,
+						     .write = true,
+						     .discard = discard,
+						     .imageUsage = usage });
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::readBuffer(
+  RGResource buffer, BufferUsage usage) {
+    _graph._passes[_pass].accesses.push_back(Access{ .resource = buffer,
+						     .write = false,
+						     .discard = false,
+						     .bufferUsage = usage });
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::writeBuffer(
+  RGResource buffer, BufferUsage usage) {
+    _graph._passes[_pass].accesses.push_back(Access{ .resource = buffer,
+						     .write = true,
+						     .discard = false,
+						     .bufferUsage = usage });
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::sideEffects() {
+    _graph._passes[_pass].sideEffects = true;
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::asyncCompute() {
+    _graph._passes[_pass].asyncCompute = true;
+    return *this;
+}
+
+void RenderGraph::PassBuilder::execute(ExecuteFn&& fn) {
+    _graph._passes[_pass].execute = std::move(fn);
+}
+
+void RenderGraph::init(VkDevice device, VmaAllocator allocator) {
+    _device = device;
+    _allocator = allocator;
+}
+
+void RenderGraph::setQueueFamilies(uint32_t graphicsFamily,
+				   uint32_t computeFamily) {
+    _graphicsFamily = graphicsFamily;
+    _computeFamily = computeFamily;
+}
+
+void RenderGraph::clear(DeletionQueue* retireQueue, uint64_t retireValue) {
+    destroyTransients(retireQueue, retireValue);
+    _passes.clear();
+    _resources.clear();
+    _order.clear();
+    _levelStarts.clear();
+}
+
+void RenderGraph::destroy() { clear(); }
+
+RGResource RenderGraph::importImage(const char* name, VkImage image,
+				    VkImageView view, ImageState* state,
+				    VkImageAspectFlags aspect) {
+    _resources.push_back(Resource{ .name = name,
+				   .imported = true,
+				   .image = image,
+				   .view = view,
+				   .aspect = aspect,
+				   .imageState = state });
+    return static_cast<RGResource>(_resources.size() - 1);
+}
+
+RGResource RenderGraph::importBuffer(const char* name, VkBuffer buffer,
+				     BufferState* state) {
+    _resources.push_back(Resource{ .name = name,
+				   .isBuffer = true,
+				   .imported = true,
+				   .buffer = buffer,
+				   .bufferState = state });
+    return static_cast<RGResource>(_resources.size() - 1);
+}
+
+RGResource RenderGraph::createImage(const char* name,
+				    const RGImageDesc& desc) {
+    _resources.push_back(
+      Resource{ .name = name, .aspect = desc.aspect, .desc = desc });
+    return static_cast<RGResource>(_resources.size() - 1);
+}
+
+void RenderGraph::setImportedImage(RGResource resource, VkImage image,
+				   VkImageView view, ImageState* state) {
+    Resource& res = _resources[resource];
+    res.image = image;
+    res.view = view;
+    res.imageState = state;
+}
+
+void RenderGraph::markOutput(RGResource resource, ImageUsage finalUsage) {
+    _resources[resource].output = true;
+    _resources[resource].finalUsage = finalUsage;
+}
+
+RenderGraph::PassBuilder RenderGraph::addPass(const char* name) {
+    _passes.push_back(Pass{ .name = name });
+    return PassBuilder(*this, static_cast<uint32_t>(_passes.size() - 1));
+}
+
+VkImage RenderGraph::getImage(RGResource resource) const {
+    return _resources[resource].image;
+}
+
+VkImageView RenderGraph::getImageView(RGResource resource) const {
+    return _resources[resource].view;
+}
+
+VkBuffer RenderGraph::getBuffer(RGResource resource) const {
+    return _resources[resource].buffer;
+}
+
+void RenderGraph::compile() {
+    destroyTransients();
+    cullPasses();
+    sortPasses();
+    assignQueues();
+    allocateTransients();
+}
+
+void RenderGraph::cullPasses() {
+    // Walk back from the outputs, a pass is needed when a later needed pass
+    // consumes one of its writes
+    std::vector<bool> needed(_resources.size());
+    for (size_t i = 0; i < _resources.size(); i++) {
+	needed[i] = _resources[i].output;
+    }
+
+    _culledPassCount = 0;
+    for (auto it = _passes.rbegin(); it != _passes.rend(); it++) {
+	Pass& pass = *it;
+	bool contributes = pass.sideEffects;
+	for (const Access& access : pass.accesses) {
+	    if (access.write && needed[access.resource])
+		contributes = true;
+	}
+	pass.culled = !contributes;
+	if (pass.culled) {
+	    _culledPassCount++;
+	    continue;
+	}
+
+	// A full overwrite hides whatever was written before it
+	for (const Access& access : pass.accesses) {
+	    if (access.write && access.discard)
+		needed[access.resource] = false;
+	}
+	for (const Access& access : pass.accesses) {
+	    if (!access.write || !access.discard)
+		needed[access.resource] = true;
+	}
+    }
+}
+
+void RenderGraph::sortPasses() {
+    struct Reader {
+	uint32_t pass;
+	ImageUsage usage;
+    };
+    std::vector<int32_t> lastWriter(_resources.size(), -1);
+    std::vector<std::vector<Reader>> readers(_resources.size());
+
+    // A pass sits one level after the deepest pass it depends on. Passes of
+    // the same level are independent, so their barriers go in one batch.
+    uint32_t levelCount = 0;
+    for (uint32_t p = 0; p < _passes.size(); p++) {
+	Pass& pass = _passes[p];
+	if (pass.culled)
+	    continue;
+
+	pass.level = 0;
+	for (const Access& access : pass.accesses) {
+	    const Resource& res = _resources[access.resource];
+	    if (lastWriter[access.resource] >= 0) {
+		pass.level = std::max(
+		  pass.level, _passes[lastWriter[access.resource]].level + 1);
+	    }
+
+	    // Writers wait for every reader, readers only for those needing
+	    // the image in another layout
+	    for (const Reader& reader : readers[access.resource]) {
+		bool layoutConflict =
+		  !res.isBuffer &&
+		  getImageUsageState(reader.usage).layout !=
+		    getImageUsageState(access.imageUsage).layout;
+		if (access.write || layoutConflict) {
+		    pass.level = std::max(pass.level,
+					  _passes[reader.pass].level + 1);
+		}
+	    }
+	}
+
+	for (const Access& access : pass.accesses) {
+	    if (access.write) {
+		lastWriter[access.resource] = static_cast<int32_t>(p);
+		readers[access.resource].clear();
+	    } else {
+		readers[access.resource].push_back(
+		  Reader{ .pass = p, .usage = access.imageUsage });
+	    }
+	}
+	levelCount = std::max(levelCount, pass.level + 1);
+    }
+
+    _order.clear();
+    for (uint32_t p = 0; p < _passes.size(); p++) {
+	if (!_passes[p].culled)
+	    _order.push_back(p);
+    }
+    std::stable_sort(
+      _order.begin(), _order.end(), [this](uint32_t a, uint32_t b) {
+	  return _passes[a].level < _passes[b].level;
+      });
+
+    _levelStarts.assign(levelCount, 0);
+    for (uint32_t pos = static_cast<uint32_t>(_order.size()); pos-- > 0;) {
+	_levelStarts[_passes[_order[pos]].level] = pos;
+    }
+}
+
+void RenderGraph::assignQueues() {
+    // Compute work is submitted first, so a pass can only move to the compute
+    // queue if no graphics pass of the frame touched its resources before
+    bool separate = _computeFamily != _graphicsFamily;
+    std::vector<bool> usedOnGraphics(_resources.size());
+    std::vector<bool> used(_resources.size());
+    _asyncPassCount = 0;
+    _graphicsFallbackCount = 0;
+    _computeWaitStages = VK_PIPELINE_STAGE_2_NONE;
+    for (Resource& res : _resources) {
+	res.computeOwned = false;
+	res.handoff = false;
+    }
+
+    for (uint32_t p : _order) {
+	Pass& pass = _passes[p];
+	pass.onCompute = separate && pass.asyncCompute;
+	for (const Access& access : pass.accesses) {
+	    const Resource& res = _resources[access.resource];
+	    // Transients are always discarded on their first use
+	    bool preserved = !res.isBuffer && res.imported && !access.discard;
+	    if (usedOnGraphics[access.resource] ||
+		(!used[access.resource] && preserved)) {
+		pass.onCompute = false;
+	    }
+	}
+	if (pass.asyncCompute && separate && !pass.onCompute)
+	    _graphicsFallbackCount++;
+
+	for (const Access& access : pass.accesses) {
+	    Resource& res = _resources[access.resource];
+	    used[access.resource] = true;
+	    if (pass.onCompute) {
+		res.computeOwned = !res.isBuffer;
+		continue;
+	    }
+	    if (res.computeOwned && !usedOnGraphics[access.resource]) {
+		res.handoff = true;
+		res.handoffUsage = access.imageUsage;
+		ImageState next = getImageUsageState(access.imageUsage);
+		_computeWaitStages |= next.stage;
+	    }
+	    usedOnGraphics[access.resource] = true;
+	}
+	if (pass.onCompute)
+	    _asyncPassCount++;
+    }
+}
+
+void RenderGraph::allocateTransients() {
+    // Lifetimes are counted in levels since barriers are batched per level
+    std::vector<RGResource> transients;
+    for (uint32_t p : _order) {
+	Pass& pass = _passes[p];
+	for (Access& access : pass.accesses) {
+	    Resource& res = _resources[access.resource];
+	    if (res.imported || res.isBuffer)
+		continue;
+
+	    if (res.firstUse == UINT32_MAX) {
+		// Nothing survives from previous frames or from aliases
+		access.discard = true;
+		res.firstUse = pass.level;
+		transients.push_back(access.resource);
+	    }
+	    res.lastUse = std::max(res.lastUse, pass.level);
+	}
+    }
+
+    // Outputs are still used once the last pass is done. Levels do not order
+    // both queues, so images the compute queue writes never alias.
+    for (RGResource r : transients) {
+	Resource& res = _resources[r];
+	if (res.computeOwned)
+	    res.firstUse = 0;
+	if (res.output || res.computeOwned)
+	    res.lastUse = static_cast<uint32_t>(_levelStarts.size());
+    }
+
+    _unaliasedSize = 0;
+    _transientSize = 0;
+    if (transients.empty())
+	return;
+
+    uint32_t memoryTypeBits = UINT32_MAX;
+    VkDeviceSize alignment = 1;
+    for (RGResource r : transients) {
+	Resource& res = _resources[r];
+	VkImageCreateInfo imgInfo = getImageCreateInfo(
+	  res.desc.format,
+	  res.desc.usage,
+	  { res.desc.extent.width, res.desc.extent.height, 1 });
+	VK_CHECK(vkCreateImage(_device, &imgInfo, nullptr, &res.image),
+		 "Could not create transient image");
+	vkGetImageMemoryRequirements(_device, res.image, &res.requirements);
+
+	memoryTypeBits &= res.requirements.memoryTypeBits;
+	alignment = std::max(alignment, res.requirements.alignment);
+	_unaliasedSize += res.requirements.size;
+    }
+
+    VmaAllocationCreateInfo allocInfo = {
+	.usage = VMA_MEMORY_USAGE_GPU_ONLY,
+	.requiredFlags = VkMemoryPropertyFlags(
+	  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+    };
+
+    if (memoryTypeBits == 0) {
+	// No memory type suits every transient, give up on aliasing
+	for (RGResource r : transients) {
+	    Resource& res = _resources[r];
+	    VK_CHECK(vmaAllocateMemory(_allocator,
+				       &res.requirements,
+				       &allocInfo,
+				       &res.allocation,
+				       nullptr),
+		     "Could not allocate transient image memory");
+	    VK_CHECK(vmaBindImageMemory2(
+		       _allocator, res.allocation, 0, res.image, nullptr),
+		     "Could not bind transient image memory");
+	}
+	_transientSize = _unaliasedSize;
+    } else {
+	// Biggest images first, each at the lowest offset that no image alive
+	// during an overlapping range of levels occupies
+	std::sort(transients.begin(),
+		  transients.end(),
+		  [this](RGResource a, RGResource b) {
+		      return _resources[a].requirements.size >
+			     _resources[b].requirements.size;
+		  });
+
+	std::vector<RGResource> placed;
+	for (RGResource r : transients) {
+	    Resource& res = _resources[r];
+	    VkDeviceSize size = res.requirements.size;
+
+	    std::vector<std::pair<VkDeviceSize, VkDeviceSize>> busy;
+	    for (RGResource o : placed) {
+		const Resource& other = _resources[o];
+		if (res.firstUse <= other.lastUse &&
+		    other.firstUse <= res.lastUse) {
+		    busy.push_back(
+		      { other.offset, other.offset + other.requirements.size });
+		}
+	    }
+	    std::sort(busy.begin(), busy.end());
+
+	    VkDeviceSize offset = 0;
+	    for (const auto& [begin, end] : busy) {
+		if (offset + size <= begin)
+		    break;
+		VkDeviceSize align = res.requirements.alignment;
+		offset = std::max(offset, (end + align - 1) / align * align);
+	    }
+	    res.offset = offset;
+	    _transientSize = std::max(_transientSize, offset + size);
+
+	    for (RGResource o : placed) {
+		Resource& other = _resources[o];
+		if (offset < other.offset + other.requirements.size &&
+		    other.offset < offset + size) {
+		    res.aliases.push_back(o);
+		    other.aliases.push_back(r);
+		}
+	    }
+	    placed.push_back(r);
+	}
+
+	VkMemoryRequirements requirements = {
+	    .size = _transientSize,
+	    .alignment = alignment,
+	    .memoryTypeBits = memoryTypeBits
+	};
+	VK_CHECK(vmaAllocateMemory(_allocator,
+				   &requirements,
+				   &allocInfo,
+				   &_transientMemory,
+				   nullptr),
+		 "Could not allocate transient memory");
+	for (RGResource r : transients) {
+	    Resource& res = _resources[r];
+	    VK_CHECK(vmaBindImageMemory2(_allocator,
+					 _transientMemory,
+					 res.offset,
+					 res.image,
+					 nullptr),
+		     "Could not bind transient image memory");
+	}
+    }
+
+    for (RGResource r : transients) {
+	Resource& res = _resources[r];
+	VkImageViewCreateInfo viewInfo = getImageViewCreateInfo(
+	  res.desc.format, res.image, res.desc.aspect);
+	VK_CHECK(vkCreateImageView(_device, &viewInfo, nullptr, &res.view),
+		 "Could not create transient image view");
+    }
+}
+
+void RenderGraph::destroyTransients(DeletionQueue* retireQueue,
+				    uint64_t retireValue) {
+    for (Resource& res : _resources) {
+	if (res.imported || res.isBuffer)
+	    continue;
+
+	if (retireQueue) {
+	    // Flushed most recent first, so the view goes first
+	    retireQueue->push(res.image, res.allocation, retireValue);
+	    retireQueue->push(res.view, retireValue);
+	} else {
+	    vkDestroyImageView(_device, res.view, nullptr);
+	    vkDestroyImage(_device, res.image, nullptr);
+	    if (res.allocation != VK_NULL_HANDLE)
+		vmaFreeMemory(_allocator, res.allocation);
+	}
+	res.view = VK_NULL_HANDLE;
+	res.image = VK_NULL_HANDLE;
+	res.allocation = VK_NULL_HANDLE;
+	res.ownState = {};
+	res.firstUse = UINT32_MAX;
+	res.lastUse = 0;
+	res.aliases.clear();
+    }
+
+    if (_transientMemory != VK_NULL_HANDLE) {
+	if (retireQueue)
+	    retireQueue->push(_transientMemory, retireValue);
+	else
+	    vmaFreeMemory(_allocator, _transientMemory);
+	_transientMemory = VK_NULL_HANDLE;
+    }
+}
+
+void RenderGraph::handOff(Resource& res, VkCommandBuffer computeCmd,
+			  VkCommandBuffer cmd) {
+    // The release on the compute queue and the acquire on the graphics one
+    // must describe the same transition. The semaphore between both
+    // submissions orders them.
+    ImageState& state = imageState(res);
+    ImageState next = getImageUsageState(res.handoffUsage);
+    VkImageMemoryBarrier2 barrier = {
+	.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+	.srcStageMask = state.stage,
+	.srcAccessMask = state.access,
+	.dstStageMask = VK_PIPELINE_STAGE_2_NONE,
+	.dstAccessMask = VK_ACCESS_2_NONE,
+	.oldLayout = state.layout,
+	.newLayout = next.layout,
+	.srcQueueFamilyIndex = _computeFamily,
+	.dstQueueFamilyIndex = _graphicsFamily,
+	.image = res.image,
+	.subresourceRange = getImageSubresourceRange(res.aspect),
+    };
+    VkDependencyInfo depInfo = {
+	.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+	.imageMemoryBarrierCount = 1,
+	.pImageMemoryBarriers = &barrier,
+    };
+    vkCmdPipelineBarrier2(computeCmd, &depInfo);
+
+    barrier.srcStageMask = next.stage;
+    barrier.srcAccessMask = VK_ACCESS_2_NONE;
+    barrier.dstStageMask = next.stage;
+    barrier.dstAccessMask = next.access;
+    vkCmdPipelineBarrier2(cmd, &depInfo);
+
+    // Other reads on this queue chain after the acquire, which made the
+    // compute writes available
+    state = next;
+    state.writeStage = next.stage;
+}
+
+void RenderGraph::execute(VkCommandBuffer cmd, GpuProfiler* profiler,
+			  VkCommandBuffer computeCmd) {
+    BarrierBatch barriers;
+    BarrierBatch computeBarriers;
+    std::vector<bool> handedOff(_resources.size());
+    for (uint32_t level = 0; level < _levelStarts.size(); level++) {
+	uint32_t begin = _levelStarts[level];
+	uint32_t end = level + 1 < _levelStarts.size()
+			 ? _levelStarts[level + 1]
+			 : static_cast<uint32_t>(_order.size());
+
+	for (uint32_t pos = begin; pos < end; pos++) {
+	    const Pass& pass = _passes[_order[pos]];
+	    VkCommandBuffer passCmd = pass.onCompute ? computeCmd : cmd;
+	    BarrierBatch& batch = pass.onCompute ? computeBarriers : barriers;
+	    for (const Access& access : pass.accesses) {
+		Resource& res = _resources[access.resource];
+		if (res.isBuffer) {
+		    batch.transition(passCmd,
+				     res.buffer,
+				     *res.bufferState,
+				     access.bufferUsage);
+		    continue;
+		}
+		if (!pass.onCompute && res.handoff &&
+		    !handedOff[access.resource]) {
+		    computeBarriers.flush(computeCmd);
+		    handOff(res, computeCmd, cmd);
+		    handedOff[access.resource] = true;
+		}
+
+		// A transient starts its lifetime once every image sharing
+		// its memory is done with it
+		if (!res.imported && access.discard) {
+		    for (RGResource alias : res.aliases) {
+			res.ownState.stage |= _resources[alias].ownState.stage;
+			res.ownState.access |=
+			  _resources[alias].ownState.access;
+		    }
+		}
+		batch.transition(passCmd,
+				 res.image,
+				 imageState(res),
+				 access.imageUsage,
+				 access.discard,
+				 res.aspect);
+	    }
+	}
+	barriers.flush(cmd);
+	computeBarriers.flush(computeCmd);
+
+	for (uint32_t pos = begin; pos < end; pos++) {
+	    Pass& pass = _passes[_order[pos]];
+	    VkCommandBuffer passCmd = pass.onCompute ? computeCmd : cmd;
+	    uint32_t scope = profiler ? profiler->beginScope(passCmd,
+							     pass.name.c_str(),
+							     !pass.onCompute)
+				      : 0;
+	    pass.execute(passCmd);
+	    if (profiler)
+		profiler->endScope(passCmd, scope);
+	}
+    }
+
+    // Leave outputs the way their consumers expect them
+    for (Resource& res : _resources) {
+	if (res.output && !res.isBuffer) {
+	    barriers.transition(cmd,
+				res.image,
+				imageState(res),
+				res.finalUsage,
+				false,
+				res.aspect);
+	}
+    }
+    barriers.flush(cmd);
+}
+
+} // namespace vk
+} // namespace baldwin
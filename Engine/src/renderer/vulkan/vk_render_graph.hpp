@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+#include "renderer/vulkan/vk_barriers.hpp"
+#include "renderer/vulkan/vk_deletion_queue.hpp"
+
+namespace baldwin {
+namespace vk {
+
+struct GpuProfiler;
+
+using RGResource = uint32_t;
+
+struct RGImageDesc {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent = { 0, 0 };
+    VkImageUsageFlags usage = 0;
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+};
+
+// Frame description in which passes declare the images and buffers they read
+// and write. Compiling culls the passes that do not contribute to an output,
+// sorts the others in dependency levels and places transient images whose
+// lifetimes do not overlap in the same memory. Barriers are derived from the
+// declared uses while executing, one batch per level.
+//
+// The graph is built and compiled once, then executed every frame. Imported
+// resources can be swapped between executions, e.g. the swapchain image.
+//
+// Passes flagged as async compute are recorded in a separate command buffer
+// for a compute queue family, submitted before the graphics one. Images they
+// write are handed to the graphics family with ownership transfers at their
+// first graphics use.
+class RenderGraph {
+  public:
+    using ExecuteFn = std::function<void(VkCommandBuffer cmd)>;
+
+    class PassBuilder {
+      public:
+	PassBuilder(RenderGraph& graph, uint32_t pass)
+	  : _graph(graph)
+	  , _pass(pass) {}
+
+	PassBuilder& read(RGResource image, ImageUsage usage);
+	// Discarding states the pass overwrites the whole image
+	PassBuilder& write(RGResource image, ImageUsage usage,
+			   bool discard = false);
+	PassBuilder& readBuffer(RGResource buffer, BufferUsage usage);
+	PassBuilder& writeBuffer(RGResource buffer, BufferUsage usage);
+	// Keeps the pass even if nothing consumes its writes
+	PassBuilder& sideEffects();
+	// Runs the pass on the compute queue when there is a separate one. It
+	// stays on the graphics queue if it depends on graphics work of the
+	// same frame, or if an image it touches first is not overwritten whole,
+	// since ownership only ever moves from compute to graphics. Buffers it
+	// uses must be shared concurrently between both families.
+	PassBuilder& asyncCompute();
+	void execute(ExecuteFn&& fn);
+
+      private:
+	RenderGraph& _graph;
+	uint32_t _pass;
+    };
+
+    void init(VkDevice device, VmaAllocator allocator);
+    // Must be called before compiling, async passes only leave the graphics
+    // queue when both families differ
+    void setQueueFamilies(uint32_t graphicsFamily, uint32_t computeFamily);
+    // Transient resources must no longer be in use by the GPU, unless a
+    // queue is given to retire them once retireValue completes
+    void clear(DeletionQueue* retireQueue = nullptr, uint64_t retireValue = 0);
+    void destroy();
+
+    RGResource importImage(
+      const char* name, VkImage image, VkImageView view, ImageState* state,
+      VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT);
+    RGResource importBuffer(const char* name, VkBuffer buffer,
+			    BufferState* state);
+    RGResource createImage(const char* name, const RGImageDesc& desc);
+    void setImportedImage(RGResource resource, VkImage image, VkImageView view,
+			  ImageState* state);
+    // Outputs are left in finalUsage once the graph has executed
+    void markOutput(RGResource resource, ImageUsage finalUsage);
+    PassBuilder addPass(const char* name);
+
+    void compile();
+    // computeCmd is only recorded into when usesAsyncCompute()
+    void execute(VkCommandBuffer cmd, GpuProfiler* profiler,
+		 VkCommandBuffer computeCmd = VK_NULL_HANDLE);
+
+    VkImage getImage(RGResource resource) const;
+    VkImageView getImageView(RGResource resource) const;
+    VkBuffer getBuffer(RGResource resource) const;
+
+    uint32_t passCount() const { return static_cast<uint32_t>(_passes.size()); }
+    uint32_t culledPassCount() const { return _culledPassCount; }
+    bool usesAsyncCompute() const { return _asyncPassCount > 0; }
+    uint32_t asyncPassCount() const { return _asyncPassCount; }
+    // Async passes their resources kept on the graphics queue, see
+    // assignQueues
+    uint32_t graphicsFallbackCount() const { return _graphicsFallbackCount; }
+    // Stages of the graphics submission that must wait for the compute one
+    VkPipelineStageFlags2 computeWaitStages() const {
+	return _computeWaitStages;
+    }
+    VkDeviceSize transientMemorySize() const { return _transientSize; }
+    // What the transient images would take without aliasing
+    VkDeviceSize unaliasedMemorySize() const { return _unaliasedSize; }
+
+  private:
+    struct Access {
+	RGResource resource;
+	bool write;
+	bool discard;
+	ImageUsage imageUsage;
+	BufferUsage bufferUsage;
+    };
+
+    struct Pass {
+	std::string name;
+	std::vector<Access> accesses;
+	ExecuteFn execute;
+	bool sideEffects = false;
+	bool asyncCompute = false;
+	bool onCompute = false;
+	bool culled = false;
+	uint32_t level = 0;
+    };
+
+    struct Resource {
+	std::string name;
+	bool isBuffer = false;
+	bool imported = false;
+	bool output = false;
+	ImageUsage finalUsage = ImageUsage::TransferSrc;
+
+	VkImage image = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+	VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+	ImageState* imageState = nullptr;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	BufferState* bufferState = nullptr;
+
+	// Transient images only
+	RGImageDesc desc{};
+	ImageState ownState{};
+	VkMemoryRequirements requirements{};
+	VkDeviceSize offset = 0;
+	VmaAllocation allocation = VK_NULL_HANDLE;
+	uint32_t firstUse = UINT32_MAX;
+	uint32_t lastUse = 0;
+	// Transients sharing part of this one's memory
+	std::vector<RGResource> aliases;
+
+	// Written on the compute queue, then acquired by the graphics queue
+	// for handoffUsage
+	bool computeOwned = false;
+	bool handoff = false;
+	ImageUsage handoffUsage = ImageUsage::TransferSrc;
+    };
+
+    ImageState& imageState(Resource& resource) {
+	return resource.imported ? *resource.imageState : resource.ownState;
+    }
+    void cullPasses();
+    void sortPasses();
+    void assignQueues();
+    void allocateTransients();
+    void handOff(Resource& res, VkCommandBuffer computeCmd,
+		 VkCommandBuffer cmd);
+    void destroyTransients(DeletionQueue* retireQueue = nullptr,
+			   uint64_t retireValue = 0);
+
+    VkDevice _device = VK_NULL_HANDLE;
+    VmaAllocator _allocator = VK_NULL_HANDLE;
+    uint32_t _graphicsFamily = 0;
+    uint32_t _computeFamily = 0;
+    std::vector<Pass> _passes;
+    std::vector<Resource> _resources;
+    // Kept passes in execution order, and where each level starts in it
+    std::vector<uint32_t> _order;
+    std::vector<uint32_t> _levelStarts;
+    VmaAllocation _transientMemory = VK_NULL_HANDLE;
+    uint32_t _culledPassCount = 0;
+    uint32_t _asyncPassCount = 0;
+    uint32_t _graphicsFallbackCount = 0;
+    VkPipelineStageFlags2 _computeWaitStages = VK_PIPELINE_STAGE_2_NONE;
+    VkDeviceSize _transientSize = 0;
+    VkDeviceSize _unaliasedSize = 0;
+};
+
+} // namespace vk
+} // namespace baldwin
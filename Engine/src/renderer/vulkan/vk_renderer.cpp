@@ -3,9 +3,13 @@
 #define GLFW_INCLUDE_VULKAN
 #include "vk_renderer.hpp"
 
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
 #include <cmath>
 #include <iostream>
 #include <cstdint>
+#include <utility>
 #include <vulkan/vulkan_core.h>
 #include <VkBootstrap.h>
 #include <backends/imgui_impl_glfw.h>
@@ -15,23 +19,159 @@
 #include "vk_images.hpp"
 #include "vk_infos.hpp"
 #include "renderer/vulkan/vk_shaders.hpp"
+#include "scene/cooked_scene.hpp"
+#include "scene/gltf_loader.hpp"
+#include "scene/instanced_scene.hpp"
 
 namespace baldwin {
 namespace vk {
 
+// Stage at which submissions wait for the acquired swapchain image
+static constexpr VkPipelineStageFlags2 SWAPCHAIN_WAIT_STAGE =
+  VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+// Below this, splitting draws across threads costs more than it saves
+static constexpr uint32_t MIN_DRAWS_PER_SECONDARY = 256;
+static constexpr uint32_t IMGUI_MAX_TEXTURES = 16;
+static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+static constexpr VkFormat DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+// One invocation per instance
+static constexpr WorkgroupSize CULL_WORKGROUP = { 64, 1 };
+// One invocation per meshlet task, CLUSTER_GROUP_SIZE in the shaders
+static constexpr WorkgroupSize CLUSTER_WORKGROUP = { 64, 1 };
+// Counters of Statistics in the culling shaders
+static constexpr uint32_t CULL_STATISTICS_COUNT = 6;
+static constexpr uint32_t EARLY_PHASE = 0;
+static constexpr uint32_t LATE_PHASE = 1;
+// Depth is reversed, 1 at the near plane and 0 at the far one
+static constexpr float DEPTH_CLEAR = 0.0f;
+
+// Requested mode first, then the closest ones. Fifo is always supported.
+static std::vector<VkPresentModeKHR> presentModeChain(PresentMode mode) {
+    switch (mode) {
+	case PresentMode::FifoRelaxed:
+	    return { VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+		     VK_PRESENT_MODE_FIFO_KHR };
+	case PresentMode::Mailbox:
+	    return { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR };
+	case PresentMode::Immediate:
+	    return { VK_PRESENT_MODE_IMMEDIATE_KHR,
+		     VK_PRESENT_MODE_MAILBOX_KHR,
+		     VK_PRESENT_MODE_FIFO_KHR };
+	case PresentMode::Fifo:
+	default:
+	    return { VK_PRESENT_MODE_FIFO_KHR };
+    }
+}
+
+static PresentMode toPresentMode(VkPresentModeKHR mode) {
+    switch (mode) {
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+	    return PresentMode::FifoRelaxed;
+	case VK_PRESENT_MODE_MAILBOX_KHR:
+	    return PresentMode::Mailbox;
+	case VK_PRESENT_MODE_IMMEDIATE_KHR:
+	    return PresentMode::Immediate;
+	default:
+	    return PresentMode::Fifo;
+    }
+}
+
 bool VulkanRenderer::init(GLFWwindow* window, int width, int height,
-			  bool tripleBuffering) {
-    if (tripleBuffering)
-	_frameOverlap = 3;
+			  const RendererSettings& settings, JobSystem& jobs) {
+    _initStart = std::chrono::steady_clock::now();
+    _framesInFlight = std::clamp(
+      settings.framesInFlight, uint32_t{ 1 }, MAX_FRAMES_IN_FLIGHT);
+    _headless = settings.headless;
+    _pipelineStatistics = settings.pipelineStatistics;
+    _parallelRecording = settings.parallelRecording;
+    _triangleDraws = settings.triangleDraws;
+    _asyncCompute = settings.asyncCompute;
+    _jobs = &jobs;
+    _window = window;
+    _requestedPresentMode = settings.presentMode;
+    _lowLatency = settings.lowLatency;
+    _minRenderScale = settings.minRenderScale;
+    _gpuCulling = settings.gpuCulling;
+    _occlusionCulling = settings.gpuCulling && settings.occlusionCulling;
+    _clusterCulling = settings.gpuCulling && settings.clusterCulling;
+    _instancedScene = settings.instancedScene;
+    _cameraDistance = settings.cameraDistance;
+    setDynamicResolution(settings.dynamicResolution, settings.targetFrameMs);
 
     initVulkan(window);
-    createSwapchain(width, height);
+    _pipelineCache.init(_device, _gpu, settings.pipelineCachePath);
+    _computeTuner.init(_device,
+		       _gpu,
+		       _computeQueue,
+		       _computeQueueFamily,
+		       settings.computeTuningPath);
+    _deletionQueue.pushFunction([this]() {
+	_pipelineCache.save(_device);
+	_pipelineCache.destroy(_device);
+    });
+    _pipelineCompiler.init(_device, _pipelineCache.cache, jobs);
+    _deletionQueue.pushFunction([this]() {
+	_pipelineCompiler.dumpStatistics(std::cout);
+	_pipelineCompiler.destroy();
+    });
+    if (!_headless) {
+	createSwapchain(width, height);
+	_deletionQueue.pushFunction([this]() {
+	    destroySwapchain(_swapchain, _swapchainImageViews);
+	});
+    }
+    createDrawImage(width, height);
     createCommands();
+    createBackgroundImages();
+    _deletionQueue.pushFunction([this]() { destroyBackgroundImages(); });
     createSync();
+    // The depth pyramid and the render graph register bindless handles
     initDescriptors();
-    initBackgroundPipeline();
+    // Its draw buffers are imported by the render graph. Cluster tasks are
+    // dispatched in one row of workgroups.
+    VkPhysicalDeviceProperties gpuProperties;
+    vkGetPhysicalDeviceProperties(_gpu, &gpuProperties);
+    uint32_t clusterCapacity = 0;
+    if (_clusterCulling) {
+	clusterCapacity = static_cast<uint32_t>(std::min<uint64_t>(
+	  settings.maxClusters,
+	  uint64_t{ gpuProperties.limits.maxComputeWorkGroupCount[0] } *
+	    CLUSTER_WORKGROUP.x));
+    }
+    _gpuScene.init(_device,
+		   _allocator,
+		   _uploader.queueFamilies(),
+		   settings.maxInstances,
+		   clusterCapacity);
+    _deletionQueue.pushFunction([this]() { _gpuScene.destroy(); });
+    _depthPyramid.init(_device,
+		       _allocator,
+		       _bindless,
+		       { _drawImage.imageExtent.width,
+			 _drawImage.imageExtent.height });
+    _deletionQueue.pushFunction(
+      [this]() { _depthPyramid.destroy(_device, _bindless); });
+    buildRenderGraph();
+    _deletionQueue.pushFunction([this]() { _renderGraph.destroy(); });
+    _meshPool.init(_device, _allocator, _uploader.queueFamilies());
+    _deletionQueue.pushFunction([this]() { _meshPool.destroy(); });
+
+    // Compiled on the job threads while the rest of the renderer is set up
+    // and the first frames are drawn with fallbacks
+    initBackgroundPipeline(settings.tuneCompute);
     initTrianglePipeline();
+    initMeshPipeline();
+    initCullPipeline();
+    _startupTimings.asyncPipelines = settings.asyncPipelines;
+    _startupTimings.warmPipelineCache = _pipelineCache.warm;
+    if (!settings.asyncPipelines) {
+	_pipelineCompiler.waitAll();
+	updatePipelines();
+    }
+
     initImguiBackend(window);
+    if (!settings.scenePath.empty() || _instancedScene > 0)
+	loadScene(settings.scenePath);
 
     return true;
 }
@@ -39,31 +179,30 @@ bool VulkanRenderer::init(GLFWwindow* window, int width, int height,
 void VulkanRenderer::initVulkan(GLFWwindow* window) {
     /*  For an example of initialization without using VKB, see the Vulkan
      path tracer source code */
-    uint32_t extensionCount;
-    const char** extensions = glfwGetRequiredInstanceExtensions(
-      &extensionCount);
 
     // Instance
     vkb::InstanceBuilder builder;
-
+    builder.set_app_name("Baldwin Engine Application")
+      .require_api_version(1, 3, 0);
 #ifdef ENABLE_VALIDATION_LAYERS
-    auto instRes = builder.set_app_name("Baldwin Engine Application")
-		     .request_validation_layers()
-		     .enable_extensions(extensionCount, extensions)
-		     .use_default_debug_messenger()
-		     .require_api_version(1, 3, 0)
-		     .build();
-#else
-    auto instRes = builder.set_app_name("Baldwin Engine Application")
-		     .require_api_version(1, 3, 0)
-		     .enable_extensions(extensionCount, extensions)
-		     .build();
+    builder.request_validation_layers().use_default_debug_messenger();
 #endif
-    vkb::Instance vkbInst = instRes.value();
+    if (_headless) {
+	// No surface extensions, which lets software ICDs such as lavapipe run
+	// without any display server
+	builder.set_headless();
+    } else {
+	uint32_t extensionCount;
+	const char** extensions = glfwGetRequiredInstanceExtensions(
+	  &extensionCount);
+	builder.enable_extensions(extensionCount, extensions);
+    }
+    vkb::Instance vkbInst = builder.build().value();
     _instance = vkbInst.instance;
 
     // Surface
-    glfwCreateWindowSurface(_instance, window, nullptr, &_surface);
+    if (!_headless)
+	glfwCreateWindowSurface(_instance, window, nullptr, &_surface);
 
     // Physical and logical devices
     VkPhysicalDeviceVulkan13Features features13 = {
@@ -77,15 +216,69 @@ void VulkanRenderer::initVulkan(GLFWwindow* window) {
     };
     features12.bufferDeviceAddress = true;
     features12.descriptorIndexing = true;
+    features12.timelineSemaphore = true;
+    // Profiler queries are reset from the host, see GpuProfiler
+    features12.hostQueryReset = true;
+    // GPU-driven draws, each passing its instance index as first instance
+    features12.drawIndirectCount = true;
+    // The depth pyramid is a two channel storage image
+    VkPhysicalDeviceFeatures features = {
+	.multiDrawIndirect = VK_TRUE,
+	.drawIndirectFirstInstance = VK_TRUE,
+	.shaderStorageImageExtendedFormats = VK_TRUE
+    };
+    // Bindless heap
+    features12.runtimeDescriptorArray = true;
+    features12.descriptorBindingPartiallyBound = true;
+    features12.descriptorBindingUpdateUnusedWhilePending = true;
+    features12.descriptorBindingSampledImageUpdateAfterBind = true;
+    features12.descriptorBindingStorageImageUpdateAfterBind = true;
+    features12.descriptorBindingStorageBufferUpdateAfterBind = true;
+    features12.shaderSampledImageArrayNonUniformIndexing = true;
+    features12.shaderStorageImageArrayNonUniformIndexing = true;
+    features12.shaderStorageBufferArrayNonUniformIndexing = true;
 
     vkb::PhysicalDeviceSelector selector{ vkbInst };
-    vkb::PhysicalDevice physicalDevice = selector.set_minimum_version(1, 3)
-					   .set_required_features_13(features13)
-					   .set_required_features_12(features12)
-					   .set_surface(_surface)
-					   .select()
-					   .value();
+    selector.set_minimum_version(1, 3)
+      .set_required_features(features)
+      .set_required_features_13(features13)
+      .set_required_features_12(features12);
+    if (_headless)
+	selector.require_present(false);
+    else
+	selector.set_surface(_surface);
+    vkb::PhysicalDevice physicalDevice = selector.select().value();
     std::cout << "Selected GPU :" << physicalDevice.name << std::endl;
+
+    // Pipeline statistics only feed the profiler, so they are optional
+    VkPhysicalDeviceFeatures optionalFeatures = { .pipelineStatisticsQuery =
+						    VK_TRUE };
+    _pipelineStatistics = _pipelineStatistics &&
+			  physicalDevice.enable_features_if_present(
+			    optionalFeatures);
+    _timestampPeriod = physicalDevice.properties.limits.timestampPeriod;
+
+    // The depth pyramid reduces 2x2 texel blocks within subgroup clusters
+    VkPhysicalDeviceVulkan11Properties properties11 = {
+	.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_PROPERTIES
+    };
+    VkPhysicalDeviceProperties2 properties = {
+	.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+	.pNext = &properties11
+    };
+    vkGetPhysicalDeviceProperties2(physicalDevice.physical_device,
+				   &properties);
+    bool clusteredSubgroups =
+      (properties11.subgroupSupportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+      (properties11.subgroupSupportedOperations &
+       VK_SUBGROUP_FEATURE_CLUSTERED_BIT) &&
+      properties11.subgroupSize >= 4;
+    if (_occlusionCulling && !clusteredSubgroups) {
+	std::cout << "No clustered subgroup operations, occlusion culling "
+		     "disabled"
+		  << std::endl;
+	_occlusionCulling = false;
+    }
     vkb::DeviceBuilder deviceBuilder{ physicalDevice };
     vkb::Device vkbDevice = deviceBuilder.build().value();
 
@@ -96,6 +289,34 @@ void VulkanRenderer::initVulkan(GLFWwindow* window) {
     _graphicsQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::graphics)
 			     .value();
     _graphicsQueue = vkbDevice.get_queue(vkb::QueueType::graphics).value();
+    // Uploads run on a dedicated transfer queue when there is one, so they
+    // overlap with rendering
+    auto transferQueue = vkbDevice.get_dedicated_queue(
+      vkb::QueueType::transfer);
+    if (transferQueue.has_value()) {
+	_transferQueue = transferQueue.value();
+	_transferQueueFamily = vkbDevice
+				 .get_dedicated_queue_index(
+				   vkb::QueueType::transfer)
+				 .value();
+    } else {
+	_transferQueue = _graphicsQueue;
+	_transferQueueFamily = _graphicsQueueFamily;
+    }
+    // Async compute needs a family without graphics, otherwise everything
+    // runs on the graphics queue
+    auto computeQueue = vkbDevice.get_separate_queue(vkb::QueueType::compute);
+    if (_asyncCompute && computeQueue.has_value()) {
+	_computeQueue = computeQueue.value();
+	_computeQueueFamily = vkbDevice
+				.get_separate_queue_index(
+				  vkb::QueueType::compute)
+				.value();
+    } else {
+	_asyncCompute = false;
+	_computeQueue = _graphicsQueue;
+	_computeQueueFamily = _graphicsQueueFamily;
+    }
 
     // VMA
     VmaAllocatorCreateInfo allocatorInfo = {
@@ -110,7 +331,6 @@ void VulkanRenderer::initVulkan(GLFWwindow* window) {
     _deletionQueue.pushFunction([this, vkbInst]() {
 	vmaDestroyAllocator(_allocator);
 	vkb::destroy_debug_utils_messenger(_instance, vkbInst.debug_messenger);
-	vkDestroySwapchainKHR(_device, _swapchain, nullptr);
 	vkDestroySurfaceKHR(_instance, _surface, nullptr);
 	vkDestroyDevice(_device, nullptr);
 	vkDestroyInstance(_instance, nullptr);
@@ -121,67 +341,125 @@ void VulkanRenderer::createSwapchain(int width, int height) {
     _swapchainFormat = VK_FORMAT_B8G8R8A8_UNORM;
 
     vkb::SwapchainBuilder swapchainBuilder{ _gpu, _device, _surface };
-    vkb::Swapchain
-      vkbSwapchain = swapchainBuilder
-		       //.use_default_format_selection()
-		       .set_desired_format(VkSurfaceFormatKHR{
-			 .format = _swapchainFormat,
-			 .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR })
-		       // use vsync present mode
-		       .set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
-		       .set_desired_extent(width, height)
-		       .add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT)
-		       .build()
-		       .value();
+    swapchainBuilder
+      .set_desired_format(
+	VkSurfaceFormatKHR{ .format = _swapchainFormat,
+			    .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR })
+      .set_desired_extent(width, height)
+      .add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+      // Lets the driver reuse resources of the swapchain being replaced
+      .set_old_swapchain(_swapchain);
+    for (VkPresentModeKHR mode : presentModeChain(_requestedPresentMode)) {
+	swapchainBuilder.add_fallback_present_mode(mode);
+    }
+    vkb::Swapchain vkbSwapchain = swapchainBuilder.build().value();
 
     _swapchainExtent = vkbSwapchain.extent;
+    _presentMode = toPresentMode(vkbSwapchain.present_mode);
     // store swapchain and its related imagessnip-next-choice
     _swapchain = vkbSwapchain.swapchain;
     _swapchainImages = vkbSwapchain.get_images().value();
+    _swapchainImageStates.assign(_swapchainImages.size(), ImageState{});
     _swapchainImageViews = vkbSwapchain.get_image_views().value();
+}
 
-    // Draw image
-    _drawImage.imageFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+void VulkanRenderer::destroySwapchain(VkSwapchainKHR swapchain,
+				      std::vector<VkImageView>& imageViews) {
+    for (VkImageView imgView : imageViews) {
+	vkDestroyImageView(_device, imgView, nullptr);
+    }
+    imageViews.clear();
+    vkDestroySwapchainKHR(_device, swapchain, nullptr);
+}
+
+void VulkanRenderer::recreateSwapchain(int width, int height) {
+    // Presentation may still read the old images, and only waiting for the
+    // queue covers it
+    vkQueueWaitIdle(_graphicsQueue);
+    vkGetSemaphoreCounterValue(_device, _frameTimeline, &_completedValue);
+
+    VkSwapchainKHR oldSwapchain = _swapchain;
+    std::vector<VkImageView> oldImageViews = std::move(_swapchainImageViews);
+    createSwapchain(width, height);
+    destroySwapchain(oldSwapchain, oldImageViews);
+    _swapchainDirty = false;
+    if (_swapchainExtent.width != _drawImage.imageExtent.width ||
+	_swapchainExtent.height != _drawImage.imageExtent.height) {
+	resizeRenderTargets();
+    }
+}
+
+void VulkanRenderer::resizeRenderTargets() {
+    // Frames already submitted keep using the old targets, which are retired
+    // once the last of them completes. They get new bindless handles, the
+    // old ones may still be read.
     _drawImage.imageExtent = { _swapchainExtent.width,
 			       _swapchainExtent.height,
 			       1 };
 
-    VkImageUsageFlags drawImageUsages = {};
-    drawImageUsages |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-    drawImageUsages |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-    drawImageUsages |= VK_IMAGE_USAGE_STORAGE_BIT;
-    drawImageUsages |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    retireBackgroundImages(_retireQueue, _frameValue);
+    createBackgroundImages();
+    for (FrameData& frame : _frames) {
+	_bindless.release(BindlessType::StorageImage, frame.backgroundHandle);
+	frame.backgroundHandle = _bindless.addStorageImage(
+	  _device, frame.background.imageView);
+    }
+    _depthPyramid.retire(_retireQueue, _bindless, _frameValue);
+    _depthPyramid.init(
+      _device,
+      _allocator,
+      _bindless,
+      { _drawImage.imageExtent.width, _drawImage.imageExtent.height });
+    _pyramidValid = false;
+
+    // The draw and depth images are transients of the graph
+    _bindless.release(BindlessType::SampledImage, _depthHandle);
+    _renderGraph.clear(&_retireQueue, _frameValue);
+    buildRenderGraph();
+}
 
-    VkImageCreateInfo imgInfo = getImageCreateInfo(
-      _drawImage.imageFormat, drawImageUsages, _drawImage.imageExtent);
+void VulkanRenderer::setPresentMode(PresentMode mode) {
+    _requestedPresentMode = mode;
+    _swapchainDirty = !_headless;
+}
 
-    // GPU memory only
-    VmaAllocationCreateInfo imgAllocInfo = {
-	.usage = VMA_MEMORY_USAGE_GPU_ONLY,
-	.requiredFlags = VkMemoryPropertyFlags(
-	  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+void VulkanRenderer::createDrawImage(int width, int height) {
+    // Offscreen runs have no swapchain to follow, so the requested size is
+    // used as is
+    _drawExtent = _headless ? VkExtent2D{ static_cast<uint32_t>(width),
+					  static_cast<uint32_t>(height) }
+			    : _swapchainExtent;
+
+    _drawImage.imageFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+    _drawImage.imageExtent = { _drawExtent.width, _drawExtent.height, 1 };
+    // Memory is owned by the render graph, which fills the image and view
+    // once compiled
+}
+
+void VulkanRenderer::setDynamicResolution(bool enabled, double targetMs) {
+    _dynamicResolution = enabled;
+    _resolution.setBudget(targetMs, _minRenderScale);
+    if (!enabled)
+	_resolution.reset();
+}
+
+void VulkanRenderer::updateDrawExtent() {
+    float scale = _resolution.scale();
+    // Multiples of 8 texels keep workgroups whole, and the extent from
+    // changing on every small correction
+    auto scaled = [scale](uint32_t size) {
+	if (scale >= 1.0f)
+	    return size;
+	uint32_t value = static_cast<uint32_t>(size * scale) & ~7u;
+	return std::clamp(value, std::min(size, 8u), size);
     };
-    vmaCreateImage(_allocator,
-		   &imgInfo,
-		   &imgAllocInfo,
-		   &_drawImage.image,
-		   &_drawImage.allocation,
-		   nullptr);
-
-    // Associated view
-    VkImageViewCreateInfo imgViewInfo = getImageViewCreateInfo(
-      _drawImage.imageFormat, _drawImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
-    VK_CHECK(
-      vkCreateImageView(_device, &imgViewInfo, nullptr, &_drawImage.imageView),
-      "Could not create draw iamge view");
+    _drawExtent = { scaled(_drawImage.imageExtent.width),
+		    scaled(_drawImage.imageExtent.height) };
 
-    _deletionQueue.pushFunction([this]() {
-	vkDestroyImageView(_device, _drawImage.imageView, nullptr);
-	vmaDestroyImage(_allocator, _drawImage.image, _drawImage.allocation);
-	for (auto& imgView : _swapchainImageViews) {
-	    vkDestroyImageView(_device, imgView, nullptr);
-	}
-    });
+    _frameTimings.renderWidth = _drawExtent.width;
+    _frameTimings.renderHeight = _drawExtent.height;
+    _frameTimings.renderScale =
+      static_cast<float>(_drawExtent.width) / _drawImage.imageExtent.width;
 }
 
 void VulkanRenderer::createCommands() {
@@ -192,11 +470,12 @@ void VulkanRenderer::createCommands() {
 	.queueFamilyIndex = _graphicsQueueFamily
     };
 
-    for (int i = 0; i < _frameOverlap; i++) {
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 	FrameData frame{};
 	VK_CHECK(
 	  vkCreateCommandPool(_device, &poolInfo, nullptr, &frame.commandPool),
 	  "Could not create frame command pool");
+	frame.profiler.init(_device, _pipelineStatistics);
 
 	VkCommandBufferAllocateInfo bufferInfo = {
 	    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
@@ -208,29 +487,155 @@ void VulkanRenderer::createCommands() {
 		   _device, &bufferInfo, &frame.mainCommandBuffer),
 		 "Could not allocate frame main command buffer");
 
+	if (_asyncCompute) {
+	    VkCommandPoolCreateInfo computePoolInfo = poolInfo;
+	    computePoolInfo.queueFamilyIndex = _computeQueueFamily;
+	    VK_CHECK(vkCreateCommandPool(_device,
+					 &computePoolInfo,
+					 nullptr,
+					 &frame.computeCommandPool),
+		     "Could not create frame compute command pool");
+	    bufferInfo.commandPool = frame.computeCommandPool;
+	    VK_CHECK(vkAllocateCommandBuffers(
+		       _device, &bufferInfo, &frame.computeCommandBuffer),
+		     "Could not allocate frame compute command buffer");
+	}
+
+	// Secondaries are recorded from every job thread, each needs its own
+	// pool since pools can not be used concurrently
+	VkCommandPoolCreateInfo threadPoolInfo = {
+	    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+	    .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+	    .queueFamilyIndex = _graphicsQueueFamily
+	};
+	frame.threadCommands.resize(_jobs->threadCount());
+	frame.linearAllocator.init(_device, _allocator);
+	frame.cullStatistics = createBuffer(
+	  _allocator,
+	  CULL_STATISTICS_COUNT * sizeof(uint32_t),
+	  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+	    VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+	  VMA_MEMORY_USAGE_AUTO,
+	  VMA_ALLOCATION_CREATE_MAPPED_BIT |
+	    VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT);
+	std::fill_n(
+	  static_cast<uint32_t*>(frame.cullStatistics.info.pMappedData),
+	  CULL_STATISTICS_COUNT,
+	  0);
+	vmaFlushAllocation(
+	  _allocator, frame.cullStatistics.allocation, 0, VK_WHOLE_SIZE);
+	VkBufferDeviceAddressInfo addressInfo = {
+	    .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+	    .buffer = frame.cullStatistics.buffer
+	};
+	frame.cullStatisticsAddress = vkGetBufferDeviceAddress(_device,
+							       &addressInfo);
+	for (ThreadCommands& thread : frame.threadCommands) {
+	    VK_CHECK(vkCreateCommandPool(
+		       _device, &threadPoolInfo, nullptr, &thread.pool),
+		     "Could not create thread command pool");
+	}
+
 	_frames.push_back(frame);
-	_frames[i].deletionQueue.pushFunction([this, i]() {
-	    vkFreeCommandBuffers(_device,
-				 _frames[i].commandPool,
-				 1,
-				 &_frames[i].mainCommandBuffer);
-	    vkDestroyCommandPool(_device, _frames[i].commandPool, nullptr);
-	});
+	// Destroying the pools frees their command buffers
+	_deletionQueue.push(frame.commandPool);
+	if (_asyncCompute)
+	    _deletionQueue.push(frame.computeCommandPool);
+	for (ThreadCommands& thread : frame.threadCommands) {
+	    _deletionQueue.push(thread.pool);
+	}
+	_deletionQueue.push(frame.linearAllocator.buffer.buffer,
+			    frame.linearAllocator.buffer.allocation);
+	_deletionQueue.push(frame.cullStatistics.buffer,
+			    frame.cullStatistics.allocation);
+	_deletionQueue.push(frame.profiler.timestampPool);
+	_deletionQueue.push(frame.profiler.statisticsPool);
     }
 
-    // Immediate commands (soon)
+    // Uploads
+    _uploader.init(_device,
+		   _allocator,
+		   _transferQueue,
+		   _transferQueueFamily,
+		   _graphicsQueueFamily);
+    _deletionQueue.pushFunction([this]() { _uploader.destroy(); });
+}
+
+void VulkanRenderer::createBackgroundImages() {
+    VkExtent3D extent = _drawImage.imageExtent;
+    VkImageCreateInfo imgInfo = getImageCreateInfo(
+      _drawImage.imageFormat,
+      VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      extent);
+    VmaAllocationCreateInfo allocInfo = {
+	.usage = VMA_MEMORY_USAGE_GPU_ONLY,
+	.requiredFlags = VkMemoryPropertyFlags(
+	  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+    };
+
+    for (FrameData& frame : _frames) {
+	AllocatedImage& image = frame.background;
+	image.imageFormat = _drawImage.imageFormat;
+	image.imageExtent = extent;
+	VK_CHECK(vmaCreateImage(_allocator,
+				&imgInfo,
+				&allocInfo,
+				&image.image,
+				&image.allocation,
+				nullptr),
+		 "Could not create background image");
+	VkImageViewCreateInfo viewInfo = getImageViewCreateInfo(
+	  image.imageFormat, image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+	VK_CHECK(
+	  vkCreateImageView(_device, &viewInfo, nullptr, &image.imageView),
+	  "Could not create background image view");
+	image.state = {};
+    }
+}
+
+void VulkanRenderer::destroyBackgroundImages() {
+    DeletionQueue queue;
+    retireBackgroundImages(queue, 0);
+    queue.flush(_device, _allocator);
+}
+
+void VulkanRenderer::retireBackgroundImages(DeletionQueue& queue,
+					    uint64_t retireValue) {
+    for (FrameData& frame : _frames) {
+	// Flushed most recent first, so the view goes first
+	queue.push(frame.background.image,
+		   frame.background.allocation,
+		   retireValue);
+	queue.push(frame.background.imageView, retireValue);
+	frame.background.image = VK_NULL_HANDLE;
+	frame.background.imageView = VK_NULL_HANDLE;
+	frame.background.allocation = VK_NULL_HANDLE;
+    }
 }
 
 void VulkanRenderer::createSync() {
     VkSemaphoreCreateInfo semaphoreInfo = {
 	.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
     };
-    VkFenceCreateInfo fenceInfo = {
-	.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-	.flags = VK_FENCE_CREATE_SIGNALED_BIT
+    VkSemaphoreTypeCreateInfo timelineInfo = {
+	.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+	.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+	.initialValue = 0
     };
-
-    for (int i = 0; i < _frameOverlap; i++) {
+    VkSemaphoreCreateInfo timelineSemaphoreInfo = {
+	.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+	.pNext = &timelineInfo
+    };
+    VK_CHECK(vkCreateSemaphore(
+	       _device, &timelineSemaphoreInfo, nullptr, &_frameTimeline),
+	     "Could not create frame timeline semaphore");
+    _deletionQueue.push(_frameTimeline);
+    VK_CHECK(vkCreateSemaphore(
+	       _device, &timelineSemaphoreInfo, nullptr, &_computeTimeline),
+	     "Could not create compute timeline semaphore");
+    _deletionQueue.push(_computeTimeline);
+
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 	VK_CHECK(vkCreateSemaphore(
 		   _device, &semaphoreInfo, nullptr, &_frames[i].swapSemaphore),
 		 "Could not create frame swapSemaphore");
@@ -238,88 +643,95 @@ void VulkanRenderer::createSync() {
 	  vkCreateSemaphore(
 	    _device, &semaphoreInfo, nullptr, &_frames[i].renderSemaphore),
 	  "Could not create frame renderSemaphore");
-	VK_CHECK(
-	  vkCreateFence(_device, &fenceInfo, nullptr, &_frames[i].renderFence),
-	  "Could not create frame renderFence");
 
-	_frames[i].deletionQueue.pushFunction([this, i]() {
-	    vkDestroyFence(_device, _frames[i].renderFence, nullptr);
-	    vkDestroySemaphore(_device, _frames[i].renderSemaphore, nullptr);
-	    vkDestroySemaphore(_device, _frames[i].swapSemaphore, nullptr);
-	});
+	_deletionQueue.push(_frames[i].renderSemaphore);
+	_deletionQueue.push(_frames[i].swapSemaphore);
     }
 }
 
 void VulkanRenderer::initDescriptors() {
-    std::vector<DescriptorAllocator::PoolSizeRatio> poolSizes = {
-	{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }
-    };
-    _descriptorAllocator.initPool(_device, 10, poolSizes);
-
-    DescriptorLayoutBuilder builder{};
-    builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-
-    _bgSetLayout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT, nullptr);
-    _bgDescriptors = _descriptorAllocator.allocate(
-      _device, _bgSetLayout, nullptr);
-
-    VkDescriptorImageInfo imgWriteInfo = {
-	.imageView = _drawImage.imageView,
-	.imageLayout = VK_IMAGE_LAYOUT_GENERAL
-    };
-    VkWriteDescriptorSet writeInfo = {
-	.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-	.dstSet = _bgDescriptors,
-	.dstBinding = 0,
-	.descriptorCount = 1,
-	.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-	.pImageInfo = &imgWriteInfo
-    };
-    vkUpdateDescriptorSets(_device, 1, &writeInfo, 0, nullptr);
+    // Everything shaders read or write goes through the bindless heap
+    _bindless.init(_device, _gpu, MAX_FRAMES_IN_FLIGHT);
+    for (FrameData& frame : _frames) {
+	frame.backgroundHandle = _bindless.addStorageImage(
+	  _device, frame.background.imageView);
+    }
 
-    _deletionQueue.pushFunction([this]() {
-	vkDestroyDescriptorSetLayout(_device, _bgSetLayout, nullptr);
-	_descriptorAllocator.destroyPool(_device);
-    });
+    _deletionQueue.pushFunction([this]() { _bindless.destroy(_device); });
 }
 
-void VulkanRenderer::initBackgroundPipeline() {
-    VkPipelineLayoutCreateInfo ppLayoutInfo = {
-	.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-	.setLayoutCount = 1,
-	.pSetLayouts = &_bgSetLayout
-    };
-    VK_CHECK(vkCreatePipelineLayout(
-	       _device, &ppLayoutInfo, nullptr, &_bgPipelineLayout),
-	     "Could not create background pipeline layout");
-
-    auto bgCode = readShaderFile("shaders/test.comp.spv");
-    VkShaderModule module = createShaderModule(_device, bgCode);
-    VkPipelineShaderStageCreateInfo
-      stageInfo = getPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT,
-						   module);
-    VkComputePipelineCreateInfo ppInfo = {
-	.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-	.stage = stageInfo,
-	.layout = _bgPipelineLayout
-    };
-    VK_CHECK(vkCreateComputePipelines(
-	       _device, nullptr, 1, &ppInfo, nullptr, &_bgPipeline),
-	     "Could not create background pipeline");
-
-    vkDestroyShaderModule(_device, module, nullptr);
-    _deletionQueue.pushFunction([this]() {
-	vkDestroyPipelineLayout(_device, _bgPipelineLayout, nullptr);
-	vkDestroyPipeline(_device, _bgPipeline, nullptr);
-    });
+void VulkanRenderer::initBackgroundPipeline(bool tune) {
+    _bgWorkgroup = _computeTuner.lookup("background", WorkgroupSize{});
+    if (tune) {
+	VkShaderModule module =
+	  createShaderModule(_device, getShaderCode("test.comp"));
+	// Tuned over the first frame's background, with constants living in
+	// its linear allocator until the first frame resets it
+	FrameData& frame = _frames[0];
+	VkDeviceAddress constants =
+	  frame.linearAllocator
+	    .push(FrameConstants{ .renderWidth = _drawExtent.width,
+				  .renderHeight = _drawExtent.height })
+	    .address;
+	frame.linearAllocator.flush(_allocator);
+	ImageState state{};
+	try {
+	    _bgWorkgroup = _computeTuner.tune(
+	      "background",
+	      _bgWorkgroup,
+	      [&](WorkgroupSize workgroup) {
+		  return createComputePipeline(_device,
+					       _pipelineCache.cache,
+					       _bindless.pipelineLayout,
+					       module,
+					       workgroup);
+	      },
+	      [&](VkCommandBuffer cmd, VkPipeline pipeline,
+		  WorkgroupSize workgroup) {
+		  BarrierBatch barriers;
+		  barriers.transition(cmd,
+				      frame.background.image,
+				      state,
+				      ImageUsage::ComputeWrite,
+				      true);
+		  barriers.flush(cmd);
+		  vkCmdBindDescriptorSets(cmd,
+					  VK_PIPELINE_BIND_POINT_COMPUTE,
+					  _bindless.pipelineLayout,
+					  0,
+					  1,
+					  &_bindless.set,
+					  0,
+					  nullptr);
+		  vkCmdBindPipeline(
+		    cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		  struct {
+		      VkDeviceAddress frame;
+		      uint32_t image;
+		  } pushed = { constants, frame.backgroundHandle };
+		  vkCmdPushConstants(cmd,
+				     _bindless.pipelineLayout,
+				     VK_SHADER_STAGE_ALL,
+				     0,
+				     sizeof(pushed),
+				     &pushed);
+		  vkCmdDispatch(cmd,
+				workgroup.groupsX(_drawExtent.width),
+				workgroup.groupsY(_drawExtent.height),
+				1);
+	      });
+	} catch (...) {
+	    vkDestroyShaderModule(_device, module, nullptr);
+	    throw;
+	}
+	frame.linearAllocator.reset();
+	vkDestroyShaderModule(_device, module, nullptr);
+    }
+    _bgPipeline = _pipelineCompiler.compileCompute(
+      "test.comp", _bindless.pipelineLayout, _bgWorkgroup);
 }
 
 void VulkanRenderer::initTrianglePipeline() {
-    auto vertCode = readShaderFile("shaders/test_triangle.vert.spv");
-    VkShaderModule vertModule = createShaderModule(_device, vertCode);
-    auto fragCode = readShaderFile("shaders/test_triangle.frag.spv");
-    VkShaderModule fragModule = createShaderModule(_device, fragCode);
-
     VkPipelineLayoutCreateInfo triangleLayoutInfo = {
 	.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
 	.setLayoutCount = 0
@@ -330,7 +742,6 @@ void VulkanRenderer::initTrianglePipeline() {
 
     GraphicsPipelineBuilder builder = {};
     builder._pipelineLayout = _trianglePipelineLayout;
-    builder.setShaders(vertModule, fragModule);
     builder.setInputTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
     builder.setPolygonMode(VK_POLYGON_MODE_FILL);
     builder.setCullMode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
@@ -339,35 +750,227 @@ void VulkanRenderer::initTrianglePipeline() {
     builder.disableDepthTest();
     builder.setColorAttachment(_drawImage.imageFormat);
     builder.setDepthFormat(VK_FORMAT_UNDEFINED);
-    _trianglePipeline = builder.build(_device);
+    _trianglePipeline = _pipelineCompiler.compileGraphics(
+      builder, "test_triangle.vert", "test_triangle.frag");
 
-    vkDestroyShaderModule(_device, vertModule, nullptr);
-    vkDestroyShaderModule(_device, fragModule, nullptr);
+    _deletionQueue.push(_trianglePipelineLayout);
+}
 
-    _deletionQueue.pushFunction([this]() {
-	vkDestroyPipelineLayout(_device, _trianglePipelineLayout, nullptr);
-	vkDestroyPipeline(_device, _trianglePipeline, nullptr);
-    });
+void VulkanRenderer::initMeshPipeline() {
+    // Vertices are pulled from the pool through their address, so there is
+    // no vertex input state and the bindless layout is enough
+    GraphicsPipelineBuilder builder = {};
+    builder._pipelineLayout = _bindless.pipelineLayout;
+    builder.setInputTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    builder.setPolygonMode(VK_POLYGON_MODE_FILL);
+    // Meshes wind counter-clockwise seen from outside, which the left-handed
+    // view mirrors on screen. Culled like the cluster pass's cone test.
+    builder.setCullMode(VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_CLOCKWISE);
+    builder.disableMultiSampling();
+    builder.disableBlending();
+    // Reversed depth, nearer is greater
+    builder.enableDepthTest(true, VK_COMPARE_OP_GREATER_OR_EQUAL);
+    builder.setColorAttachment(_drawImage.imageFormat);
+    builder.setDepthFormat(DEPTH_FORMAT);
+    _meshPipeline = _pipelineCompiler.compileGraphics(
+      builder, "mesh.vert", "mesh.frag");
+}
+
+void VulkanRenderer::initCullPipeline() {
+    _cullPipeline = _pipelineCompiler.compileCompute(
+      "cull.comp", _bindless.pipelineLayout, CULL_WORKGROUP);
+    if (_occlusionCulling) {
+	_pyramidPipeline = _pipelineCompiler.compileCompute(
+	  "pyramid.comp", _bindless.pipelineLayout, DepthPyramid::WORKGROUP);
+    }
+    if (_clusterCulling) {
+	_clusterPipeline = _pipelineCompiler.compileCompute(
+	  "cluster.comp", _bindless.pipelineLayout, CLUSTER_WORKGROUP);
+    }
+}
+
+void VulkanRenderer::loadScene(const std::string& path) {
+    if (_instancedScene > 0)
+	std::cout << "Building " << _instancedScene << " instances" << std::endl;
+    else
+	std::cout << "Loading scene " << path << std::endl;
+    _sceneLoadStart = std::chrono::steady_clock::now();
+    _sceneLoading = true;
+    _jobs->runBackground(
+      [this, path]() {
+	  try {
+	      if (_instancedScene > 0)
+		  _sceneData = buildInstancedScene(_instancedScene);
+	      else if (isCookedScene(path))
+		  _sceneData = loadCookedScene(path);
+	      else
+		  _sceneData = loadGltf(path, *_jobs);
+	  } catch (...) {
+	      _sceneError = std::current_exception();
+	  }
+      },
+      &_sceneLoad);
+}
+
+void VulkanRenderer::updateScene() {
+    if (!_sceneLoading)
+	return;
+    // Without worker threads nothing else would ever run the job
+    if (_jobs->threadCount() == 1)
+	_jobs->wait(_sceneLoad);
+    if (!_sceneLoad.done())
+	return;
+    _sceneLoading = false;
+    if (_sceneError)
+	std::rethrow_exception(std::exchange(_sceneError, nullptr));
+
+    // Copies go through the staging ring, frames wait for them like for
+    // any other upload. Cooked scenes are copied straight from the mapping.
+    std::vector<GpuMesh> gpuMeshes;
+    // Index of every scene mesh in _meshes, UINT32_MAX when skipped
+    std::vector<uint32_t> meshIndices(_sceneData.meshes.size(), UINT32_MAX);
+    for (size_t m = 0; m < _sceneData.meshes.size(); m++) {
+	const MeshView& mesh = _sceneData.meshes[m];
+	MeshDraw draw = {};
+	uint32_t vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+	uint32_t indexCount = static_cast<uint32_t>(mesh.indices.size());
+	if (_meshes.size() == _gpuScene.meshCapacity() ||
+	    !_meshPool.allocate(vertexCount, indexCount, draw.allocation)) {
+	    std::cout << "Mesh pool is full, skipping a mesh of "
+		      << vertexCount << " vertices" << std::endl;
+	    continue;
+	}
+	// Only the cluster pass reads meshlets
+	uint32_t firstMeshlet = 0;
+	uint32_t meshletCount = 0;
+	if (_clusterCulling) {
+	    firstMeshlet = _gpuScene.addMeshlets(_uploader, mesh.meshlets);
+	    meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+	}
+	if (firstMeshlet == UINT32_MAX) {
+	    std::cout << "Meshlet table is full, skipping a mesh of "
+		      << meshletCount << " meshlets" << std::endl;
+	    _meshPool.free(draw.allocation);
+	    continue;
+	}
+	_uploader.uploadBuffer(
+	  _meshPool.vertexBuffer(),
+	  draw.allocation.firstVertex * sizeof(PackedVertex),
+	  mesh.vertices.data(),
+	  mesh.vertices.size_bytes());
+	_uploader.uploadBuffer(_meshPool.indexBuffer(),
+			       draw.allocation.firstIndex * sizeof(uint32_t),
+			       mesh.indices.data(),
+			       mesh.indices.size_bytes());
+
+	GpuMesh gpuMesh = {
+	    .firstIndex = draw.allocation.firstIndex,
+	    .indexCount = draw.allocation.indexCount,
+	    .vertexOffset = static_cast<int32_t>(draw.allocation.firstVertex),
+	    .firstMeshlet = firstMeshlet,
+	    .meshletCount = meshletCount
+	};
+	float radius = 0.0f;
+	for (int axis = 0; axis < 3; axis++) {
+	    draw.boundsMin[axis] = mesh.boundsMin[axis];
+	    draw.boundsMax[axis] = mesh.boundsMax[axis];
+	    float extent = mesh.boundsMax[axis] - mesh.boundsMin[axis];
+	    gpuMesh.positionOffset[axis] = mesh.boundsMin[axis];
+	    gpuMesh.positionScale[axis] = extent;
+	    gpuMesh.sphere[axis] = mesh.boundsMin[axis] + 0.5f * extent;
+	    radius += 0.25f * extent * extent;
+	}
+	gpuMesh.sphere[3] = std::sqrt(radius);
+	meshIndices[m] = static_cast<uint32_t>(_meshes.size());
+	_meshes.push_back(draw);
+	gpuMeshes.push_back(gpuMesh);
+    }
+
+    // Scenes without instances draw each mesh once, untransformed
+    std::vector<MeshInstance> sceneInstances = std::move(_sceneData.instances);
+    if (sceneInstances.empty()) {
+	for (uint32_t m = 0; m < _sceneData.meshes.size(); m++) {
+	    sceneInstances.push_back(MeshInstance{ .scale = 1.0f, .mesh = m });
+	}
+    }
+    std::vector<GpuInstance> gpuInstances;
+    gpuInstances.reserve(
+      std::min<size_t>(sceneInstances.size(), _gpuScene.instanceCapacity()));
+    float sceneMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float sceneMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (const MeshInstance& instance : sceneInstances) {
+	if (instance.mesh >= meshIndices.size() ||
+	    meshIndices[instance.mesh] == UINT32_MAX)
+	    continue;
+	if (gpuInstances.size() == _gpuScene.instanceCapacity()) {
+	    std::cout << "Instance capacity reached, dropping the remaining "
+			 "instances"
+		      << std::endl;
+	    break;
+	}
+
+	uint32_t meshIndex = meshIndices[instance.mesh];
+	const MeshDraw& draw = _meshes[meshIndex];
+	const GpuMesh& mesh = gpuMeshes[meshIndex];
+	GpuInstance gpuInstance = { .transform = { instance.position[0],
+						   instance.position[1],
+						   instance.position[2],
+						   instance.scale },
+				    .mesh = meshIndex };
+	for (int axis = 0; axis < 3; axis++) {
+	    gpuInstance.sphere[axis] = instance.position[axis] +
+				       mesh.sphere[axis] * instance.scale;
+	    sceneMin[axis] = std::min(sceneMin[axis],
+				      instance.position[axis] +
+					draw.boundsMin[axis] * instance.scale);
+	    sceneMax[axis] = std::max(sceneMax[axis],
+				      instance.position[axis] +
+					draw.boundsMax[axis] * instance.scale);
+	}
+	gpuInstance.sphere[3] = mesh.sphere[3] * instance.scale;
+	gpuInstances.push_back(gpuInstance);
+	_instanceMeshes.push_back(meshIndex);
+	_sceneTriangles += draw.allocation.indexCount / 3;
+    }
+    _gpuScene.upload(_uploader, gpuMeshes, gpuInstances);
+    _cullStatistics.instances = _gpuScene.instanceCount();
+
+    if (!gpuInstances.empty()) {
+	float radius = 0.0f;
+	for (int axis = 0; axis < 3; axis++) {
+	    _sceneBounds[axis] = 0.5f * (sceneMin[axis] + sceneMax[axis]);
+	    float half = 0.5f * (sceneMax[axis] - sceneMin[axis]);
+	    radius += half * half;
+	}
+	_sceneBounds[3] = std::max(std::sqrt(radius), 1e-3f);
+    }
+
+    double loadMs = std::chrono::duration<double, std::milli>(
+		      std::chrono::steady_clock::now() - _sceneLoadStart)
+		      .count();
+    _meshStatistics = {
+	.meshes = static_cast<uint32_t>(_meshes.size()),
+	.triangles = _sceneData.triangles,
+	.bytesLoaded = _sceneData.bytes,
+	.loadMs = loadMs,
+	.mbPerSecond = megabytesPerSecond(_sceneData.bytes, loadMs / 1000.0),
+	.trianglesPerSecond = _sceneData.triangles / (loadMs / 1000.0),
+	.poolBytes = _meshPool.usedBytes(),
+    };
+    _sceneData = {};
 }
 
 void VulkanRenderer::initImguiBackend(GLFWwindow* wwindow) {
+    // The backend only allocates one combined image sampler per texture it
+    // displays, the font atlas being the only one for now. It also frees
+    // them individually, so it keeps a pool of its own.
     VkDescriptorPoolSize poolSizes[] = {
-	{ VK_DESCRIPTOR_TYPE_SAMPLER, 1000 },
-	{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000 },
-	{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000 },
-	{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000 },
-	{ VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000 },
-	{ VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000 },
-	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000 },
-	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000 },
-	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000 },
-	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000 },
-	{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000 }
+	{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, IMGUI_MAX_TEXTURES },
     };
     VkDescriptorPoolCreateInfo poolInfo = {
 	.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
 	.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
-	.maxSets = 1000,
+	.maxSets = IMGUI_MAX_TEXTURES,
 	.poolSizeCount = static_cast<uint32_t>(std::size(poolSizes)),
 	.pPoolSizes = poolSizes,
     };
@@ -384,21 +987,271 @@ void VulkanRenderer::initImguiBackend(GLFWwindow* wwindow) {
 	.Queue = _graphicsQueue,
 	.DescriptorPool = imguiPool,
 	.MinImageCount = 2,
-	.ImageCount = static_cast<uint32_t>(_frameOverlap),
+	.ImageCount = MAX_FRAMES_IN_FLIGHT,
 	.MSAASamples = VK_SAMPLE_COUNT_1_BIT,
+	.PipelineCache = _pipelineCache.cache,
 	.UseDynamicRendering = true
     };
+    // Headless frames draw the UI straight onto the draw image
     imguiVulkInitInfo.PipelineRenderingCreateInfo = {
 	.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
 	.colorAttachmentCount = 1,
-	.pColorAttachmentFormats = &_swapchainFormat
+	.pColorAttachmentFormats = _headless ? &_drawImage.imageFormat
+					     : &_swapchainFormat
     };
     ImGui_ImplVulkan_Init(&imguiVulkInitInfo);
     ImGui_ImplVulkan_CreateFontsTexture();
 
-    _deletionQueue.pushFunction([this, imguiPool]() {
-	vkDestroyDescriptorPool(_device, imguiPool, nullptr);
-    });
+    _deletionQueue.push(imguiPool);
+}
+
+void VulkanRenderer::buildRenderGraph() {
+    _renderGraph.init(_device, _allocator);
+    _renderGraph.setQueueFamilies(_graphicsQueueFamily, _computeQueueFamily);
+
+    RGResource draw = _renderGraph.createImage(
+      "Draw",
+      RGImageDesc{ .format = _drawImage.imageFormat,
+		   .extent = { _drawImage.imageExtent.width,
+			       _drawImage.imageExtent.height },
+		   .usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+			    VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+			    VK_IMAGE_USAGE_STORAGE_BIT |
+			    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT });
+
+    // The frame's own background image is swapped in every frame
+    _backgroundResource = _renderGraph.importImage(
+      "Background",
+      _frames[0].background.image,
+      _frames[0].background.imageView,
+      &_frames[0].background.state);
+    RGResource background = _backgroundResource;
+
+    // Every texel is written, so nothing needs to be preserved, which is
+    // also what lets it run on the compute queue
+    _renderGraph.addPass("Background")
+      .write(background, ImageUsage::ComputeWrite, true)
+      .asyncCompute()
+      .execute([this](VkCommandBuffer cmd) {
+	  // Compose falls back to a clear until the pipeline is compiled
+	  if (!_backgroundReady)
+	      return;
+	  vkCmdBindPipeline(
+	    cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _bgPipeline.get());
+	  struct {
+	      VkDeviceAddress frame;
+	      uint32_t image;
+	  } constants = { _frameConstantsAddress,
+			  getCurrentFrame().backgroundHandle };
+	  vkCmdPushConstants(cmd,
+			     _bindless.pipelineLayout,
+			     VK_SHADER_STAGE_ALL,
+			     0,
+			     sizeof(constants),
+			     &constants);
+	  // Same workgroup size the pipeline was specialized with
+	  vkCmdDispatch(cmd,
+			_bgWorkgroup.groupsX(_drawExtent.width),
+			_bgWorkgroup.groupsY(_drawExtent.height),
+			1);
+      });
+
+    _renderGraph.addPass("Compose")
+      .read(background, ImageUsage::TransferSrc)
+      .write(draw, ImageUsage::TransferDst, true)
+      .execute([this, background, draw](VkCommandBuffer cmd) {
+	  if (!_backgroundReady) {
+	      VkClearColorValue clear;
+	      std::copy_n(_frameConstants.clearColor, 4, clear.float32);
+	      VkImageSubresourceRange range =
+		getImageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
+	      vkCmdClearColorImage(cmd,
+				   _renderGraph.getImage(draw),
+				   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				   &clear,
+				   1,
+				   &range);
+	      return;
+	  }
+	  copyImageToImage(cmd,
+			   _renderGraph.getImage(background),
+			   _renderGraph.getImage(draw),
+			   _drawExtent,
+			   _drawExtent);
+      });
+
+    _renderGraph.addPass("Triangle")
+      .write(draw, ImageUsage::ColorAttachment)
+      .execute([this](VkCommandBuffer cmd) { drawTriangle(cmd); });
+
+    RGResource depth = _renderGraph.createImage(
+      "Depth",
+      RGImageDesc{ .format = DEPTH_FORMAT,
+		   .extent = { _drawImage.imageExtent.width,
+			       _drawImage.imageExtent.height },
+		   .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+			    VK_IMAGE_USAGE_SAMPLED_BIT,
+		   .aspect = VK_IMAGE_ASPECT_DEPTH_BIT });
+    // Culling rewrites the draws every frame, starting from empty counts
+    RGResource draws = _renderGraph.importBuffer(
+      "Draws", _gpuScene.drawBuffer(), &_gpuScene.drawState);
+    RGResource drawCount = _renderGraph.importBuffer(
+      "Draw count", _gpuScene.drawCountBuffer(), &_gpuScene.drawCountState);
+    RGResource occlusion = _renderGraph.importBuffer(
+      "Occlusion flags",
+      _gpuScene.occlusionBuffer(),
+      &_gpuScene.occlusionState);
+    // Appended to by both culling passes of a phase, see GpuScene
+    RGResource clusterTasks = _renderGraph.importBuffer(
+      "Cluster tasks",
+      _gpuScene.clusterTaskBuffer(),
+      &_gpuScene.clusterTaskState);
+    RGResource earlyDispatch = _renderGraph.importBuffer(
+      "Early cluster dispatch",
+      _gpuScene.clusterDispatchBuffer(EARLY_PHASE),
+      &_gpuScene.clusterDispatchStates[EARLY_PHASE]);
+    RGResource lateDispatch = _renderGraph.importBuffer(
+      "Late cluster dispatch",
+      _gpuScene.clusterDispatchBuffer(LATE_PHASE),
+      &_gpuScene.clusterDispatchStates[LATE_PHASE]);
+    // Kept from one frame to the next
+    RGResource pyramid = _renderGraph.importImage("Depth pyramid",
+						  _depthPyramid.image(),
+						  _depthPyramid.view(),
+						  &_depthPyramid.state);
+    _renderGraph.addPass("Clear draw count")
+      .writeBuffer(drawCount, BufferUsage::TransferDst)
+      .writeBuffer(earlyDispatch, BufferUsage::TransferDst)
+      .writeBuffer(lateDispatch, BufferUsage::TransferDst)
+      .execute([this](VkCommandBuffer cmd) {
+	  if (!_cullReady)
+	      return;
+	  vkCmdFillBuffer(cmd,
+			  _gpuScene.drawCountBuffer(),
+			  0,
+			  _gpuScene.drawCountOffset(GpuScene::PHASE_COUNT),
+			  0);
+	  if (!_clusterReady)
+	      return;
+	  for (uint32_t phase = 0; phase < GpuScene::PHASE_COUNT; phase++) {
+	      vkCmdFillBuffer(cmd,
+			      _gpuScene.clusterDispatchBuffer(phase),
+			      0,
+			      sizeof(GpuScene::ClusterDispatch),
+			      0);
+	  }
+      });
+    _renderGraph.addPass("Cull")
+      .read(pyramid, ImageUsage::ComputeRead)
+      .writeBuffer(drawCount, BufferUsage::ComputeReadWrite)
+      .writeBuffer(draws, BufferUsage::ComputeWrite)
+      .writeBuffer(occlusion, BufferUsage::ComputeWrite)
+      .writeBuffer(clusterTasks, BufferUsage::ComputeWrite)
+      .writeBuffer(earlyDispatch, BufferUsage::ComputeReadWrite)
+      .execute([this](VkCommandBuffer cmd) {
+	  cullInstances(cmd, EARLY_PHASE);
+      });
+    // Meshlets it finds occluded go to the late phase's tasks
+    _renderGraph.addPass("Cluster cull")
+      .read(pyramid, ImageUsage::ComputeRead)
+      .readBuffer(earlyDispatch, BufferUsage::IndirectComputeRead)
+      .writeBuffer(clusterTasks, BufferUsage::ComputeReadWrite)
+      .writeBuffer(lateDispatch, BufferUsage::ComputeReadWrite)
+      .writeBuffer(drawCount, BufferUsage::ComputeReadWrite)
+      .writeBuffer(draws, BufferUsage::ComputeWrite)
+      .execute([this](VkCommandBuffer cmd) {
+	  cullClusters(cmd, EARLY_PHASE);
+      });
+
+    _renderGraph.addPass("Meshes")
+      .readBuffer(draws, BufferUsage::IndirectRead)
+      .readBuffer(drawCount, BufferUsage::IndirectRead)
+      .write(draw, ImageUsage::ColorAttachment)
+      .write(depth, ImageUsage::DepthAttachment, true)
+      .execute([this, depth](VkCommandBuffer cmd) {
+	  _depthImageView = _renderGraph.getImageView(depth);
+	  drawMeshes(cmd, EARLY_PHASE);
+      });
+
+    // What the early phase drew occludes the rest. Instances it rejected
+    // against last frame's pyramid are tested again against this one, and
+    // drawn if they turn out visible.
+    _renderGraph.addPass("Depth pyramid")
+      .read(depth, ImageUsage::ComputeSampled)
+      .write(pyramid, ImageUsage::ComputeReadWrite)
+      .execute([this](VkCommandBuffer cmd) { buildDepthPyramid(cmd); });
+    _renderGraph.addPass("Late cull")
+      .read(pyramid, ImageUsage::ComputeRead)
+      .readBuffer(occlusion, BufferUsage::ComputeRead)
+      .writeBuffer(drawCount, BufferUsage::ComputeReadWrite)
+      .writeBuffer(draws, BufferUsage::ComputeWrite)
+      .writeBuffer(clusterTasks, BufferUsage::ComputeWrite)
+      .writeBuffer(lateDispatch, BufferUsage::ComputeReadWrite)
+      .execute([this](VkCommandBuffer cmd) {
+	  cullInstances(cmd, LATE_PHASE);
+      });
+    _renderGraph.addPass("Late cluster cull")
+      .read(pyramid, ImageUsage::ComputeRead)
+      .readBuffer(lateDispatch, BufferUsage::IndirectComputeRead)
+      .readBuffer(clusterTasks, BufferUsage::ComputeRead)
+      .writeBuffer(drawCount, BufferUsage::ComputeReadWrite)
+      .writeBuffer(draws, BufferUsage::ComputeWrite)
+      .execute([this](VkCommandBuffer cmd) {
+	  cullClusters(cmd, LATE_PHASE);
+      });
+    _renderGraph.addPass("Late meshes")
+      .readBuffer(draws, BufferUsage::IndirectRead)
+      .readBuffer(drawCount, BufferUsage::IndirectRead)
+      .write(draw, ImageUsage::ColorAttachment)
+      .write(depth, ImageUsage::DepthAttachment)
+      .execute([this](VkCommandBuffer cmd) {
+	  drawMeshes(cmd, LATE_PHASE);
+      });
+
+    if (_headless) {
+	// Nothing to present, the UI is drawn over the draw image itself
+	_renderGraph.addPass("ImGui")
+	  .write(draw, ImageUsage::ColorAttachment)
+	  .execute([this](VkCommandBuffer cmd) {
+	      drawImgui(cmd, _drawImage.imageView, _drawExtent);
+	  });
+	_renderGraph.markOutput(draw, ImageUsage::TransferSrc);
+    } else {
+	// The actual swapchain image is swapped in every frame after acquiring
+	_swapchainResource = _renderGraph.importImage(
+	  "Swapchain",
+	  _swapchainImages[0],
+	  _swapchainImageViews[0],
+	  &_swapchainImageStates[0]);
+	RGResource swapchain = _swapchainResource;
+
+	_renderGraph.addPass("Blit")
+	  .read(draw, ImageUsage::TransferSrc)
+	  .write(swapchain, ImageUsage::TransferDst, true)
+	  .execute([this, draw, swapchain](VkCommandBuffer cmd) {
+	      copyImageToImage(cmd,
+			       _renderGraph.getImage(draw),
+			       _renderGraph.getImage(swapchain),
+			       _drawExtent,
+			       _swapchainExtent);
+	  });
+
+	_renderGraph.addPass("ImGui")
+	  .write(swapchain, ImageUsage::ColorAttachment)
+	  .execute([this, swapchain](VkCommandBuffer cmd) {
+	      drawImgui(
+		cmd, _renderGraph.getImageView(swapchain), _swapchainExtent);
+	  });
+	_renderGraph.markOutput(swapchain, ImageUsage::Present);
+    }
+
+    _renderGraph.compile();
+    _drawImage.image = _renderGraph.getImage(draw);
+    _drawImage.imageView = _renderGraph.getImageView(draw);
+    _depthHandle = _bindless.addSampledImage(
+      _device,
+      _renderGraph.getImageView(depth),
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 }
 
 void VulkanRenderer::newImguiFrame() {
@@ -408,46 +1261,396 @@ void VulkanRenderer::newImguiFrame() {
 
 void VulkanRenderer::run(int frameNum) { draw(frameNum); }
 
+VkCommandBuffer VulkanRenderer::beginSecondary(
+  FrameData& frame,
+  const VkCommandBufferInheritanceRenderingInfo& renderingInfo) {
+    ThreadCommands& thread =
+      frame.threadCommands[JobSystem::currentThreadIndex()];
+    if (thread.used == thread.secondaries.size()) {
+	VkCommandBufferAllocateInfo bufferInfo = {
+	    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+	    .commandPool = thread.pool,
+	    .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+	    .commandBufferCount = 1,
+	};
+	VkCommandBuffer buffer;
+	VK_CHECK(vkAllocateCommandBuffers(_device, &bufferInfo, &buffer),
+		 "Could not allocate secondary command buffer");
+	thread.secondaries.push_back(buffer);
+    }
+    VkCommandBuffer cmd = thread.secondaries[thread.used++];
+
+    VkCommandBufferInheritanceInfo inheritanceInfo = {
+	.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+	.pNext = &renderingInfo
+    };
+    VkCommandBufferBeginInfo beginInfo = getCommandBufferBeginInfo(
+      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+      VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo),
+	     "Could not begin secondary command recording");
+    return cmd;
+}
+
+void VulkanRenderer::recordRendering(
+  VkCommandBuffer cmd, FrameData& frame, VkRenderingInfo renderInfo,
+  const VkCommandBufferInheritanceRenderingInfo& inheritanceInfo,
+  uint32_t drawCount, const RecordFn& record) {
+    uint32_t chunkCount = std::min(_jobs->threadCount(),
+				   drawCount / MIN_DRAWS_PER_SECONDARY);
+    if (!_parallelRecording || chunkCount < 2) {
+	vkCmdBeginRendering(cmd, &renderInfo);
+	record(cmd, 0, drawCount);
+	vkCmdEndRendering(cmd);
+	return;
+    }
+
+    // One secondary per chunk, executed in chunk order whichever thread
+    // recorded it
+    std::vector<VkCommandBuffer> secondaries(chunkCount);
+    JobCounter counter;
+    for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+	uint32_t begin = drawCount * chunk / chunkCount;
+	uint32_t end = drawCount * (chunk + 1) / chunkCount;
+	_jobs->run(
+	  [&, chunk, begin, end]() {
+	      VkCommandBuffer buffer = beginSecondary(frame, inheritanceInfo);
+	      record(buffer, begin, end);
+	      VK_CHECK(vkEndCommandBuffer(buffer),
+		       "Could not end secondary command recording");
+	      secondaries[chunk] = buffer;
+	  },
+	  &counter);
+    }
+    _jobs->wait(counter);
+
+    renderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+    vkCmdBeginRendering(cmd, &renderInfo);
+    vkCmdExecuteCommands(cmd, chunkCount, secondaries.data());
+    vkCmdEndRendering(cmd);
+}
+
 void VulkanRenderer::drawTriangle(const VkCommandBuffer& cmd) {
+    // Skipped until the pipeline is compiled
+    if (!_trianglePipeline.ready())
+	return;
+
     // Begin a render pass connected to our draw image
     VkRenderingAttachmentInfo colorAttachment = getAttachmentInfo(
       _drawImage.imageView, nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 
     VkRenderingInfo renderInfo = getRenderingInfo(
-      _swapchainExtent, &colorAttachment, nullptr);
-    vkCmdBeginRendering(cmd, &renderInfo);
+      _drawExtent, &colorAttachment, nullptr);
+    VkCommandBufferInheritanceRenderingInfo inheritanceInfo =
+      getInheritanceRenderingInfo(&_drawImage.imageFormat,
+				  VK_FORMAT_UNDEFINED);
+
+    // Secondaries inherit nothing but the attachments, so every chunk binds
+    // its own state
+    auto record = [this](VkCommandBuffer cmd, uint32_t begin, uint32_t end) {
+	vkCmdBindPipeline(
+	  cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _trianglePipeline.get());
+
+	// Dynamic viewport and scissor
+	// The vp defines the transformation from the image to the framebuffer
+	// The scissor rectangle define in which which regions pixels will
+	// actually be stored
+	// vp -> fit, scissor -> crop
+	VkViewport vp = {
+	    .x = 0,
+	    .y = 0,
+	    .width = static_cast<float>(_drawExtent.width),
+	    .height = static_cast<float>(_drawExtent.height),
+	    .minDepth = 0.0f,
+	    .maxDepth = 1.0f,
+	};
+	vkCmdSetViewport(cmd, 0, 1, &vp);
+
+	VkRect2D scissor = { .offset = { 0, 0 }, .extent = _drawExtent };
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
 
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _trianglePipeline);
-
-    // Dynamic viewport and scissor
-    // The vp defines the transformation from the image to the framebuffer
-    // The scissor rectangle define in which which regions pixels will actually
-    // be stored
-    // vp -> fit, scissor -> crop
-    VkViewport vp = {
-	.x = 0,
-	.y = 0,
-	.width = static_cast<float>(_swapchainExtent.width),
-	.height = static_cast<float>(_swapchainExtent.height),
-	.minDepth = 0.0f,
-	.maxDepth = 1.0f,
+	for (uint32_t i = begin; i < end; i++) {
+	    vkCmdDraw(cmd, 3, 1, 0, 0);
+	}
     };
-    vkCmdSetViewport(cmd, 0, 1, &vp);
+    recordRendering(cmd,
+		    getCurrentFrame(),
+		    renderInfo,
+		    inheritanceInfo,
+		    _triangleDraws,
+		    record);
+}
 
-    VkRect2D scissor = { .offset = { 0, 0 }, .extent = _swapchainExtent };
-    vkCmdSetScissor(cmd, 0, 1, &scissor);
+void VulkanRenderer::cullInstances(VkCommandBuffer cmd, uint32_t phase) {
+    uint32_t instanceCount = _gpuScene.instanceCount();
+    if (!_cullReady || instanceCount == 0)
+	return;
+    if (phase == LATE_PHASE && !_occlusionReady)
+	return;
+
+    // The early phase tests against last frame's pyramid, when there is one,
+    // the late phase against the one built this frame
+    bool occlusion = _occlusionReady &&
+		     (phase == LATE_PHASE || _pyramidValid);
+    VkExtent2D pyramidExtent = phase == LATE_PHASE ? _drawExtent
+						   : _pyramidExtent;
+    FrameData& frame = getCurrentFrame();
+    vkCmdBindPipeline(
+      cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipeline.get());
+    struct {
+	VkDeviceAddress frame;
+	VkDeviceAddress meshes;
+	VkDeviceAddress instances;
+	VkDeviceAddress draws;
+	VkDeviceAddress drawCount;
+	VkDeviceAddress statistics;
+	VkDeviceAddress occlusion;
+	VkDeviceAddress tasks;
+	VkDeviceAddress dispatch;
+	uint32_t instanceCount;
+	uint32_t phase;
+	uint32_t pyramid;
+	uint32_t pyramidLevels;
+	uint32_t pyramidWidth;
+	uint32_t pyramidHeight;
+	uint32_t clusterCulling;
+	uint32_t taskCapacity;
+    } constants = { _frameConstantsAddress,
+		    _gpuScene.meshAddress(),
+		    _gpuScene.instanceAddress(),
+		    _gpuScene.drawAddress(phase),
+		    _gpuScene.drawCountAddress(phase),
+		    frame.cullStatisticsAddress,
+		    _gpuScene.occlusionAddress(),
+		    _gpuScene.clusterTaskAddress(phase),
+		    _gpuScene.clusterDispatchAddress(phase),
+		    instanceCount,
+		    phase,
+		    _depthPyramid.handle(),
+		    occlusion ? _depthPyramid.levelCount(pyramidExtent) : 0,
+		    pyramidExtent.width,
+		    pyramidExtent.height,
+		    _clusterReady ? 1u : 0u,
+		    _gpuScene.clusterCapacity() };
+    vkCmdPushConstants(cmd,
+		       _bindless.pipelineLayout,
+		       VK_SHADER_STAGE_ALL,
+		       0,
+		       sizeof(constants),
+		       &constants);
+    vkCmdDispatch(cmd, CULL_WORKGROUP.groupsX(instanceCount), 1, 1);
+    if (!_clusterReady)
+	readStatisticsOnHost(cmd, phase);
+}
 
-    vkCmdDraw(cmd, 3, 1, 0, 0);
-    vkCmdEndRendering(cmd);
+void VulkanRenderer::cullClusters(VkCommandBuffer cmd, uint32_t phase) {
+    if (!_clusterReady || _gpuScene.instanceCount() == 0)
+	return;
+    if (phase == LATE_PHASE && !_occlusionReady)
+	return;
+
+    // Same pyramids as the instance passes. The early phase only has one
+    // when the late phase runs to retest what it rejects.
+    bool occlusion = _occlusionReady &&
+		     (phase == LATE_PHASE || _pyramidValid);
+    VkExtent2D pyramidExtent = phase == LATE_PHASE ? _drawExtent
+						   : _pyramidExtent;
+    FrameData& frame = getCurrentFrame();
+    vkCmdBindPipeline(
+      cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _clusterPipeline.get());
+    struct {
+	VkDeviceAddress frame;
+	VkDeviceAddress meshes;
+	VkDeviceAddress instances;
+	VkDeviceAddress meshlets;
+	VkDeviceAddress draws;
+	VkDeviceAddress drawCount;
+	VkDeviceAddress statistics;
+	VkDeviceAddress tasks;
+	VkDeviceAddress dispatch;
+	VkDeviceAddress lateTasks;
+	VkDeviceAddress lateDispatch;
+	uint32_t phase;
+	uint32_t pyramid;
+	uint32_t pyramidLevels;
+	uint32_t pyramidWidth;
+	uint32_t pyramidHeight;
+	uint32_t taskCapacity;
+	uint32_t drawCapacity;
+    } constants = { _frameConstantsAddress,
+		    _gpuScene.meshAddress(),
+		    _gpuScene.instanceAddress(),
+		    _gpuScene.meshletAddress(),
+		    _gpuScene.drawAddress(phase),
+		    _gpuScene.drawCountAddress(phase),
+		    frame.cullStatisticsAddress,
+		    _gpuScene.clusterTaskAddress(phase),
+		    _gpuScene.clusterDispatchAddress(phase),
+		    _gpuScene.clusterTaskAddress(LATE_PHASE),
+		    _gpuScene.clusterDispatchAddress(LATE_PHASE),
+		    phase,
+		    _depthPyramid.handle(),
+		    occlusion ? _depthPyramid.levelCount(pyramidExtent) : 0,
+		    pyramidExtent.width,
+		    pyramidExtent.height,
+		    _gpuScene.clusterCapacity(),
+		    _gpuScene.drawCapacity() };
+    static_assert(sizeof(constants) <= 128);
+    vkCmdPushConstants(cmd,
+		       _bindless.pipelineLayout,
+		       VK_SHADER_STAGE_ALL,
+		       0,
+		       sizeof(constants),
+		       &constants);
+    // Sized by the instance pass of the phase, and for the late phase by the
+    // early cluster pass as well
+    vkCmdDispatchIndirect(cmd, _gpuScene.clusterDispatchBuffer(phase), 0);
+    readStatisticsOnHost(cmd, phase);
+}
+
+void VulkanRenderer::readStatisticsOnHost(VkCommandBuffer cmd,
+					  uint32_t phase) {
+    // Statistics are read on the CPU once the frame has completed, after the
+    // last phase of the frame
+    if (phase == EARLY_PHASE && _occlusionReady)
+	return;
+    VkMemoryBarrier2 hostBarrier = {
+	.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+	.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+	.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+	.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+	.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT
+    };
+    VkDependencyInfo depInfo = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+				 .memoryBarrierCount = 1,
+				 .pMemoryBarriers = &hostBarrier };
+    vkCmdPipelineBarrier2(cmd, &depInfo);
+}
+
+void VulkanRenderer::buildDepthPyramid(VkCommandBuffer cmd) {
+    // Nothing would test against it, or nothing was drawn to build it from
+    if (!_occlusionReady || !_meshPipeline.ready() ||
+	_gpuScene.instanceCount() == 0) {
+	_pyramidValid = false;
+	return;
+    }
+    _depthPyramid.build(cmd,
+			_pyramidPipeline.get(),
+			_bindless.pipelineLayout,
+			_depthHandle,
+			_drawExtent);
+    _pyramidValid = true;
+    _pyramidExtent = _drawExtent;
+}
+
+void VulkanRenderer::drawMeshes(VkCommandBuffer cmd, uint32_t phase) {
+    if (_meshes.empty() || !_meshPipeline.ready())
+	return;
+    // Nothing was culled to draw from. Without GPU culling, everything is
+    // drawn in the early phase.
+    if (_gpuCulling && !_cullReady)
+	return;
+    if (phase == LATE_PHASE && !_occlusionReady)
+	return;
+
+    VkRenderingAttachmentInfo colorAttachment = getAttachmentInfo(
+      _drawImage.imageView, nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    // The late phase draws over the early one's depth
+    VkClearValue depthClear = { .depthStencil = { DEPTH_CLEAR, 0 } };
+    VkRenderingAttachmentInfo depthAttachment = getAttachmentInfo(
+      _depthImageView,
+      phase == EARLY_PHASE ? &depthClear : nullptr,
+      VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+
+    VkRenderingInfo renderInfo = getRenderingInfo(
+      _drawExtent, &colorAttachment, &depthAttachment);
+    VkCommandBufferInheritanceRenderingInfo inheritanceInfo =
+      getInheritanceRenderingInfo(&_drawImage.imageFormat, DEPTH_FORMAT);
+
+    // Secondaries inherit nothing but the attachments, so every chunk binds
+    // its own state. Draws find their mesh through their instance.
+    auto bind = [this](VkCommandBuffer cmd) {
+	vkCmdBindPipeline(
+	  cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _meshPipeline.get());
+	// Every mesh lives in the same buffers
+	vkCmdBindIndexBuffer(
+	  cmd, _meshPool.indexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+
+	VkViewport vp = {
+	    .x = 0,
+	    .y = 0,
+	    .width = static_cast<float>(_drawExtent.width),
+	    .height = static_cast<float>(_drawExtent.height),
+	    .minDepth = 0.0f,
+	    .maxDepth = 1.0f,
+	};
+	vkCmdSetViewport(cmd, 0, 1, &vp);
+	VkRect2D scissor = { .offset = { 0, 0 }, .extent = _drawExtent };
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+	struct {
+	    VkDeviceAddress frame;
+	    VkDeviceAddress vertices;
+	    VkDeviceAddress meshes;
+	    VkDeviceAddress instances;
+	} constants = { _frameConstantsAddress,
+			_meshPool.vertexAddress(),
+			_gpuScene.meshAddress(),
+			_gpuScene.instanceAddress() };
+	vkCmdPushConstants(cmd,
+			   _bindless.pipelineLayout,
+			   VK_SHADER_STAGE_ALL,
+			   0,
+			   sizeof(constants),
+			   &constants);
+    };
+
+    if (_gpuCulling) {
+	// One draw call whatever the instance count, the culling pass wrote
+	// the commands and their count
+	vkCmdBeginRendering(cmd, &renderInfo);
+	bind(cmd);
+	vkCmdDrawIndexedIndirectCount(cmd,
+				      _gpuScene.drawBuffer(),
+				      _gpuScene.drawOffset(phase),
+				      _gpuScene.drawCountBuffer(),
+				      _gpuScene.drawCountOffset(phase),
+				      _gpuScene.drawCapacity(),
+				      sizeof(VkDrawIndexedIndirectCommand));
+	vkCmdEndRendering(cmd);
+	return;
+    }
+
+    auto record = [this, &bind](VkCommandBuffer cmd, uint32_t begin,
+				uint32_t end) {
+	bind(cmd);
+	for (uint32_t i = begin; i < end; i++) {
+	    const MeshAllocation& mesh = _meshes[_instanceMeshes[i]].allocation;
+	    vkCmdDrawIndexed(cmd,
+			     mesh.indexCount,
+			     1,
+			     mesh.firstIndex,
+			     static_cast<int32_t>(mesh.firstVertex),
+			     i);
+	}
+    };
+    recordRendering(cmd,
+		    getCurrentFrame(),
+		    renderInfo,
+		    inheritanceInfo,
+		    static_cast<uint32_t>(_instanceMeshes.size()),
+		    record);
 }
 
 void VulkanRenderer::drawImgui(const VkCommandBuffer& cmd,
-			       VkImageView targetImageView) {
+			       VkImageView targetImageView,
+			       VkExtent2D targetExtent) {
     VkRenderingAttachmentInfo colorAttachment = getAttachmentInfo(
       targetImageView, nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 
     VkRenderingInfo renderInfo = getRenderingInfo(
-      _swapchainExtent, &colorAttachment, nullptr);
+      targetExtent, &colorAttachment, nullptr);
 
     vkCmdBeginRendering(cmd, &renderInfo);
 
@@ -456,112 +1659,381 @@ void VulkanRenderer::drawImgui(const VkCommandBuffer& cmd,
     vkCmdEndRendering(cmd);
 }
 
+void VulkanRenderer::recordPassStatistics(const char* name, double gpuMs,
+					  const ProfilerScopeResult* scope) {
+    auto it = std::find_if(
+      _passStatistics.begin(),
+      _passStatistics.end(),
+      [name](const PassStatistics& pass) { return pass.name == name; });
+    if (it == _passStatistics.end()) {
+	_passStatistics.push_back(PassStatistics{ .name = name });
+	it = _passStatistics.end() - 1;
+    }
+
+    it->gpuMs[it->historyOffset] = static_cast<float>(gpuMs);
+    it->historyOffset = (it->historyOffset + 1) % PassStatistics::HISTORY_SIZE;
+    if (scope) {
+	it->vertexInvocations = scope->vertexInvocations;
+	it->fragmentInvocations = scope->fragmentInvocations;
+	it->computeInvocations = scope->computeInvocations;
+    }
+}
+
+void VulkanRenderer::resolveProfiler(FrameData& frame) {
+    // The frame has already been waited on, so this never stalls
+    double frameMs = 0.0;
+    double computeMs = 0.0;
+    if (!frame.profiler.resolve(
+	  _device, _timestampPeriod, frameMs, computeMs, _scopeResults)) {
+	return;
+    }
+
+    _frameTimings.gpuFrame = frame.frameNum;
+    _frameTimings.gpuMs = frameMs;
+
+    // Measured at an earlier scale, which damping accounts for
+    if (_dynamicResolution)
+	_resolution.update(frameMs);
+
+    recordPassStatistics("Frame", frameMs, nullptr);
+    if (_asyncCompute)
+	recordPassStatistics("Compute queue", computeMs, nullptr);
+    for (const ProfilerScopeResult& scope : _scopeResults) {
+	recordPassStatistics(scope.name, scope.gpuMs, &scope);
+    }
+}
+
+void VulkanRenderer::waitForFrame(uint64_t value) {
+    if (value > _completedValue) {
+	VkSemaphoreWaitInfo waitInfo = {
+	    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+	    .semaphoreCount = 1,
+	    .pSemaphores = &_frameTimeline,
+	    .pValues = &value
+	};
+	VK_CHECK(vkWaitSemaphores(_device, &waitInfo, UINT64_MAX),
+		 "Could not wait for frame completion");
+    }
+    vkGetSemaphoreCounterValue(_device, _frameTimeline, &_completedValue);
+}
+
+void VulkanRenderer::setFramesInFlight(uint32_t count) {
+    count = std::clamp(count, uint32_t{ 1 }, MAX_FRAMES_IN_FLIGHT);
+    if (count == _framesInFlight)
+	return;
+
+    // Frames map to different slots afterwards, none may still be running
+    waitForFrame(_frameValue);
+    _framesInFlight = count;
+}
+
+void VulkanRenderer::waitForNextFrame() {
+    if (_frameWaited)
+	return;
+
+    // Normally only the frame that last used the next frame's resources is
+    // waited for, which leaves up to _framesInFlight - 1 frames running on
+    // the GPU. Low latency waits for the last one, so that input is sampled
+    // as late as possible.
+    FrameData& next = _frames[(_frameValue + 1) % _framesInFlight];
+    uint64_t value = _lowLatency ? _frameValue : next.timelineValue;
+    auto waitStart = std::chrono::steady_clock::now();
+    waitForFrame(value);
+    _inputTime = std::chrono::steady_clock::now();
+    _frameTimings.cpuWaitMs = std::chrono::duration<double, std::milli>(
+				_inputTime - waitStart)
+				.count();
+    _frameTimings.framesInFlight = _framesInFlight;
+    pollCompletedFrames();
+    _frameWaited = true;
+}
+
+void VulkanRenderer::pollCompletedFrames() {
+    vkGetSemaphoreCounterValue(_device, _frameTimeline, &_completedValue);
+    auto now = std::chrono::steady_clock::now();
+    uint64_t latest = 0;
+    for (FrameData& frame : _frames) {
+	if (!frame.latencyPending || frame.timelineValue > _completedValue)
+	    continue;
+	frame.latencyPending = false;
+	if (frame.timelineValue > latest) {
+	    latest = frame.timelineValue;
+	    std::chrono::duration<double, std::milli> latency =
+	      now - frame.inputTime;
+	    _frameTimings.inputLatencyMs = latency.count();
+	}
+    }
+}
+
+void VulkanRenderer::updatePipelines() {
+    _pipelineCompiler.update();
+    // Sampled once, so that every pass of the frame agrees
+    _backgroundReady = _bgPipeline.ready();
+    _cullReady = _gpuCulling && _cullPipeline.ready();
+    _occlusionReady = _cullReady && _occlusionCulling &&
+		      _pyramidPipeline.ready();
+    _clusterReady = _cullReady && _clusterCulling && _clusterPipeline.ready();
+
+    if (_pipelinesReady || !_pipelineCompiler.idle())
+	return;
+    _pipelinesReady = true;
+    _startupTimings.pipelinesMs = _pipelineCompiler.compileMs();
+}
+
 void VulkanRenderer::draw(int frameNum) {
-    // Wait for GPU to finish rendering
-    vkWaitForFences(
-      _device, 1, &getCurrentFrame(frameNum).renderFence, VK_TRUE, 1000000000);
-    vkResetFences(_device, 1, &getCurrentFrame(frameNum).renderFence);
+    waitForNextFrame();
+    _frameWaited = false;
+    // Before anything is acquired or reserved for the frame, since loading
+    // errors are rethrown
+    updateScene();
 
     // Request swapchain image index that we can blit on
-    uint32_t swapchainImgIndex;
-    VK_CHECK(vkAcquireNextImageKHR(_device,
-				   _swapchain,
-				   1000000,
-				   getCurrentFrame(frameNum).swapSemaphore,
-				   nullptr,
-				   &swapchainImgIndex),
-	     "Could not get swap chain image index");
+    uint32_t swapchainImgIndex = 0;
+    FrameData& frame = _frames[(_frameValue + 1) % _framesInFlight];
+    if (!_headless) {
+	// Some platforms never report a resized surface as out of date
+	int width = 0, height = 0;
+	glfwGetFramebufferSize(_window, &width, &height);
+	if (width == 0 || height == 0)
+	    return; // Minimized, there is nothing to present to
+	if (_swapchainDirty ||
+	    static_cast<uint32_t>(width) != _swapchainExtent.width ||
+	    static_cast<uint32_t>(height) != _swapchainExtent.height) {
+	    recreateSwapchain(width, height);
+	}
+
+	VkResult result = vkAcquireNextImageKHR(_device,
+						_swapchain,
+						UINT64_MAX,
+						frame.swapSemaphore,
+						VK_NULL_HANDLE,
+						&swapchainImgIndex);
+	// Nothing has been recorded yet, the frame is retried once the
+	// swapchain is rebuilt
+	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+	    _swapchainDirty = true;
+	    return;
+	}
+	if (result == VK_SUBOPTIMAL_KHR)
+	    _swapchainDirty = true;
+	else
+	    VK_CHECK(result, "Could not get swap chain image index");
+    }
+
+    _frameValue++;
+    frame.inputTime = _inputTime;
+    frame.latencyPending = true;
+    updatePipelines();
+    _retireQueue.flush(_device, _allocator, _completedValue);
+    frame.linearAllocator.reset();
+    for (ThreadCommands& thread : frame.threadCommands) {
+	VK_CHECK(vkResetCommandPool(_device, thread.pool, 0),
+		 "Could not reset thread command pool");
+	thread.used = 0;
+    }
+    resolveProfiler(frame);
+    if (_gpuCulling) {
+	// Written by the culling passes of the frame that last used these
+	// resources, which has completed: instances in the frustum, then
+	// instances drawn by either phase, then clusters and triangles of
+	// those before and after cluster culling
+	auto* counts = static_cast<uint32_t*>(
+	  frame.cullStatistics.info.pMappedData);
+	vmaInvalidateAllocation(
+	  _allocator, frame.cullStatistics.allocation, 0, VK_WHOLE_SIZE);
+	if (frame.frameNum >= 0) {
+	    uint32_t inFrustum = std::min(counts[0], _cullStatistics.instances);
+	    uint32_t drawn = std::min(counts[1], inFrustum);
+	    _cullStatistics.visibleInstances = drawn;
+	    _cullStatistics.frustumCulled = _cullStatistics.instances -
+					    inFrustum;
+	    _cullStatistics.occlusionCulled = inFrustum - drawn;
+	    _cullStatistics.clusters = counts[2];
+	    _cullStatistics.clustersDrawn = std::min(counts[3], counts[2]);
+	    _cullStatistics.triangles = counts[4];
+	    _cullStatistics.trianglesDrawn = std::min(counts[5], counts[4]);
+	}
+	std::fill_n(counts, CULL_STATISTICS_COUNT, 0);
+	vmaFlushAllocation(
+	  _allocator, frame.cullStatistics.allocation, 0, VK_WHOLE_SIZE);
+    } else {
+	// Every instance is drawn whole
+	_cullStatistics.visibleInstances = _cullStatistics.instances;
+	_cullStatistics.frustumCulled = 0;
+	_cullStatistics.occlusionCulled = 0;
+	_cullStatistics.clusters = _cullStatistics.instances;
+	_cullStatistics.clustersDrawn = _cullStatistics.instances;
+	_cullStatistics.triangles = _sceneTriangles;
+	_cullStatistics.trianglesDrawn = _sceneTriangles;
+    }
+    _cullStatistics.gpuCulling = _gpuCulling;
+    _cullStatistics.occlusionCulling = _occlusionCulling;
+    _cullStatistics.clusterCulling = _clusterCulling;
+    updateDrawExtent();
+    frame.frameNum = frameNum;
+    frame.timelineValue = _frameValue;
+    _bindless.beginFrame(_frameValue);
+    _uploader.update();
 
     // Usual command workflow is : 1. wait / 2. reset / 3. begin / 4. record
     // / 5. submit to queue
-    VkCommandBuffer cmd = getCurrentFrame(frameNum).mainCommandBuffer;
+    VkCommandBuffer cmd = frame.mainCommandBuffer;
     VK_CHECK(vkResetCommandBuffer(cmd, 0), "Could not reset command buffer");
     VkCommandBufferBeginInfo cmdBeginInfo = getCommandBufferBeginInfo(
       VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
     VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo),
 	     "Could not begin command recording");
 
-    createImageBarrierWithTransition(cmd,
-				     _drawImage.image,
-				     VK_IMAGE_LAYOUT_UNDEFINED,
-				     VK_IMAGE_LAYOUT_GENERAL);
+    // Compute passes get their own command buffer when they run on the
+    // compute queue, it is submitted first
+    VkCommandBuffer computeCmd = VK_NULL_HANDLE;
+    if (_renderGraph.usesAsyncCompute()) {
+	computeCmd = frame.computeCommandBuffer;
+	VK_CHECK(vkResetCommandBuffer(computeCmd, 0),
+		 "Could not reset compute command buffer");
+	VK_CHECK(vkBeginCommandBuffer(computeCmd, &cmdBeginInfo),
+		 "Could not begin compute command recording");
+	vkCmdBindDescriptorSets(computeCmd,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				_bindless.pipelineLayout,
+				0,
+				1,
+				&_bindless.set,
+				0,
+				nullptr);
+    }
 
+    // The frame's previous submissions have completed
+    GpuProfiler& profiler = frame.profiler;
+    profiler.beginFrame(_device, cmd, computeCmd);
+
+    // The bindless set stays bound for the whole primary command buffer
+    VkPipelineBindPoint bindPoints[] = { VK_PIPELINE_BIND_POINT_COMPUTE,
+					 VK_PIPELINE_BIND_POINT_GRAPHICS };
+    for (VkPipelineBindPoint bindPoint : bindPoints) {
+	vkCmdBindDescriptorSets(cmd,
+				bindPoint,
+				_bindless.pipelineLayout,
+				0,
+				1,
+				&_bindless.set,
+				0,
+				nullptr);
+    }
+
+    _frameNum = frameNum;
     float bValue = 0.5 + 0.5 * std::sin(static_cast<float>(frameNum) / 120.0);
-    VkClearColorValue clearValue = { 0.0, 0.0, bValue, 1.0 };
-    VkImageSubresourceRange srcRange = getImageSubresourceRange(
-      VK_IMAGE_ASPECT_COLOR_BIT);
-    vkCmdClearColorImage(cmd,
-			 _drawImage.image,
-			 VK_IMAGE_LAYOUT_GENERAL,
-			 &clearValue,
-			 1,
-			 &srcRange);
-
-    createImageBarrier(cmd, _drawImage.image, VK_IMAGE_LAYOUT_GENERAL);
-
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _bgPipeline);
-    vkCmdBindDescriptorSets(cmd,
-			    VK_PIPELINE_BIND_POINT_COMPUTE,
-			    _bgPipelineLayout,
-			    0,
-			    1,
-			    &_bgDescriptors,
-			    0,
-			    nullptr);
-    vkCmdDispatch(cmd,
-		  std::ceil(_drawImage.imageExtent.width / 16.0),
-		  std::ceil(_drawImage.imageExtent.height / 16.0),
-		  1);
-
-    createImageBarrierWithTransition(cmd,
-				     _drawImage.image,
-				     VK_IMAGE_LAYOUT_GENERAL,
-				     VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-    drawTriangle(cmd);
-
-    // Copy draw image content onto the swap chain image
-    createImageBarrierWithTransition(cmd,
-				     _drawImage.image,
-				     VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-				     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-    createImageBarrierWithTransition(cmd,
-				     _swapchainImages[swapchainImgIndex],
-				     VK_IMAGE_LAYOUT_UNDEFINED,
-				     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    copyImageToImage(cmd,
-		     _drawImage.image,
-		     _swapchainImages[swapchainImgIndex],
-		     _swapchainExtent,
-		     _swapchainExtent);
-
-    createImageBarrierWithTransition(cmd,
-				     _swapchainImages[swapchainImgIndex],
-				     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				     VK_IMAGE_LAYOUT_GENERAL);
-    drawImgui(cmd, _swapchainImageViews[swapchainImgIndex]);
-
-    createImageBarrierWithTransition(cmd,
-				     _swapchainImages[swapchainImgIndex],
-				     VK_IMAGE_LAYOUT_GENERAL,
-				     VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    _frameConstants = { .clearColor = { 0.0, 0.0, bValue, 1.0 },
+			.frameNum = static_cast<uint32_t>(frameNum),
+			.renderWidth = _drawExtent.width,
+			.renderHeight = _drawExtent.height };
+    // The camera orbits the scene
+    OrbitCamera camera = {
+	.distance = _cameraDistance,
+	.angle = static_cast<float>(frameNum) * 0.005f,
+	.aspect = static_cast<float>(_drawExtent.width) / _drawExtent.height
+    };
+    std::copy_n(_sceneBounds, 4, camera.bounds);
+    CameraMatrices matrices = computeCameraMatrices(camera);
+    std::copy_n(matrices.view, 16, _frameConstants.view);
+    std::copy_n(matrices.viewProj, 16, _frameConstants.viewProj);
+    std::copy_n(&matrices.frustum[0][0], 24, &_frameConstants.frustum[0][0]);
+    std::copy_n(matrices.projection, 4, _frameConstants.projection);
+    std::copy_n(_camera.view, 16, _frameConstants.prevView);
+    std::copy_n(_camera.projection, 4, _frameConstants.prevProjection);
+    std::copy_n(matrices.position, 4, _frameConstants.cameraPosition);
+    _camera = matrices;
+    _frameConstantsAddress =
+      frame.linearAllocator.push(_frameConstants).address;
+    if (!_headless) {
+	ImageState& swapchainState = _swapchainImageStates[swapchainImgIndex];
+	// The image is only ready once the acquire semaphore wait is over
+	swapchainState = { .layout = VK_IMAGE_LAYOUT_UNDEFINED,
+			   .stage = SWAPCHAIN_WAIT_STAGE };
+	_renderGraph.setImportedImage(_swapchainResource,
+				      _swapchainImages[swapchainImgIndex],
+				      _swapchainImageViews[swapchainImgIndex],
+				      &swapchainState);
+    }
+    // Its last use completed before this frame's resources were reused
+    frame.background.state = {};
+    _renderGraph.setImportedImage(_backgroundResource,
+				  frame.background.image,
+				  frame.background.imageView,
+				  &frame.background.state);
+    // Barriers are derived from the uses each pass declared
+    _renderGraph.execute(cmd, &profiler, computeCmd);
+
+    profiler.endFrame(cmd, computeCmd);
+    frame.linearAllocator.flush(_allocator);
 
     VK_CHECK(vkEndCommandBuffer(cmd), "Could not end command recording");
 
     // We finished drawing, time to submit
     VkCommandBufferSubmitInfo cmdSubmitInfo = getCommandBufferSubmitInfo(cmd);
-    VkSemaphoreSubmitInfo waitInfo = getSemaphoreSubmitInfo(
-      VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
-      getCurrentFrame(frameNum).swapSemaphore);
-    VkSemaphoreSubmitInfo signalInfo = getSemaphoreSubmitInfo(
-      VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR,
-      getCurrentFrame(frameNum).renderSemaphore);
-    VkSubmitInfo2 submitInfo = getSubmitInfo(
-      &cmdSubmitInfo, &signalInfo, &waitInfo);
-
-    VK_CHECK(
-      vkQueueSubmit2(
-	_graphicsQueue, 1, &submitInfo, getCurrentFrame(frameNum).renderFence),
-      "Could not submit graphics commands to queue");
+    VkSemaphoreSubmitInfo waitInfos[3] = { getSemaphoreSubmitInfo(
+      SWAPCHAIN_WAIT_STAGE, frame.swapSemaphore) };
+    VkSemaphoreSubmitInfo signalInfos[2] = {
+	getSemaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			       _frameTimeline),
+	getSemaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			       frame.renderSemaphore)
+    };
+    signalInfos[0].value = _frameValue;
+    // Headless frames neither acquire nor present, so there is nothing to
+    // wait on or signal besides the frame timeline
+    uint32_t waitCount = _headless ? 0 : 1;
+    uint32_t signalCount = _headless ? 1 : 2;
+
+    // Copies recorded during the frame go out in one batch, which the frame
+    // waits for on the GPU instead of blocking here
+    _uploader.flush();
+    VkSemaphoreSubmitInfo uploadWait = getSemaphoreSubmitInfo(
+      VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _uploader.timeline());
+    uploadWait.value = _uploader.pendingValue();
+    if (uploadWait.value != 0)
+	waitInfos[waitCount++] = uploadWait;
+
+    if (computeCmd != VK_NULL_HANDLE) {
+	VK_CHECK(vkEndCommandBuffer(computeCmd),
+		 "Could not end compute command recording");
+	VkCommandBufferSubmitInfo computeCmdInfo = getCommandBufferSubmitInfo(
+	  computeCmd);
+	VkSemaphoreSubmitInfo computeSignal = getSemaphoreSubmitInfo(
+	  VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _computeTimeline);
+	computeSignal.value = _frameValue;
+	VkSubmitInfo2 computeSubmitInfo = getSubmitInfo(
+	  &computeCmdInfo,
+	  &computeSignal,
+	  uploadWait.value != 0 ? &uploadWait : nullptr);
+	VK_CHECK(
+	  vkQueueSubmit2(_computeQueue, 1, &computeSubmitInfo, VK_NULL_HANDLE),
+	  "Could not submit compute commands to queue");
+
+	// Graphics work before the first use of a compute result can start
+	// right away
+	waitInfos[waitCount] = getSemaphoreSubmitInfo(
+	  _renderGraph.computeWaitStages(), _computeTimeline);
+	waitInfos[waitCount].value = _frameValue;
+	waitCount++;
+    }
+
+    VkSubmitInfo2 submitInfo = getSubmitInfo(&cmdSubmitInfo, nullptr, nullptr);
+    submitInfo.waitSemaphoreInfoCount = waitCount;
+    submitInfo.pWaitSemaphoreInfos = waitInfos;
+    submitInfo.signalSemaphoreInfoCount = signalCount;
+    submitInfo.pSignalSemaphoreInfos = signalInfos;
+
+    VK_CHECK(vkQueueSubmit2(_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE),
+	     "Could not submit graphics commands to queue");
+    if (_startupTimings.firstFrameMs == 0.0) {
+	auto elapsed = std::chrono::steady_clock::now() - _initStart;
+	_startupTimings.firstFrameMs =
+	  std::chrono::duration<double, std::milli>(elapsed).count();
+    }
+
+    if (_headless)
+	return;
 
     // We wait for rendering operations to finish and we
     // present
@@ -569,22 +2041,25 @@ void VulkanRenderer::draw(int frameNum) {
 	.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
 	.pNext = nullptr,
 	.waitSemaphoreCount = 1,
-	.pWaitSemaphores = &getCurrentFrame(frameNum).renderSemaphore,
+	.pWaitSemaphores = &frame.renderSemaphore,
 	.swapchainCount = 1,
 	.pSwapchains = &_swapchain,
 	.pImageIndices = &swapchainImgIndex
     };
-    VK_CHECK(vkQueuePresentKHR(_graphicsQueue, &presentInfo),
-	     "Could not present");
+    VkResult result = vkQueuePresentKHR(_graphicsQueue, &presentInfo);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+	_swapchainDirty = true;
+    else
+	VK_CHECK(result, "Could not present");
+    pollCompletedFrames();
 }
 
 void VulkanRenderer::cleanup() {
+    _jobs->wait(_sceneLoad);
     vkDeviceWaitIdle(_device);
     ImGui_ImplVulkan_Shutdown();
-    for (auto& frame : _frames) {
-	frame.deletionQueue.flush();
-    }
-    _deletionQueue.flush();
+    _retireQueue.flush(_device, _allocator);
+    _deletionQueue.flush(_device, _allocator);
 }
 
 } // namespace vk
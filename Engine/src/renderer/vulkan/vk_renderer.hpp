@@ -1,74 +1,225 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
-#include <deque>
-#include <functional>
+#include <exception>
+#include <string>
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan.h>
 #include <vk_mem_alloc.h>
 #include <vulkan/vulkan_core.h>
 
+#include "../dynamic_resolution.hpp"
 #include "../renderer.hpp"
+#include "core/job_system.hpp"
+#include "renderer/camera.hpp"
+#include "scene/mesh_data.hpp"
+#include "renderer/vulkan/vk_bindless.hpp"
+#include "renderer/vulkan/vk_compute_tuner.hpp"
+#include "renderer/vulkan/vk_depth_pyramid.hpp"
 #include "renderer/vulkan/vk_descriptors.hpp"
+#include "renderer/vulkan/vk_frame_allocator.hpp"
+#include "renderer/vulkan/vk_gpu_scene.hpp"
+#include "renderer/vulkan/vk_mesh_pool.hpp"
+#include "renderer/vulkan/vk_barriers.hpp"
+#include "renderer/vulkan/vk_deletion_queue.hpp"
+#include "renderer/vulkan/vk_pipeline_cache.hpp"
+#include "renderer/vulkan/vk_pipeline_compiler.hpp"
+#include "renderer/vulkan/vk_profiler.hpp"
+#include "renderer/vulkan/vk_render_graph.hpp"
+#include "renderer/vulkan/vk_upload.hpp"
 
 namespace baldwin {
 namespace vk {
 
-struct DeletionQueue {
-    std::deque<std::function<void()>> deletors;
-
-    void pushFunction(std::function<void()>&& function) {
-	deletors.push_back(function);
-    }
+// Secondary command buffers recorded by one job thread. The pool is reset
+// once per frame, and its buffers are reused in order.
+struct ThreadCommands {
+    VkCommandPool pool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> secondaries;
+    uint32_t used = 0;
+};
 
-    void flush() {
-	// reverse iterate the deletion queue to execute all the functions
-	for (auto it = deletors.rbegin(); it != deletors.rend(); it++) {
-	    (*it)(); // call the function
-	}
-	deletors.clear();
-    }
+struct AllocatedImage {
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView imageView = VK_NULL_HANDLE;
+    VmaAllocation allocation = VK_NULL_HANDLE;
+    VkExtent3D imageExtent = {};
+    VkFormat imageFormat = VK_FORMAT_UNDEFINED;
+    ImageState state{};
 };
 
 struct FrameData {
     VkCommandPool commandPool = VK_NULL_HANDLE;
     VkCommandBuffer mainCommandBuffer = VK_NULL_HANDLE;
-    VkFence renderFence = VK_NULL_HANDLE;
+    // Async compute work, submitted before the main command buffer
+    VkCommandPool computeCommandPool = VK_NULL_HANDLE;
+    VkCommandBuffer computeCommandBuffer = VK_NULL_HANDLE;
+    // Indexed by job thread
+    std::vector<ThreadCommands> threadCommands;
+    // Frame timeline value signalled by the last submission using this
+    // frame, its resources are free once the timeline reaches it
+    uint64_t timelineValue = 0;
+    int frameNum = -1;
+    std::chrono::steady_clock::time_point inputTime;
+    // Until its completion has been seen, see pollCompletedFrames
+    bool latencyPending = false;
     VkSemaphore swapSemaphore = VK_NULL_HANDLE;
     VkSemaphore renderSemaphore = VK_NULL_HANDLE;
-    DeletionQueue deletionQueue;
+    GpuProfiler profiler;
+    // Constants and other data shaders read this frame, through their
+    // device address
+    FrameAllocator linearAllocator;
+    // Written by the background compute pass. Each frame has its own, so
+    // that the compute queue can fill it while the graphics queue still
+    // reads the previous frame's.
+    AllocatedImage background{};
+    uint32_t backgroundHandle = 0;
+    // Host visible counts of what the culling passes kept, read
+    // back once the frame has completed
+    AllocatedBuffer cullStatistics{};
+    VkDeviceAddress cullStatisticsAddress = 0;
 };
 
-struct AllocatedImage {
-    VkImage image = VK_NULL_HANDLE;
-    VkImageView imageView = VK_NULL_HANDLE;
-    VmaAllocation allocation = VK_NULL_HANDLE;
-    VkExtent3D imageExtent = {};
-    VkFormat imageFormat = VK_FORMAT_UNDEFINED;
+struct MeshDraw {
+    MeshAllocation allocation;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+// Matches FrameConstants in the shaders, std430 layout
+struct FrameConstants {
+    float clearColor[4];
+    uint32_t frameNum;
+    // Region of the draw image rendered this frame
+    uint32_t renderWidth;
+    uint32_t renderHeight;
+    uint32_t pad;
+    // Camera, see CameraMatrices
+    float view[16];
+    float viewProj[16];
+    float frustum[6][4];
+    float projection[4];
+    // Camera of the previous frame, which built the depth pyramid the early
+    // culling phase tests against
+    float prevView[16];
+    float prevProjection[4];
+    // World space, for the cluster cone test
+    float cameraPosition[4];
 };
 
 class VulkanRenderer : public Renderer {
   public:
     bool init(GLFWwindow* window, int width, int height,
-	      bool tripleBuffering) override;
+	      const RendererSettings& settings, JobSystem& jobs) override;
     void run(int frameNum) override;
     void newImguiFrame() override;
     void cleanup() override;
+    void setFramesInFlight(uint32_t count) override;
+    void waitForNextFrame() override;
+    void setPresentMode(PresentMode mode) override;
+    PresentMode getPresentMode() const override { return _presentMode; }
+    void setLowLatency(bool enabled) override { _lowLatency = enabled; }
+    void setDynamicResolution(bool enabled, double targetMs) override;
+    FrameTimings getFrameTimings() const override { return _frameTimings; }
+    StartupTimings getStartupTimings() const override {
+	return _startupTimings;
+    }
+    const std::vector<PassStatistics>& getPassStatistics() const override {
+	return _passStatistics;
+    }
+    UploadStatistics getUploadStatistics() const override {
+	return _uploader.statistics();
+    }
+    PsoCacheStatistics getPsoCacheStatistics() const override {
+	return _pipelineCompiler.getStatistics();
+    }
+    MeshStatistics getMeshStatistics() const override {
+	return _meshStatistics;
+    }
+    CullStatistics getCullStatistics() const override {
+	return _cullStatistics;
+    }
+    RenderGraphStatistics getRenderGraphStatistics() const override {
+	return { .passes = _renderGraph.passCount(),
+		 .culledPasses = _renderGraph.culledPassCount(),
+		 .computePasses = _renderGraph.asyncPassCount(),
+		 .computeFallbacks = _renderGraph.graphicsFallbackCount(),
+		 .transientBytes = _renderGraph.transientMemorySize(),
+		 .unaliasedBytes = _renderGraph.unaliasedMemorySize() };
+    }
 
   private:
     void initVulkan(GLFWwindow* window);
     void createSwapchain(int width, int height);
+    void destroySwapchain(VkSwapchainKHR swapchain,
+			  std::vector<VkImageView>& imageViews);
+    // Also resizes the render targets when the extent changed
+    void recreateSwapchain(int width, int height);
+    // Reallocates everything sized like the swapchain: the draw and depth
+    // images, the background images and the depth pyramid
+    void resizeRenderTargets();
+    void createDrawImage(int width, int height);
+    // Picks the region of the draw image rendered this frame
+    void updateDrawExtent();
     void createCommands();
+    void createBackgroundImages();
+    void destroyBackgroundImages();
+    void retireBackgroundImages(DeletionQueue& queue, uint64_t retireValue);
     void createSync();
     void initDescriptors();
-    void initBackgroundPipeline();
+    void initBackgroundPipeline(bool tune);
+    // Polls pending pipelines once per frame, before recording
+    void updatePipelines();
     void initTrianglePipeline();
+    void initMeshPipeline();
+    void initCullPipeline();
+    void loadScene(const std::string& path);
+    // Uploads the scene once loaded, rethrowing loading errors
+    void updateScene();
     void initImguiBackend(GLFWwindow* window);
+    void buildRenderGraph();
+    using RecordFn =
+      std::function<void(VkCommandBuffer cmd, uint32_t begin, uint32_t end)>;
+    VkCommandBuffer beginSecondary(
+      FrameData& frame,
+      const VkCommandBufferInheritanceRenderingInfo& renderingInfo);
+    void recordRendering(VkCommandBuffer cmd, FrameData& frame,
+			 VkRenderingInfo renderInfo,
+			 const VkCommandBufferInheritanceRenderingInfo&
+			   inheritanceInfo,
+			 uint32_t drawCount, const RecordFn& record);
     void drawTriangle(const VkCommandBuffer& cmd);
-    void drawImgui(const VkCommandBuffer& cmd, VkImageView targetImageView);
+    // Phases are indexed as in GpuScene, the late one only runs with
+    // occlusion culling
+    void cullInstances(VkCommandBuffer cmd, uint32_t phase);
+    // Tests the meshlets of the instances a phase kept
+    void cullClusters(VkCommandBuffer cmd, uint32_t phase);
+    // Makes the culling statistics visible to the host after the last pass
+    // writing them, given the phase of the current one
+    void readStatisticsOnHost(VkCommandBuffer cmd, uint32_t phase);
+    void drawMeshes(VkCommandBuffer cmd, uint32_t phase);
+    void buildDepthPyramid(VkCommandBuffer cmd);
+    void drawImgui(const VkCommandBuffer& cmd, VkImageView targetImageView,
+		   VkExtent2D targetExtent);
+    void waitForFrame(uint64_t value);
+    // Records the input latency of the last frame the GPU completed, once.
+    // Polled after presenting and before each frame, so that it is seen
+    // complete within a frame rather than when its slot is reused.
+    void pollCompletedFrames();
+    void resolveProfiler(FrameData& frame);
+    void recordPassStatistics(const char* name, double gpuMs,
+			      const ProfilerScopeResult* scope);
     void draw(int frameNum);
 
     // General
+    bool _headless = false;
+    bool _pipelineStatistics = false;
+    bool _parallelRecording = true;
+    uint32_t _triangleDraws = 1;
+    bool _asyncCompute = true;
+    JobSystem* _jobs = nullptr;
+    GLFWwindow* _window = nullptr;
     VkInstance _instance = VK_NULL_HANDLE;
     VkPhysicalDevice _gpu = VK_NULL_HANDLE;
     VkDevice _device = VK_NULL_HANDLE;
@@ -76,28 +227,121 @@ class VulkanRenderer : public Renderer {
     VkSwapchainKHR _swapchain = VK_NULL_HANDLE;
     VkFormat _swapchainFormat = VK_FORMAT_UNDEFINED;
     std::vector<VkImage> _swapchainImages;
+    std::vector<ImageState> _swapchainImageStates;
     std::vector<VkImageView> _swapchainImageViews;
     VkExtent2D _swapchainExtent = { 0, 0 };
+    PresentMode _requestedPresentMode = PresentMode::Fifo;
+    PresentMode _presentMode = PresentMode::Fifo;
+    // Set when the surface changed or presentation reported it, the
+    // swapchain is rebuilt before the next acquire
+    bool _swapchainDirty = false;
     VkQueue _graphicsQueue = VK_NULL_HANDLE;
     uint32_t _graphicsQueueFamily;
+    VkQueue _transferQueue = VK_NULL_HANDLE;
+    uint32_t _transferQueueFamily;
+    VkQueue _computeQueue = VK_NULL_HANDLE;
+    uint32_t _computeQueueFamily;
     VmaAllocator _allocator{};
+    float _timestampPeriod = 1.0f;
 
     // Resources
+    // Allocated at full resolution, of which only _drawExtent is rendered
     AllocatedImage _drawImage{};
-    VkDescriptorSetLayout _bgSetLayout = VK_NULL_HANDLE;
-    VkDescriptorSet _bgDescriptors = VK_NULL_HANDLE;
-    VkPipelineLayout _bgPipelineLayout = VK_NULL_HANDLE;
-    VkPipeline _bgPipeline = VK_NULL_HANDLE;
+    VkExtent2D _drawExtent = { 0, 0 };
+    ResolutionController _resolution{};
+    bool _dynamicResolution = false;
+    float _minRenderScale = 0.5f;
+    PipelineHandle _bgPipeline{};
+    // Whether _bgPipeline was compiled when the current frame started
+    bool _backgroundReady = false;
+    WorkgroupSize _bgWorkgroup{};
+    ComputeTuner _computeTuner{};
     VkPipelineLayout _trianglePipelineLayout = VK_NULL_HANDLE;
-    VkPipeline _trianglePipeline = VK_NULL_HANDLE;
+    PipelineHandle _trianglePipeline{};
+    PipelineHandle _meshPipeline{};
+    PipelineHandle _cullPipeline{};
+    // Whether culling runs this frame, sampled like _backgroundReady
+    bool _cullReady = false;
+    PipelineHandle _pyramidPipeline{};
+    // Whether occlusion culling runs this frame, sampled like _cullReady
+    bool _occlusionReady = false;
+    PipelineHandle _clusterPipeline{};
+    // Whether cluster culling runs this frame, sampled like _cullReady
+    bool _clusterReady = false;
+    // Depth of the Meshes pass, placed by the render graph
+    VkImageView _depthImageView = VK_NULL_HANDLE;
+    // Sampled bindless handle of the same depth
+    uint32_t _depthHandle = 0;
+
+    MeshPool _meshPool{};
+    std::vector<MeshDraw> _meshes;
+    // Mesh and instance tables, and the draws culling writes
+    GpuScene _gpuScene{};
+    bool _gpuCulling = true;
+    bool _occlusionCulling = true;
+    bool _clusterCulling = true;
+    DepthPyramid _depthPyramid{};
+    // Whether the previous frame built the pyramid, and from what extent
+    bool _pyramidValid = false;
+    VkExtent2D _pyramidExtent = { 0, 0 };
+    // Of the previous frame once a new one starts
+    CameraMatrices _camera{};
+    uint32_t _instancedScene = 0;
+    // Mesh of every instance, for drawing them from the CPU
+    std::vector<uint32_t> _instanceMeshes;
+    // Of every instance, all drawn without GPU culling
+    uint64_t _sceneTriangles = 0;
+    CullStatistics _cullStatistics{};
+    float _cameraDistance = 2.5f;
+    // Bounding sphere of every mesh, center and radius
+    float _sceneBounds[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    // Filled by the loading job, owned by the main thread once it's done
+    JobCounter _sceneLoad;
+    bool _sceneLoading = false;
+    SceneData _sceneData;
+    std::exception_ptr _sceneError;
+    std::chrono::steady_clock::time_point _sceneLoadStart{};
+    MeshStatistics _meshStatistics{};
+    PipelineCache _pipelineCache{};
+    PipelineCompiler _pipelineCompiler{};
+    bool _pipelinesReady = false;
+    RenderGraph _renderGraph{};
+    RGResource _swapchainResource = 0;
+    RGResource _backgroundResource = 0;
 
     // Helpers
     DeletionQueue _deletionQueue;
-    DescriptorAllocator _descriptorAllocator{};
+    BindlessHeap _bindless{};
+    Uploader _uploader{};
+    // Always MAX_FRAMES_IN_FLIGHT of them, only the first _framesInFlight
+    // are used
     std::vector<FrameData> _frames;
-    int _frameOverlap = 2;
-    FrameData& getCurrentFrame(int frameNum) {
-	return _frames[frameNum % _frameOverlap];
+    uint32_t _framesInFlight = 2;
+    int _frameNum = 0;
+
+    // Frame pacing, every frame submission signals the next timeline value
+    VkSemaphore _frameTimeline = VK_NULL_HANDLE;
+    // Signalled with the frame value by async compute submissions
+    VkSemaphore _computeTimeline = VK_NULL_HANDLE;
+    // Value signalled by the frame being recorded
+    uint64_t _frameValue = 0;
+    uint64_t _completedValue = 0;
+    bool _lowLatency = false;
+    // Whether waitForNextFrame already ran for the frame about to be drawn
+    bool _frameWaited = false;
+    std::chrono::steady_clock::time_point _inputTime;
+    // Objects released while recording, pushed with _frameValue and
+    // destroyed once the GPU has completed it
+    DeletionQueue _retireQueue;
+    FrameConstants _frameConstants{};
+    VkDeviceAddress _frameConstantsAddress = 0;
+    FrameTimings _frameTimings{};
+    StartupTimings _startupTimings{};
+    std::chrono::steady_clock::time_point _initStart{};
+    std::vector<ProfilerScopeResult> _scopeResults;
+    std::vector<PassStatistics> _passStatistics;
+    FrameData& getCurrentFrame() {
+	return _frames[_frameValue % _framesInFlight];
     }
 };
 
@@ -1,36 +1,41 @@
 #include "vk_shaders.hpp"
 
-#include <fstream>
+#include <algorithm>
 #include <format>
+#include <stdexcept>
 #include "graphics_macros.hpp"
 
 namespace baldwin {
 namespace vk {
 
-std::vector<char> readShaderFile(const std::string& filename) {
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-    if (!file.is_open()) {
-	throw std::runtime_error(
-	  std::format("Failed to open file {}", filename));
+std::span<const uint32_t> getShaderCode(std::string_view name) {
+    std::span<const ShaderArchiveEntry> entries(SHADER_ARCHIVE_ENTRIES,
+						SHADER_ARCHIVE_ENTRY_COUNT);
+    auto it = std::lower_bound(
+      entries.begin(),
+      entries.end(),
+      name,
+      [](const ShaderArchiveEntry& entry, std::string_view name) {
+	  return entry.name < name;
+      });
+
+    if (it == entries.end() || it->name != name) {
+	throw std::runtime_error(std::format("Unknown shader {}", name));
     }
 
-    std::streamsize fileSize = file.tellg();
-    std::vector<char> buffer(fileSize);
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-    file.close();
-
-    return buffer;
+    // The archive is 4 bytes aligned and so is every module in it
+    return { reinterpret_cast<const uint32_t*>(SHADER_ARCHIVE_DATA +
+					       it->offset),
+	     it->size / sizeof(uint32_t) };
 }
 
 VkShaderModule createShaderModule(VkDevice device,
-				  const std::vector<char>& code) {
+				  std::span<const uint32_t> code) {
     VkShaderModule module;
     VkShaderModuleCreateInfo createInfo = {
 	.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-	.codeSize = code.size(),
-	.pCode = reinterpret_cast<const uint32_t*>(code.data()),
+	.codeSize = code.size_bytes(),
+	.pCode = code.data(),
     };
     VK_CHECK(vkCreateShaderModule(device, &createInfo, nullptr, &module),
 	     "Could not create shader module!");
@@ -1,15 +1,31 @@
 #pragma once
 
-#include <vector>
-#include <string>
+#include <cstdint>
+#include <span>
+#include <string_view>
 #include <vulkan/vulkan.h>
 
 namespace baldwin {
 namespace vk {
 
-std::vector<char> readShaderFile(const std::string& filename);
+struct ShaderArchiveEntry {
+    std::string_view name;
+    // In bytes, into SHADER_ARCHIVE_DATA
+    uint32_t offset;
+    uint32_t size;
+};
+
+// Every compiled shader, packed into the library at build time by
+// pack_shaders.cmake. Entries are sorted by name.
+extern const unsigned char SHADER_ARCHIVE_DATA[];
+extern const ShaderArchiveEntry SHADER_ARCHIVE_ENTRIES[];
+extern const uint32_t SHADER_ARCHIVE_ENTRY_COUNT;
+
+// SPIR-V of a shader, named after its source file without the .glsl
+// extension. The code is not copied and lives as long as the program.
+std::span<const uint32_t> getShaderCode(std::string_view name);
 VkShaderModule createShaderModule(VkDevice device,
-				  const std::vector<char>& code);
+				  std::span<const uint32_t> code);
 
 } // namespace vk
 } // namespace baldwin
@@ -0,0 +1,297 @@
+#include "vk_upload.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "graphics_macros.hpp"
+#include "vk_images.hpp"
+#include "vk_infos.hpp"
+
+namespace baldwin {
+namespace vk {
+
+// Suits buffer copies as well as the texel size of any image format
+static constexpr VkDeviceSize RING_ALIGNMENT = 16;
+
+void Uploader::init(VkDevice device, VmaAllocator allocator, VkQueue queue,
+		    uint32_t queueFamily, uint32_t graphicsQueueFamily,
+		    VkDeviceSize ringSize) {
+    _device = device;
+    _allocator = allocator;
+    _queue = queue;
+    _queueFamilies = { graphicsQueueFamily };
+    if (queueFamily != graphicsQueueFamily)
+	_queueFamilies.push_back(queueFamily);
+
+    VkCommandPoolCreateInfo poolInfo = {
+	.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+	.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+	.queueFamilyIndex = queueFamily
+    };
+    VK_CHECK(vkCreateCommandPool(_device, &poolInfo, nullptr, &_commandPool),
+	     "Could not create upload command pool");
+
+    VkSemaphoreTypeCreateInfo timelineInfo = {
+	.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+	.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+	.initialValue = 0
+    };
+    VkSemaphoreCreateInfo semaphoreInfo = {
+	.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+	.pNext = &timelineInfo
+    };
+    VK_CHECK(vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_timeline),
+	     "Could not create upload timeline semaphore");
+
+    _ringSize = (ringSize + RING_ALIGNMENT - 1) / RING_ALIGNMENT *
+		RING_ALIGNMENT;
+    _ring = createBuffer(
+      _allocator,
+      _ringSize,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VMA_MEMORY_USAGE_AUTO,
+      VMA_ALLOCATION_CREATE_MAPPED_BIT |
+	VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+    _windowStart = std::chrono::steady_clock::now();
+}
+
+void Uploader::destroy() {
+    flush();
+    if (_lastSubmitted > 0) {
+	VkSemaphoreWaitInfo waitInfo = {
+	    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+	    .semaphoreCount = 1,
+	    .pSemaphores = &_timeline,
+	    .pValues = &_lastSubmitted
+	};
+	vkWaitSemaphores(_device, &waitInfo, UINT64_MAX);
+    }
+
+    destroyBuffer(_allocator, _ring);
+    vkDestroySemaphore(_device, _timeline, nullptr);
+    vkDestroyCommandPool(_device, _commandPool, nullptr);
+    _inFlight.clear();
+    _freeCommandBuffers.clear();
+}
+
+uint64_t Uploader::uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset,
+				const void* data, VkDeviceSize size) {
+    // Anything bigger than the ring goes through it in several pieces
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (VkDeviceSize done = 0; done < size;) {
+	VkDeviceSize chunk = std::min(size - done, _ringSize);
+	VkDeviceSize offset = reserve(chunk);
+	stage(offset, bytes + done, chunk);
+
+	VkBufferCopy copy = { .srcOffset = offset,
+			      .dstOffset = dstOffset + done,
+			      .size = chunk };
+	vkCmdCopyBuffer(getCommandBuffer(), _ring.buffer, dst, 1, &copy);
+	_recordingBytes += chunk;
+	done += chunk;
+    }
+    return _nextValue;
+}
+
+uint64_t Uploader::uploadImage(VkImage dst, VkExtent3D extent,
+			       const void* data, VkDeviceSize size) {
+    if (size > _ringSize)
+	throw std::runtime_error("Image does not fit in the upload ring");
+
+    VkDeviceSize offset = reserve(size);
+    stage(offset, data, size);
+
+    // Transfer queues know nothing of later stages, the timeline semaphore
+    // wait is what makes the copy visible to them
+    VkCommandBuffer cmd = getCommandBuffer();
+    VkImageMemoryBarrier2 barrier = {
+	.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+	.srcStageMask = VK_PIPELINE_STAGE_2_NONE,
+	.srcAccessMask = VK_ACCESS_2_NONE,
+	.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+	.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+	.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	.image = dst,
+	.subresourceRange = getImageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT)
+    };
+    VkDependencyInfo depInfo = {
+	.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+	.imageMemoryBarrierCount = 1,
+	.pImageMemoryBarriers = &barrier
+    };
+    vkCmdPipelineBarrier2(cmd, &depInfo);
+
+    VkBufferImageCopy copy = {
+	.bufferOffset = offset,
+	.imageSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			      .mipLevel = 0,
+			      .baseArrayLayer = 0,
+			      .layerCount = 1 },
+	.imageExtent = extent
+    };
+    vkCmdCopyBufferToImage(cmd,
+			   _ring.buffer,
+			   dst,
+			   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			   1,
+			   &copy);
+
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+    barrier.dstAccessMask = VK_ACCESS_2_NONE;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier2(cmd, &depInfo);
+
+    _recordingBytes += size;
+    return _nextValue;
+}
+
+void Uploader::flush() {
+    if (_recording == VK_NULL_HANDLE)
+	return;
+
+    VK_CHECK(vkEndCommandBuffer(_recording), "Could not end upload commands");
+
+    VkCommandBufferSubmitInfo cmdSubmitInfo = getCommandBufferSubmitInfo(
+      _recording);
+    VkSemaphoreSubmitInfo signalInfo = getSemaphoreSubmitInfo(
+      VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _timeline);
+    signalInfo.value = _nextValue;
+    VkSubmitInfo2 submitInfo = getSubmitInfo(
+      &cmdSubmitInfo, &signalInfo, nullptr);
+    VK_CHECK(vkQueueSubmit2(_queue, 1, &submitInfo, VK_NULL_HANDLE),
+	     "Could not submit upload commands");
+
+    _inFlight.push_back(Batch{ .cmd = _recording,
+			       .value = _nextValue,
+			       .ringEnd = _head,
+			       .bytes = _recordingBytes });
+    _lastSubmitted = _nextValue++;
+    _recording = VK_NULL_HANDLE;
+    _recordingBytes = 0;
+}
+
+void Uploader::update() {
+    reclaim();
+
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - _windowStart).count();
+    if (seconds >= 1.0) {
+	_statistics.mbPerSecond = megabytesPerSecond(_windowBytes, seconds);
+	_windowBytes = 0;
+	_windowStart = now;
+    }
+}
+
+bool Uploader::isComplete(uint64_t value) const {
+    uint64_t completed = 0;
+    vkGetSemaphoreCounterValue(_device, _timeline, &completed);
+    return completed >= value;
+}
+
+uint64_t Uploader::pendingValue() const {
+    return isComplete(_lastSubmitted) ? 0 : _lastSubmitted;
+}
+
+VkDeviceSize Uploader::reserve(VkDeviceSize size) {
+    for (;;) {
+	uint64_t start = (_head + RING_ALIGNMENT - 1) / RING_ALIGNMENT *
+			 RING_ALIGNMENT;
+	// Allocations never wrap, the end of the ring is skipped instead
+	if (start % _ringSize + size > _ringSize)
+	    start += _ringSize - start % _ringSize;
+	if (start + size - _tail <= _ringSize) {
+	    _head = start + size;
+	    return start % _ringSize;
+	}
+
+	reclaim();
+	if (_head == _tail && _recording == VK_NULL_HANDLE) {
+	    // Nothing uses the ring, start over from its beginning
+	    _head = 0;
+	    _tail = 0;
+	    continue;
+	}
+	if (start + size - _tail > _ringSize)
+	    waitForOldestBatch();
+    }
+}
+
+void Uploader::stage(VkDeviceSize offset, const void* data,
+		     VkDeviceSize size) {
+    std::memcpy(static_cast<uint8_t*>(_ring.info.pMappedData) + offset,
+		data,
+		size);
+    // The ring may not be host coherent, the copy has to be flushed before
+    // the transfer reads it
+    vmaFlushAllocation(_allocator, _ring.allocation, offset, size);
+}
+
+VkCommandBuffer Uploader::getCommandBuffer() {
+    if (_recording != VK_NULL_HANDLE)
+	return _recording;
+
+    if (_freeCommandBuffers.empty()) {
+	VkCommandBufferAllocateInfo bufferInfo = {
+	    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+	    .commandPool = _commandPool,
+	    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+	    .commandBufferCount = 1,
+	};
+	VK_CHECK(vkAllocateCommandBuffers(_device, &bufferInfo, &_recording),
+		 "Could not allocate upload command buffer");
+    } else {
+	_recording = _freeCommandBuffers.back();
+	_freeCommandBuffers.pop_back();
+	VK_CHECK(vkResetCommandBuffer(_recording, 0),
+		 "Could not reset upload command buffer");
+    }
+
+    VkCommandBufferBeginInfo beginInfo = getCommandBufferBeginInfo(
+      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    VK_CHECK(vkBeginCommandBuffer(_recording, &beginInfo),
+	     "Could not begin upload commands");
+    return _recording;
+}
+
+void Uploader::reclaim() {
+    uint64_t completed = 0;
+    vkGetSemaphoreCounterValue(_device, _timeline, &completed);
+    while (!_inFlight.empty() && _inFlight.front().value <= completed) {
+	const Batch& batch = _inFlight.front();
+	_tail = batch.ringEnd;
+	_statistics.bytesUploaded += batch.bytes;
+	_windowBytes += batch.bytes;
+	_freeCommandBuffers.push_back(batch.cmd);
+	_inFlight.pop_front();
+    }
+}
+
+void Uploader::waitForOldestBatch() {
+    // The batch being recorded may be the one holding the space
+    if (_inFlight.empty())
+	flush();
+
+    auto start = std::chrono::steady_clock::now();
+    VkSemaphoreWaitInfo waitInfo = {
+	.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+	.semaphoreCount = 1,
+	.pSemaphores = &_timeline,
+	.pValues = &_inFlight.front().value
+    };
+    VK_CHECK(vkWaitSemaphores(_device, &waitInfo, UINT64_MAX),
+	     "Could not wait for upload completion");
+    _statistics.stalls++;
+    _statistics.stallMs += std::chrono::duration<double, std::milli>(
+			     std::chrono::steady_clock::now() - start)
+			     .count();
+    reclaim();
+}
+
+} // namespace vk
+} // namespace baldwin
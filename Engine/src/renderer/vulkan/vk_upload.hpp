@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+#include "renderer/renderer.hpp"
+#include "renderer/vulkan/vk_buffers.hpp"
+
+namespace baldwin {
+namespace vk {
+
+// Copies CPU data to buffers and images through a persistently mapped staging
+// ring. Copies are recorded as they come and submitted together on flush,
+// preferably on a dedicated transfer queue. Each submission signals the next
+// value of a timeline semaphore, which is what callers wait on, either on the
+// CPU or as part of a queue submission.
+//
+// Ring space is reclaimed once the batch that used it has completed. Only an
+// upload that does not fit in the free space waits, which is counted as a
+// stall.
+class Uploader {
+  public:
+    static constexpr VkDeviceSize DEFAULT_RING_SIZE = 32 * 1024 * 1024;
+
+    // Resources written by the uploader must be shared with every family
+    // returned by queueFamilies()
+    void init(VkDevice device, VmaAllocator allocator, VkQueue queue,
+	      uint32_t queueFamily, uint32_t graphicsQueueFamily,
+	      VkDeviceSize ringSize = DEFAULT_RING_SIZE);
+    void destroy();
+
+    // Both return the timeline value signalled once the copy is done
+    uint64_t uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset,
+			  const void* data, VkDeviceSize size);
+    // The whole image ends up in SHADER_READ_ONLY_OPTIMAL
+    uint64_t uploadImage(VkImage dst, VkExtent3D extent, const void* data,
+			 VkDeviceSize size);
+
+    // Submits every copy recorded since the last flush as one batch
+    void flush();
+    // Reclaims the space of completed batches and updates the statistics,
+    // never waits
+    void update();
+
+    bool isComplete(uint64_t value) const;
+    // Value covering every flushed upload, 0 when they have all completed
+    uint64_t pendingValue() const;
+    VkSemaphore timeline() const { return _timeline; }
+    const std::vector<uint32_t>& queueFamilies() const {
+	return _queueFamilies;
+    }
+    const UploadStatistics& statistics() const { return _statistics; }
+
+  private:
+    struct Batch {
+	VkCommandBuffer cmd;
+	uint64_t value;
+	// Ring position right after the last byte used by the batch
+	uint64_t ringEnd;
+	VkDeviceSize bytes;
+    };
+
+    VkDeviceSize reserve(VkDeviceSize size);
+    void stage(VkDeviceSize offset, const void* data, VkDeviceSize size);
+    VkCommandBuffer getCommandBuffer();
+    void reclaim();
+    void waitForOldestBatch();
+
+    VkDevice _device = VK_NULL_HANDLE;
+    VmaAllocator _allocator = VK_NULL_HANDLE;
+    VkQueue _queue = VK_NULL_HANDLE;
+    std::vector<uint32_t> _queueFamilies;
+    VkCommandPool _commandPool = VK_NULL_HANDLE;
+    VkSemaphore _timeline = VK_NULL_HANDLE;
+
+    AllocatedBuffer _ring{};
+    VkDeviceSize _ringSize = 0;
+    // Monotonic positions, the offset in the ring is modulo its size
+    uint64_t _head = 0;
+    uint64_t _tail = 0;
+
+    VkCommandBuffer _recording = VK_NULL_HANDLE;
+    VkDeviceSize _recordingBytes = 0;
+    std::deque<Batch> _inFlight;
+    std::vector<VkCommandBuffer> _freeCommandBuffers;
+    uint64_t _nextValue = 1;
+    uint64_t _lastSubmitted = 0;
+
+    UploadStatistics _statistics{};
+    std::chrono::steady_clock::time_point _windowStart{};
+    VkDeviceSize _windowBytes = 0;
+};
+
+} // namespace vk
+} // namespace baldwin
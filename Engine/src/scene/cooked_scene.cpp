@@ -0,0 +1,183 @@
+#include "cooked_scene.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+
+namespace baldwin {
+
+static uint64_t alignUp(uint64_t value) {
+    return (value + COOKED_ALIGNMENT - 1) & ~(COOKED_ALIGNMENT - 1);
+}
+
+static void pad(std::ofstream& file, uint64_t& written, uint64_t offset) {
+    static const char zeros[COOKED_ALIGNMENT] = {};
+    file.write(zeros, static_cast<std::streamsize>(offset - written));
+    written = offset;
+}
+
+void writeCookedScene(const std::string& path,
+		      const std::vector<PackedMesh>& meshes,
+		      uint64_t sourceBytes) {
+    CookedHeader header{ .magic = COOKED_MAGIC,
+			 .version = COOKED_VERSION,
+			 .vertexSize = sizeof(PackedVertex),
+			 .meshCount = static_cast<uint32_t>(meshes.size()),
+			 .sourceBytes = sourceBytes };
+    std::vector<CookedMesh> table(meshes.size());
+    for (size_t i = 0; i < meshes.size(); i++) {
+	const PackedMesh& mesh = meshes[i];
+	table[i] = { .firstVertex = static_cast<uint32_t>(header.vertexCount),
+		     .vertexCount = static_cast<uint32_t>(mesh.vertices.size()),
+		     .firstIndex = static_cast<uint32_t>(header.indexCount),
+		     .indexCount = static_cast<uint32_t>(mesh.indices.size()),
+		     .firstMeshlet = static_cast<uint32_t>(header.meshletCount),
+		     .meshletCount = static_cast<uint32_t>(
+		       mesh.meshlets.size()) };
+	std::copy_n(mesh.boundsMin, 3, table[i].boundsMin);
+	std::copy_n(mesh.boundsMax, 3, table[i].boundsMax);
+	header.vertexCount += mesh.vertices.size();
+	header.indexCount += mesh.indices.size();
+	header.meshletCount += mesh.meshlets.size();
+    }
+    if (header.vertexCount > UINT32_MAX || header.indexCount > UINT32_MAX ||
+	header.meshletCount > UINT32_MAX) {
+	throw std::runtime_error(
+	  std::format("Scene too large to be cooked in {}", path));
+    }
+    header.vertexOffset = alignUp(sizeof(CookedHeader) +
+				  table.size() * sizeof(CookedMesh));
+    header.indexOffset = alignUp(header.vertexOffset +
+				 header.vertexCount * sizeof(PackedVertex));
+    header.meshletOffset = alignUp(header.indexOffset +
+				   header.indexCount * sizeof(uint32_t));
+
+    // Same write then rename as the pipeline cache
+    std::string tmpPath = path + ".tmp";
+    {
+	std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+	uint64_t written = sizeof(CookedHeader) +
+			   table.size() * sizeof(CookedMesh);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(table.data()),
+		   static_cast<std::streamsize>(table.size() *
+						sizeof(CookedMesh)));
+	pad(file, written, header.vertexOffset);
+	for (const PackedMesh& mesh : meshes) {
+	    file.write(reinterpret_cast<const char*>(mesh.vertices.data()),
+		       static_cast<std::streamsize>(mesh.vertices.size() *
+						    sizeof(PackedVertex)));
+	    written += mesh.vertices.size() * sizeof(PackedVertex);
+	}
+	pad(file, written, header.indexOffset);
+	for (const PackedMesh& mesh : meshes) {
+	    file.write(reinterpret_cast<const char*>(mesh.indices.data()),
+		       static_cast<std::streamsize>(mesh.indices.size() *
+						    sizeof(uint32_t)));
+	    written += mesh.indices.size() * sizeof(uint32_t);
+	}
+	pad(file, written, header.meshletOffset);
+	for (const PackedMesh& mesh : meshes) {
+	    file.write(reinterpret_cast<const char*>(mesh.meshlets.data()),
+		       static_cast<std::streamsize>(mesh.meshlets.size() *
+						    sizeof(Meshlet)));
+	}
+	if (!file) {
+	    throw std::runtime_error(
+	      std::format("Could not write cooked scene {}", tmpPath));
+	}
+    }
+
+    std::error_code err;
+    std::filesystem::rename(tmpPath, path, err);
+    if (err) {
+	throw std::runtime_error(std::format(
+	  "Could not replace cooked scene {} : {}", path, err.message()));
+    }
+}
+
+SceneData loadCookedScene(const std::string& path) {
+    auto start = std::chrono::steady_clock::now();
+
+    SceneData scene{};
+    scene.file.open(path);
+    // Every page ends up being copied to the GPU
+    scene.file.prefetch();
+    const uint8_t* data = scene.file.data();
+    size_t size = scene.file.size();
+
+    auto invalid = [&path](const char* reason) {
+	return std::runtime_error(
+	  std::format("Invalid cooked scene {} : {}", path, reason));
+    };
+    if (size < sizeof(CookedHeader))
+	throw invalid("truncated header");
+    const auto* header = reinterpret_cast<const CookedHeader*>(data);
+    if (header->magic != COOKED_MAGIC)
+	throw invalid("not a cooked scene");
+    if (header->version != COOKED_VERSION ||
+	header->vertexSize != sizeof(PackedVertex))
+	throw invalid("cooked with another version, cook it again");
+
+    uint64_t tableEnd = sizeof(CookedHeader) +
+			uint64_t(header->meshCount) * sizeof(CookedMesh);
+    if (tableEnd > size || header->vertexOffset < tableEnd ||
+	header->vertexOffset % COOKED_ALIGNMENT != 0 ||
+	header->indexOffset % COOKED_ALIGNMENT != 0 ||
+	header->meshletOffset % COOKED_ALIGNMENT != 0 ||
+	header->vertexOffset + header->vertexCount * sizeof(PackedVertex) >
+	  header->indexOffset ||
+	header->indexOffset + header->indexCount * sizeof(uint32_t) >
+	  header->meshletOffset ||
+	header->meshletOffset + header->meshletCount * sizeof(Meshlet) > size)
+	throw invalid("sections out of the file");
+
+    // Nothing is parsed or converted, the meshes point into the mapping
+    const auto* table = reinterpret_cast<const CookedMesh*>(
+      data + sizeof(CookedHeader));
+    const auto* vertices = reinterpret_cast<const PackedVertex*>(
+      data + header->vertexOffset);
+    const auto* indices = reinterpret_cast<const uint32_t*>(
+      data + header->indexOffset);
+    const auto* meshlets = reinterpret_cast<const Meshlet*>(
+      data + header->meshletOffset);
+    scene.meshes.resize(header->meshCount);
+    for (uint32_t i = 0; i < header->meshCount; i++) {
+	const CookedMesh& mesh = table[i];
+	if (uint64_t(mesh.firstVertex) + mesh.vertexCount >
+	      header->vertexCount ||
+	    uint64_t(mesh.firstIndex) + mesh.indexCount > header->indexCount ||
+	    uint64_t(mesh.firstMeshlet) + mesh.meshletCount >
+	      header->meshletCount)
+	    throw invalid("mesh out of its sections");
+	// Meshlets are drawn as ranges of the mesh's indices
+	for (uint32_t j = 0; j < mesh.meshletCount; j++) {
+	    const Meshlet& meshlet = meshlets[mesh.firstMeshlet + j];
+	    if (uint64_t(meshlet.firstIndex) + meshlet.indexCount >
+		mesh.indexCount)
+		throw invalid("meshlet out of its mesh");
+	}
+
+	MeshView& view = scene.meshes[i];
+	view.vertices = { vertices + mesh.firstVertex, mesh.vertexCount };
+	view.indices = { indices + mesh.firstIndex, mesh.indexCount };
+	view.meshlets = { meshlets + mesh.firstMeshlet, mesh.meshletCount };
+	std::copy_n(mesh.boundsMin, 3, view.boundsMin);
+	std::copy_n(mesh.boundsMax, 3, view.boundsMax);
+	scene.triangles += mesh.indexCount / 3;
+    }
+    scene.bytes = size;
+    scene.parseMs = std::chrono::duration<double, std::milli>(
+		      std::chrono::steady_clock::now() - start)
+		      .count();
+    return scene;
+}
+
+bool isCookedScene(const std::string& path) {
+    return std::filesystem::path(path).extension() == COOKED_EXTENSION;
+}
+
+} // namespace baldwin
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "scene/mesh_data.hpp"
+
+namespace baldwin {
+
+// Scenes cooked offline by baldwin_cooker, laid out so that the runtime maps
+// the file and copies the vertices and indices to the GPU as they are:
+//   CookedHeader
+//   CookedMesh[meshCount]
+//   PackedVertex[vertexCount] at vertexOffset
+//   uint32_t[indexCount] at indexOffset
+//   Meshlet[meshletCount] at meshletOffset
+// Sections are aligned to COOKED_ALIGNMENT, everything is little endian.
+// Files of another version are rejected, they have to be cooked again.
+inline constexpr uint32_t COOKED_MAGIC = 0x48534d42; // "BMSH"
+inline constexpr uint32_t COOKED_VERSION = 2;
+inline constexpr uint64_t COOKED_ALIGNMENT = 16;
+inline constexpr const char* COOKED_EXTENSION = ".bmesh";
+
+struct CookedHeader {
+    uint32_t magic;
+    uint32_t version;
+    // Catches vertex layout changes that forgot to bump the version
+    uint32_t vertexSize;
+    uint32_t meshCount;
+    uint64_t vertexOffset;
+    uint64_t vertexCount;
+    uint64_t indexOffset;
+    uint64_t indexCount;
+    uint64_t meshletOffset;
+    uint64_t meshletCount;
+    // Size of the source files, for statistics
+    uint64_t sourceBytes;
+};
+static_assert(sizeof(CookedHeader) == 72);
+
+// Offsets are in elements from the start of each section
+struct CookedMesh {
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+static_assert(sizeof(CookedMesh) == 48);
+
+// Writes through a temporary file renamed over path, throws on failure
+void writeCookedScene(const std::string& path,
+		      const std::vector<PackedMesh>& meshes,
+		      uint64_t sourceBytes);
+// Maps the file, the meshes point into the mapping. Throws on files that
+// can't be mapped or are not valid.
+SceneData loadCookedScene(const std::string& path);
+bool isCookedScene(const std::string& path);
+
+} // namespace baldwin
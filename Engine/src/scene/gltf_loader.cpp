@@ -0,0 +1,216 @@
+#define CGLTF_IMPLEMENTATION
+#include "gltf_loader.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cgltf.h>
+#include <format>
+#include <stdexcept>
+#include <utility>
+
+#include "scene/mesh_packing.hpp"
+
+namespace baldwin {
+
+// One primitive to convert, with the world transform of the node drawing it
+struct PrimitiveInstance {
+    const cgltf_primitive* primitive;
+    float transform[16];
+};
+
+static void transformPoint(const float* m, const float* in, float* out) {
+    for (int i = 0; i < 3; i++) {
+	out[i] = m[i] * in[0] + m[4 + i] * in[1] + m[8 + i] * in[2] + m[12 + i];
+    }
+}
+
+// Normals are transformed by the matrix itself, which is exact as long as
+// scales are uniform
+static void transformNormal(const float* m, const float* in, float* out) {
+    float length = 0.0f;
+    for (int i = 0; i < 3; i++) {
+	out[i] = m[i] * in[0] + m[4 + i] * in[1] + m[8 + i] * in[2];
+	length += out[i] * out[i];
+    }
+    if (length > 0.0f) {
+	length = std::sqrt(length);
+	for (int i = 0; i < 3; i++) {
+	    out[i] /= length;
+	}
+    }
+}
+
+// Negative for transforms that mirror the geometry
+static float determinant(const float* m) {
+    return m[0] * (m[5] * m[10] - m[9] * m[6]) -
+	   m[4] * (m[1] * m[10] - m[9] * m[2]) +
+	   m[8] * (m[1] * m[6] - m[5] * m[2]);
+}
+
+static MeshData convertPrimitive(const PrimitiveInstance& instance) {
+    const cgltf_primitive& primitive = *instance.primitive;
+    MeshData mesh{};
+
+    const cgltf_accessor* positions = nullptr;
+    const cgltf_accessor* normals = nullptr;
+    const cgltf_accessor* uvs = nullptr;
+    for (cgltf_size i = 0; i < primitive.attributes_count; i++) {
+	const cgltf_attribute& attribute = primitive.attributes[i];
+	if (attribute.type == cgltf_attribute_type_position)
+	    positions = attribute.data;
+	else if (attribute.type == cgltf_attribute_type_normal)
+	    normals = attribute.data;
+	else if (attribute.type == cgltf_attribute_type_texcoord &&
+		 attribute.index == 0)
+	    uvs = attribute.data;
+    }
+    // Primitives that would draw nothing or read past their vertices are
+    // skipped, and dropped with the empty ones
+    if (!positions || positions->count == 0)
+	return mesh;
+
+    size_t vertexCount = positions->count;
+    std::vector<float> values(vertexCount * 3);
+    mesh.vertices.resize(vertexCount);
+
+    cgltf_accessor_unpack_floats(positions, values.data(), values.size());
+    for (size_t i = 0; i < vertexCount; i++) {
+	transformPoint(
+	  instance.transform, &values[i * 3], mesh.vertices[i].position);
+    }
+    if (normals) {
+	cgltf_accessor_unpack_floats(normals, values.data(), values.size());
+	for (size_t i = 0; i < vertexCount; i++) {
+	    transformNormal(
+	      instance.transform, &values[i * 3], mesh.vertices[i].normal);
+	}
+    }
+    if (uvs) {
+	cgltf_accessor_unpack_floats(uvs, values.data(), vertexCount * 2);
+	for (size_t i = 0; i < vertexCount; i++) {
+	    mesh.vertices[i].uvX = values[i * 2];
+	    mesh.vertices[i].uvY = values[i * 2 + 1];
+	}
+    }
+
+    if (primitive.indices) {
+	mesh.indices.resize(primitive.indices->count);
+	for (size_t i = 0; i < mesh.indices.size(); i++) {
+	    cgltf_size index = cgltf_accessor_read_index(primitive.indices, i);
+	    if (index >= vertexCount)
+		return MeshData{};
+	    mesh.indices[i] = static_cast<uint32_t>(index);
+	}
+    } else {
+	mesh.indices.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++) {
+	    mesh.indices[i] = static_cast<uint32_t>(i);
+	}
+    }
+    // Incomplete triangles are dropped. Mirroring flips the winding, front
+    // faces stay counter-clockwise.
+    mesh.indices.resize(mesh.indices.size() / 3 * 3);
+    if (determinant(instance.transform) < 0.0f) {
+	for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+	    std::swap(mesh.indices[i + 1], mesh.indices[i + 2]);
+	}
+    }
+
+    std::copy_n(mesh.vertices[0].position, 3, mesh.boundsMin);
+    std::copy_n(mesh.vertices[0].position, 3, mesh.boundsMax);
+    for (const Vertex& vertex : mesh.vertices) {
+	for (int i = 0; i < 3; i++) {
+	    mesh.boundsMin[i] = std::min(mesh.boundsMin[i], vertex.position[i]);
+	    mesh.boundsMax[i] = std::max(mesh.boundsMax[i], vertex.position[i]);
+	}
+    }
+    return mesh;
+}
+
+static void collectPrimitives(const cgltf_mesh& mesh, const float* transform,
+			      std::vector<PrimitiveInstance>& instances) {
+    for (cgltf_size i = 0; i < mesh.primitives_count; i++) {
+	if (mesh.primitives[i].type != cgltf_primitive_type_triangles)
+	    continue;
+	PrimitiveInstance& instance = instances.emplace_back();
+	instance.primitive = &mesh.primitives[i];
+	std::copy_n(transform, 16, instance.transform);
+    }
+}
+
+std::vector<MeshData> readGltf(const std::string& path, JobSystem& jobs,
+			       uint64_t& bytes) {
+    cgltf_options options{};
+    cgltf_data* data = nullptr;
+    if (cgltf_parse_file(&options, path.c_str(), &data) !=
+	  cgltf_result_success ||
+	cgltf_load_buffers(&options, data, path.c_str()) !=
+	  cgltf_result_success ||
+	cgltf_validate(data) != cgltf_result_success) {
+	cgltf_free(data);
+	throw std::runtime_error(std::format("Could not load glTF {}", path));
+    }
+
+    bytes = data->json_size;
+    for (cgltf_size i = 0; i < data->buffers_count; i++) {
+	bytes += data->buffers[i].size;
+    }
+
+    // Files without nodes still describe meshes, drawn untransformed
+    std::vector<PrimitiveInstance> instances;
+    if (data->nodes_count == 0) {
+	const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0,
+				     0, 0, 1, 0, 0, 0, 0, 1 };
+	for (cgltf_size i = 0; i < data->meshes_count; i++) {
+	    collectPrimitives(data->meshes[i], identity, instances);
+	}
+    }
+    for (cgltf_size i = 0; i < data->nodes_count; i++) {
+	const cgltf_node& node = data->nodes[i];
+	if (!node.mesh)
+	    continue;
+	float transform[16];
+	cgltf_node_transform_world(&node, transform);
+	collectPrimitives(*node.mesh, transform, instances);
+    }
+
+    std::vector<MeshData> meshes(instances.size());
+    jobs.parallelFor(static_cast<uint32_t>(instances.size()),
+		     1,
+		     [&](uint32_t begin, uint32_t end) {
+			 for (uint32_t i = begin; i < end; i++) {
+			     meshes[i] = convertPrimitive(instances[i]);
+			 }
+		     });
+    cgltf_free(data);
+
+    std::erase_if(meshes,
+		  [](const MeshData& mesh) { return mesh.indices.empty(); });
+    return meshes;
+}
+
+SceneData loadGltf(const std::string& path, JobSystem& jobs) {
+    auto start = std::chrono::steady_clock::now();
+
+    SceneData scene{};
+    std::vector<MeshData> meshes = readGltf(path, jobs, scene.bytes);
+    scene.packedMeshes.resize(meshes.size());
+    jobs.parallelFor(static_cast<uint32_t>(meshes.size()),
+		     1,
+		     [&](uint32_t begin, uint32_t end) {
+			 for (uint32_t i = begin; i < end; i++) {
+			     scene.packedMeshes[i] = packMesh(meshes[i]);
+			 }
+		     });
+    for (const PackedMesh& mesh : scene.packedMeshes) {
+	scene.meshes.push_back(viewMesh(mesh));
+	scene.triangles += mesh.indices.size() / 3;
+    }
+    scene.parseMs = std::chrono::duration<double, std::milli>(
+		      std::chrono::steady_clock::now() - start)
+		      .count();
+    return scene;
+}
+
+} // namespace baldwin
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "core/job_system.hpp"
+#include "scene/mesh_data.hpp"
+
+namespace baldwin {
+
+// Reads every triangle primitive of a .gltf or .glb file, with the transforms
+// of the nodes instancing them baked in. Primitives are converted in parallel
+// on the job system. Throws on files that can't be read. bytes receives the
+// size of the JSON and binary buffers.
+std::vector<MeshData> readGltf(const std::string& path, JobSystem& jobs,
+			       uint64_t& bytes);
+// Same, with every mesh packed for the GPU
+SceneData loadGltf(const std::string& path, JobSystem& jobs);
+
+} // namespace baldwin
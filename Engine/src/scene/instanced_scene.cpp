@@ -0,0 +1,129 @@
+#include "instanced_scene.hpp"
+
+#include <chrono>
+#include <cmath>
+
+#include "scene/mesh_packing.hpp"
+
+namespace baldwin {
+
+// Between instance centers, meshes being at most 2 units wide
+static constexpr float GRID_SPACING = 4.0f;
+static constexpr uint32_t SPHERE_STACKS = 8;
+static constexpr uint32_t SPHERE_SLICES = 16;
+
+static void setBounds(MeshData& mesh) {
+    for (int axis = 0; axis < 3; axis++) {
+	mesh.boundsMin[axis] = -1.0f;
+	mesh.boundsMax[axis] = 1.0f;
+    }
+}
+
+// Unit cube with one quad per face, so that normals stay flat
+static MeshData buildCube() {
+    MeshData mesh{};
+    for (int axis = 0; axis < 3; axis++) {
+	for (float sign : { -1.0f, 1.0f }) {
+	    int u = (axis + 1) % 3;
+	    int v = (axis + 2) % 3;
+	    uint32_t first = static_cast<uint32_t>(mesh.vertices.size());
+	    const float corners[4][2] = {
+		{ -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f }
+	    };
+	    for (const float* corner : corners) {
+		Vertex vertex{};
+		vertex.position[axis] = sign;
+		vertex.position[u] = corner[0] * sign;
+		vertex.position[v] = corner[1];
+		vertex.normal[axis] = sign;
+		vertex.uvX = corner[0] * 0.5f + 0.5f;
+		vertex.uvY = corner[1] * 0.5f + 0.5f;
+		mesh.vertices.push_back(vertex);
+	    }
+	    mesh.indices.insert(
+	      mesh.indices.end(),
+	      { first, first + 1, first + 2, first, first + 2, first + 3 });
+	}
+    }
+    setBounds(mesh);
+    return mesh;
+}
+
+static MeshData buildSphere() {
+    MeshData mesh{};
+    const float pi = 3.14159265f;
+    for (uint32_t stack = 0; stack <= SPHERE_STACKS; stack++) {
+	float phi = pi * stack / SPHERE_STACKS;
+	for (uint32_t slice = 0; slice <= SPHERE_SLICES; slice++) {
+	    float theta = 2.0f * pi * slice / SPHERE_SLICES;
+	    Vertex vertex{};
+	    vertex.position[0] = std::sin(phi) * std::cos(theta);
+	    vertex.position[1] = std::cos(phi);
+	    vertex.position[2] = std::sin(phi) * std::sin(theta);
+	    for (int axis = 0; axis < 3; axis++) {
+		vertex.normal[axis] = vertex.position[axis];
+	    }
+	    vertex.uvX = static_cast<float>(slice) / SPHERE_SLICES;
+	    vertex.uvY = static_cast<float>(stack) / SPHERE_STACKS;
+	    mesh.vertices.push_back(vertex);
+	}
+    }
+    for (uint32_t stack = 0; stack < SPHERE_STACKS; stack++) {
+	for (uint32_t slice = 0; slice < SPHERE_SLICES; slice++) {
+	    uint32_t a = stack * (SPHERE_SLICES + 1) + slice;
+	    uint32_t b = a + SPHERE_SLICES + 1;
+	    // Counter-clockwise seen from outside, like the cube
+	    mesh.indices.insert(mesh.indices.end(),
+				{ a, a + 1, b, a + 1, b + 1, b });
+	}
+    }
+    setBounds(mesh);
+    return mesh;
+}
+
+// Deterministic, so that runs draw the same scene
+static float hashToUnit(uint32_t value) {
+    value ^= value >> 16;
+    value *= 0x7feb352d;
+    value ^= value >> 15;
+    value *= 0x846ca68b;
+    value ^= value >> 16;
+    return static_cast<float>(value & 0xffffff) / 0xffffff;
+}
+
+SceneData buildInstancedScene(uint32_t instanceCount) {
+    auto start = std::chrono::steady_clock::now();
+
+    SceneData scene{};
+    scene.packedMeshes.push_back(packMesh(buildCube()));
+    scene.packedMeshes.push_back(packMesh(buildSphere()));
+    for (const PackedMesh& mesh : scene.packedMeshes) {
+	scene.meshes.push_back(viewMesh(mesh));
+    }
+
+    // Smallest cube of cells holding every instance, centered on the origin
+    uint32_t side = static_cast<uint32_t>(
+      std::ceil(std::cbrt(static_cast<double>(instanceCount))));
+    float half = 0.5f * GRID_SPACING * (side - 1);
+    scene.instances.resize(instanceCount);
+    for (uint32_t i = 0; i < instanceCount; i++) {
+	MeshInstance& instance = scene.instances[i];
+	uint32_t cell[3] = { i % side, (i / side) % side, i / (side * side) };
+	for (int axis = 0; axis < 3; axis++) {
+	    float jitter = hashToUnit(i * 3 + axis) - 0.5f;
+	    instance.position[axis] = cell[axis] * GRID_SPACING - half +
+				      jitter * GRID_SPACING * 0.25f;
+	}
+	instance.scale = 0.5f + 0.5f * hashToUnit(~i);
+	instance.mesh = i % static_cast<uint32_t>(scene.meshes.size());
+	scene.triangles +=
+	  scene.meshes[instance.mesh].indices.size() / 3;
+    }
+
+    scene.parseMs = std::chrono::duration<double, std::milli>(
+		      std::chrono::steady_clock::now() - start)
+		      .count();
+    return scene;
+}
+
+} // namespace baldwin
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+#include "scene/mesh_data.hpp"
+
+namespace baldwin {
+
+// Procedural scene of a few small meshes instanced instanceCount times on a
+// jittered grid, for benchmarks that must run without any asset
+SceneData buildInstancedScene(uint32_t instanceCount);
+
+} // namespace baldwin
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "core/mapped_file.hpp"
+
+namespace baldwin {
+
+// Vertex as read from source assets, kept in full precision until packed
+struct Vertex {
+    float position[3];
+    float uvX;
+    float normal[3];
+    float uvY;
+};
+
+// Vertex layout shared with the shaders, which fetch it through the vertex
+// buffer's device address. Positions are unorm16 within the bounds of their
+// mesh, normals octahedral snorm16 and UVs half floats.
+struct PackedVertex {
+    uint16_t position[3];
+    uint16_t unused;
+    int16_t normal[2];
+    uint16_t uv[2];
+};
+static_assert(sizeof(PackedVertex) == 16);
+
+// Limits of a meshlet, sized for mesh shader workgroups even though clusters
+// are drawn from the index buffer
+inline constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+inline constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// Cluster of neighbouring triangles, culled on its own. Its triangles are
+// contiguous in the index buffer of its mesh, so that it is drawn as a range
+// of it. Matches Meshlet in the shaders, std430 layout.
+struct Meshlet {
+    // Bounding sphere in mesh space, center and radius
+    float sphere[4];
+    // Normal cone, its axis in xyz and the sine of its half angle in w. A
+    // cutoff of 1 never culls.
+    float cone[4];
+    // Relative to the first index of the mesh
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t pad[2];
+};
+static_assert(sizeof(Meshlet) == 48);
+
+// Geometry of one glTF primitive, in world space
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+// Geometry ready to be copied to the GPU as is
+struct PackedMesh {
+    std::vector<PackedVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<Meshlet> meshlets;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+// Points into the packed meshes or the mapped file a scene owns
+struct MeshView {
+    std::span<const PackedVertex> vertices;
+    std::span<const uint32_t> indices;
+    std::span<const Meshlet> meshlets;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+// Placement of a mesh in the scene, scales are uniform
+struct MeshInstance {
+    float position[3];
+    float scale;
+    uint32_t mesh;
+};
+
+struct SceneData {
+    std::vector<MeshView> meshes;
+    // Empty draws every mesh once, as is
+    std::vector<MeshInstance> instances;
+    // Storage of the meshes, depending on where they come from
+    std::vector<PackedMesh> packedMeshes;
+    MappedFile file;
+    // Bytes read from disk
+    uint64_t bytes = 0;
+    uint64_t triangles = 0;
+    double parseMs = 0.0;
+};
+
+} // namespace baldwin
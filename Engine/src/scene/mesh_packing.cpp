@@ -0,0 +1,98 @@
+#include "mesh_packing.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "scene/meshlet_builder.hpp"
+
+namespace baldwin {
+
+static int16_t toSnorm16(float value) {
+    return static_cast<int16_t>(
+      std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+uint16_t floatToHalf(float value) {
+    uint32_t bits = std::bit_cast<uint32_t>(value);
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    // Values too small for a normal half are flushed to zero, too large ones
+    // and NaNs become infinities
+    if (exponent <= 0)
+	return sign;
+    if (exponent >= 31)
+	return sign | 0x7c00;
+
+    uint16_t half = static_cast<uint16_t>(sign | (exponent << 10) |
+					  (mantissa >> 13));
+    // Round to nearest, a carry correctly moves to the exponent
+    if (mantissa & 0x1000)
+	half++;
+    return half;
+}
+
+void encodeOctahedral(const float* normal, int16_t* encoded) {
+    float length = std::abs(normal[0]) + std::abs(normal[1]) +
+		   std::abs(normal[2]);
+    if (length == 0.0f) {
+	encoded[0] = 0;
+	encoded[1] = 0;
+	return;
+    }
+
+    float x = normal[0] / length;
+    float y = normal[1] / length;
+    if (normal[2] < 0.0f) {
+	float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+	float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+	x = foldedX;
+	y = foldedY;
+    }
+    encoded[0] = toSnorm16(x);
+    encoded[1] = toSnorm16(y);
+}
+
+PackedMesh packMesh(const MeshData& mesh) {
+    PackedMesh packed{};
+    std::copy_n(mesh.boundsMin, 3, packed.boundsMin);
+    std::copy_n(mesh.boundsMax, 3, packed.boundsMax);
+    packed.indices = mesh.indices;
+    packed.meshlets = buildMeshlets(mesh);
+
+    float scale[3];
+    for (int axis = 0; axis < 3; axis++) {
+	float extent = mesh.boundsMax[axis] - mesh.boundsMin[axis];
+	scale[axis] = extent > 0.0f ? 65535.0f / extent : 0.0f;
+    }
+
+    packed.vertices.resize(mesh.vertices.size());
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+	const Vertex& vertex = mesh.vertices[i];
+	PackedVertex& out = packed.vertices[i];
+	for (int axis = 0; axis < 3; axis++) {
+	    float offset = vertex.position[axis] - mesh.boundsMin[axis];
+	    out.position[axis] = static_cast<uint16_t>(std::clamp(
+	      std::lround(offset * scale[axis]), 0l, 65535l));
+	}
+	out.unused = 0;
+	encodeOctahedral(vertex.normal, out.normal);
+	out.uv[0] = floatToHalf(vertex.uvX);
+	out.uv[1] = floatToHalf(vertex.uvY);
+    }
+    return packed;
+}
+
+MeshView viewMesh(const PackedMesh& mesh) {
+    MeshView view{};
+    view.vertices = mesh.vertices;
+    view.indices = mesh.indices;
+    view.meshlets = mesh.meshlets;
+    std::copy_n(mesh.boundsMin, 3, view.boundsMin);
+    std::copy_n(mesh.boundsMax, 3, view.boundsMax);
+    return view;
+}
+
+} // namespace baldwin
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "scene/mesh_data.hpp"
+
+namespace baldwin {
+
+// Quantizes every vertex to the layout the shaders read, see PackedVertex.
+// Indices are copied untouched and split in meshlets, see buildMeshlets.
+PackedMesh packMesh(const MeshData& mesh);
+MeshView viewMesh(const PackedMesh& mesh);
+
+uint16_t floatToHalf(float value);
+// Maps a unit vector on the octahedron folded over the z = 0 plane, zero
+// vectors end up pointing towards +z
+void encodeOctahedral(const float* normal, int16_t* encoded);
+
+} // namespace baldwin
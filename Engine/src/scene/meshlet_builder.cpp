@@ -0,0 +1,158 @@
+#include "meshlet_builder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace baldwin {
+
+// Cosine of the widest angle between a triangle and the average normal of
+// its cluster. Tighter cones cull more often but make more clusters.
+static constexpr float MAX_NORMAL_SPREAD = 0.5f;
+// Cones wider than this, in cosine, would almost never cull
+static constexpr float MIN_CONE_COSINE = 0.1f;
+// Twice the area of a triangle relative to its longest edge squared, below
+// which its normal is mostly rounding error
+static constexpr float DEGENERATE_AREA = 1e-6f;
+
+static float dot(const float* a, const float* b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Unit normal of a counter-clockwise triangle, zero when degenerate
+static void triangleNormal(const MeshData& mesh, const uint32_t* triangle,
+			   float* normal) {
+    const float* a = mesh.vertices[triangle[0]].position;
+    const float* b = mesh.vertices[triangle[1]].position;
+    const float* c = mesh.vertices[triangle[2]].position;
+    float u[3], v[3], w[3];
+    for (int i = 0; i < 3; i++) {
+	u[i] = b[i] - a[i];
+	v[i] = c[i] - a[i];
+	w[i] = c[i] - b[i];
+    }
+    normal[0] = u[1] * v[2] - u[2] * v[1];
+    normal[1] = u[2] * v[0] - u[0] * v[2];
+    normal[2] = u[0] * v[1] - u[1] * v[0];
+    float length = std::sqrt(dot(normal, normal));
+    float longest = std::max({ dot(u, u), dot(v, v), dot(w, w) });
+    bool degenerate = length <= DEGENERATE_AREA * longest;
+    for (int i = 0; i < 3; i++) {
+	normal[i] = degenerate ? 0.0f : normal[i] / length;
+    }
+}
+
+static Meshlet finishMeshlet(const MeshData& mesh, uint32_t firstTriangle,
+			     uint32_t endTriangle) {
+    Meshlet meshlet{ .firstIndex = firstTriangle * 3,
+		     .indexCount = (endTriangle - firstTriangle) * 3 };
+    const uint32_t* indices = &mesh.indices[meshlet.firstIndex];
+
+    // Sphere around the center of the bounding box, far from minimal but
+    // cheap and never much worse for clusters this small
+    float boundsMin[3] = { INFINITY, INFINITY, INFINITY };
+    float boundsMax[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (uint32_t i = 0; i < meshlet.indexCount; i++) {
+	const float* position = mesh.vertices[indices[i]].position;
+	for (int axis = 0; axis < 3; axis++) {
+	    boundsMin[axis] = std::min(boundsMin[axis], position[axis]);
+	    boundsMax[axis] = std::max(boundsMax[axis], position[axis]);
+	}
+    }
+    float radius = 0.0f;
+    for (int axis = 0; axis < 3; axis++) {
+	meshlet.sphere[axis] = 0.5f * (boundsMin[axis] + boundsMax[axis]);
+    }
+    for (uint32_t i = 0; i < meshlet.indexCount; i++) {
+	const float* position = mesh.vertices[indices[i]].position;
+	float distance = 0.0f;
+	for (int axis = 0; axis < 3; axis++) {
+	    float d = position[axis] - meshlet.sphere[axis];
+	    distance += d * d;
+	}
+	radius = std::max(radius, distance);
+    }
+    // Quantized positions are off by up to half a step on each axis
+    float error = 0.0f;
+    for (int axis = 0; axis < 3; axis++) {
+	float step = (mesh.boundsMax[axis] - mesh.boundsMin[axis]) / 65535.0f;
+	error += 0.25f * step * step;
+    }
+    meshlet.sphere[3] = std::sqrt(radius) + std::sqrt(error);
+
+    // Every triangle normal lies within the cone around the average one
+    float axis[3] = {};
+    for (uint32_t i = 0; i < meshlet.indexCount; i += 3) {
+	float normal[3];
+	triangleNormal(mesh, indices + i, normal);
+	for (int j = 0; j < 3; j++) {
+	    axis[j] += normal[j];
+	}
+    }
+    float length = std::sqrt(dot(axis, axis));
+    meshlet.cone[3] = 1.0f;
+    if (length == 0.0f)
+	return meshlet;
+    for (int j = 0; j < 3; j++) {
+	meshlet.cone[j] = axis[j] / length;
+    }
+    float minCosine = 1.0f;
+    for (uint32_t i = 0; i < meshlet.indexCount; i += 3) {
+	float normal[3];
+	triangleNormal(mesh, indices + i, normal);
+	if (normal[0] == 0.0f && normal[1] == 0.0f && normal[2] == 0.0f)
+	    continue;
+	minCosine = std::min(minCosine, dot(normal, meshlet.cone));
+    }
+    if (minCosine > MIN_CONE_COSINE)
+	meshlet.cone[3] = std::sqrt(1.0f - minCosine * minCosine);
+    return meshlet;
+}
+
+std::vector<Meshlet> buildMeshlets(const MeshData& mesh) {
+    std::vector<Meshlet> meshlets;
+    uint32_t triangleCount = static_cast<uint32_t>(mesh.indices.size() / 3);
+    // Last cluster each vertex was counted in
+    std::vector<uint32_t> owner(mesh.vertices.size(), UINT32_MAX);
+    uint32_t cluster = 0;
+    uint32_t firstTriangle = 0;
+    uint32_t vertexCount = 0;
+    float normalSum[3] = {};
+
+    for (uint32_t t = 0; t < triangleCount; t++) {
+	const uint32_t* triangle = &mesh.indices[t * 3];
+	float normal[3];
+	triangleNormal(mesh, triangle, normal);
+
+	uint32_t newVertices = 0;
+	for (int k = 0; k < 3; k++) {
+	    newVertices += owner[triangle[k]] != cluster;
+	}
+	// Degenerate triangles fit anywhere
+	float sumLength = std::sqrt(dot(normalSum, normalSum));
+	bool spread = dot(normal, normal) > 0.0f && sumLength > 0.0f &&
+		      dot(normal, normalSum) < MAX_NORMAL_SPREAD * sumLength;
+	if (t > firstTriangle &&
+	    (t - firstTriangle == MESHLET_MAX_TRIANGLES ||
+	     vertexCount + newVertices > MESHLET_MAX_VERTICES || spread)) {
+	    meshlets.push_back(finishMeshlet(mesh, firstTriangle, t));
+	    cluster++;
+	    firstTriangle = t;
+	    vertexCount = 0;
+	    std::fill_n(normalSum, 3, 0.0f);
+	}
+
+	for (int k = 0; k < 3; k++) {
+	    if (owner[triangle[k]] != cluster) {
+		owner[triangle[k]] = cluster;
+		vertexCount++;
+	    }
+	    normalSum[k] += normal[k];
+	}
+    }
+    if (firstTriangle < triangleCount)
+	meshlets.push_back(finishMeshlet(mesh, firstTriangle, triangleCount));
+    return meshlets;
+}
+
+} // namespace baldwin
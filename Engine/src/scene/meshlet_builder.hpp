@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vector>
+
+#include "scene/mesh_data.hpp"
+
+namespace baldwin {
+
+// Splits the index buffer in clusters of consecutive triangles, starting a
+// new one when the vertex or triangle limit is reached or when a triangle
+// faces too far from the others. Indices are left untouched, so an index
+// buffer already ordered for the vertex cache yields compact clusters.
+//
+// Bounds cover the positions once quantized by packMesh.
+std::vector<Meshlet> buildMeshlets(const MeshData& mesh);
+
+} // namespace baldwin
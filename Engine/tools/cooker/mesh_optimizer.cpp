@@ -0,0 +1,281 @@
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace baldwin {
+
+static constexpr int FORSYTH_CACHE_SIZE = 32;
+static constexpr uint32_t FIFO_CACHE_SIZE = 16;
+
+// Scores from Forsyth's article: the last triangle's vertices are slightly
+// penalized so that strips don't go back and forth, vertices with few
+// triangles left are favoured so that no lonely triangle is left behind
+static float vertexScore(int cachePosition, uint32_t remaining) {
+    if (remaining == 0)
+	return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 3) {
+	float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+	score = std::pow(1.0f - (cachePosition - 3) * scaler, 1.5f);
+    } else if (cachePosition >= 0) {
+	score = 0.75f;
+    }
+    return score + 2.0f / std::sqrt(static_cast<float>(remaining));
+}
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+	return;
+
+    // Triangles using each vertex, packed in one array
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (uint32_t index : indices) {
+	remaining[index]++;
+    }
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+	offsets[v + 1] = offsets[v] + remaining[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+	adjacency[filled[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+	score[v] = vertexScore(-1, remaining[v]);
+    }
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++) {
+	triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] +
+			   score[indices[t * 3 + 2]];
+    }
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    // One more than the cache holds, for the vertices pushed out
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> nextCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    nextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    int64_t best = -1;
+    size_t cursor = 0;
+    for (size_t emittedCount = 0; emittedCount < triangleCount;
+	 emittedCount++) {
+	// When no triangle touches the cache, start over from the first one
+	// left in input order
+	if (best < 0) {
+	    while (emitted[cursor]) {
+		cursor++;
+	    }
+	    best = static_cast<int64_t>(cursor);
+	}
+
+	uint32_t triangle = static_cast<uint32_t>(best);
+	emitted[triangle] = true;
+	const uint32_t* corners = &indices[triangle * 3];
+	result.insert(result.end(), corners, corners + 3);
+
+	// Detaches the triangle from its vertices
+	for (int c = 0; c < 3; c++) {
+	    uint32_t v = corners[c];
+	    uint32_t* begin = &adjacency[offsets[v]];
+	    uint32_t* end = begin + remaining[v];
+	    *std::find(begin, end, triangle) = *(end - 1);
+	    remaining[v]--;
+	}
+
+	// Moves its vertices to the front of the LRU cache
+	nextCache.assign(corners, corners + 3);
+	for (uint32_t v : cache) {
+	    if (v != corners[0] && v != corners[1] && v != corners[2])
+		nextCache.push_back(v);
+	}
+	std::swap(cache, nextCache);
+	for (size_t i = 0; i < cache.size(); i++) {
+	    int position = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+	    cachePosition[cache[i]] = position;
+	    score[cache[i]] = vertexScore(position, remaining[cache[i]]);
+	}
+
+	// Only triangles of vertices in the cache changed score
+	best = -1;
+	float bestScore = -1.0f;
+	for (uint32_t v : cache) {
+	    for (uint32_t a = 0; a < remaining[v]; a++) {
+		uint32_t t = adjacency[offsets[v] + a];
+		triangleScore[t] = score[indices[t * 3]] +
+				   score[indices[t * 3 + 1]] +
+				   score[indices[t * 3 + 2]];
+		if (triangleScore[t] > bestScore) {
+		    bestScore = triangleScore[t];
+		    best = t;
+		}
+	    }
+	}
+	if (cache.size() > FORSYTH_CACHE_SIZE)
+	    cache.resize(FORSYTH_CACHE_SIZE);
+    }
+    indices = std::move(result);
+}
+
+struct Cluster {
+    uint32_t firstTriangle;
+    uint32_t triangleCount;
+    float sortKey;
+};
+
+static void triangleGeometry(const std::vector<uint32_t>& indices,
+			     const std::vector<Vertex>& vertices, size_t t,
+			     float* centroid, float* normal) {
+    const float* a = vertices[indices[t * 3]].position;
+    const float* b = vertices[indices[t * 3 + 1]].position;
+    const float* c = vertices[indices[t * 3 + 2]].position;
+    float ab[3], ac[3];
+    for (int i = 0; i < 3; i++) {
+	centroid[i] = (a[i] + b[i] + c[i]) / 3.0f;
+	ab[i] = b[i] - a[i];
+	ac[i] = c[i] - a[i];
+    }
+    // Twice the area in length
+    normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+    normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+    normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+}
+
+void optimizeOverdraw(std::vector<uint32_t>& indices,
+		      const std::vector<Vertex>& vertices) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+	return;
+
+    // Hard boundaries, where none of a triangle's vertices are in the cache
+    // anymore: reordering the clusters between them costs no extra misses
+    std::vector<Cluster> clusters;
+    std::vector<uint32_t> cache(FIFO_CACHE_SIZE, UINT32_MAX);
+    uint32_t head = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+	uint32_t misses = 0;
+	for (int c = 0; c < 3; c++) {
+	    uint32_t v = indices[t * 3 + c];
+	    if (std::find(cache.begin(), cache.end(), v) != cache.end())
+		continue;
+	    cache[head] = v;
+	    head = (head + 1) % FIFO_CACHE_SIZE;
+	    misses++;
+	}
+	if (misses == 3 || clusters.empty())
+	    clusters.push_back({ static_cast<uint32_t>(t), 0, 0.0f });
+	clusters.back().triangleCount++;
+    }
+
+    // Area weighted centroids and normals
+    float meshCentroid[3] = {};
+    float meshArea = 0.0f;
+    std::vector<float> clusterData(clusters.size() * 6, 0.0f);
+    for (size_t i = 0; i < clusters.size(); i++) {
+	float* centroid = &clusterData[i * 6];
+	float* normal = &clusterData[i * 6 + 3];
+	float clusterArea = 0.0f;
+	const Cluster& cluster = clusters[i];
+	for (uint32_t t = cluster.firstTriangle;
+	     t < cluster.firstTriangle + cluster.triangleCount;
+	     t++) {
+	    float triangleCentroid[3], triangleNormal[3];
+	    triangleGeometry(indices, vertices, t, triangleCentroid,
+			     triangleNormal);
+	    float area = std::sqrt(triangleNormal[0] * triangleNormal[0] +
+				   triangleNormal[1] * triangleNormal[1] +
+				   triangleNormal[2] * triangleNormal[2]);
+	    for (int a = 0; a < 3; a++) {
+		centroid[a] += triangleCentroid[a] * area;
+		normal[a] += triangleNormal[a];
+		meshCentroid[a] += triangleCentroid[a] * area;
+	    }
+	    clusterArea += area;
+	}
+	if (clusterArea > 0.0f) {
+	    for (int a = 0; a < 3; a++) {
+		centroid[a] /= clusterArea;
+	    }
+	}
+	meshArea += clusterArea;
+    }
+    if (meshArea > 0.0f) {
+	for (int a = 0; a < 3; a++) {
+	    meshCentroid[a] /= meshArea;
+	}
+    }
+
+    // Clusters facing away from the center are likely to occlude the others
+    for (size_t i = 0; i < clusters.size(); i++) {
+	const float* centroid = &clusterData[i * 6];
+	const float* normal = &clusterData[i * 6 + 3];
+	float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+				 normal[2] * normal[2]);
+	float key = 0.0f;
+	if (length > 0.0f) {
+	    for (int a = 0; a < 3; a++) {
+		key += (centroid[a] - meshCentroid[a]) * normal[a] / length;
+	    }
+	}
+	clusters[i].sortKey = key;
+    }
+    std::stable_sort(clusters.begin(),
+		     clusters.end(),
+		     [](const Cluster& a, const Cluster& b) {
+			 return a.sortKey > b.sortKey;
+		     });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (const Cluster& cluster : clusters) {
+	auto first = indices.begin() + cluster.firstTriangle * 3;
+	result.insert(result.end(), first, first + cluster.triangleCount * 3);
+    }
+    indices = std::move(result);
+}
+
+void optimizeVertexFetch(std::vector<Vertex>& vertices,
+			 std::vector<uint32_t>& indices) {
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+    for (uint32_t& index : indices) {
+	if (remap[index] == UINT32_MAX) {
+	    remap[index] = static_cast<uint32_t>(result.size());
+	    result.push_back(vertices[index]);
+	}
+	index = remap[index];
+    }
+    vertices = std::move(result);
+}
+
+double computeAcmr(const std::vector<uint32_t>& indices, size_t vertexCount,
+		   uint32_t cacheSize) {
+    if (indices.size() < 3)
+	return 0.0;
+
+    // Insertion time of every vertex, those inserted less than cacheSize
+    // misses ago are still in the FIFO
+    std::vector<uint64_t> insertedAt(vertexCount, 0);
+    uint64_t misses = 0;
+    for (uint32_t index : indices) {
+	if (insertedAt[index] == 0 ||
+	    misses - insertedAt[index] >= cacheSize) {
+	    misses++;
+	    insertedAt[index] = misses;
+	}
+    }
+    return static_cast<double>(misses) / (indices.size() / 3);
+}
+
+} // namespace baldwin
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "scene/mesh_data.hpp"
+
+namespace baldwin {
+
+// Reorders triangles so that consecutive ones share vertices, using Tom
+// Forsyth's linear-speed vertex cache optimization
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+// Reorders the clusters of an index buffer already optimized for the vertex
+// cache so that triangles facing outwards are drawn first, which lets depth
+// testing reject more of the hidden ones from any view. Clusters are split
+// where the cache is flushed, keeping the cache efficiency intact.
+void optimizeOverdraw(std::vector<uint32_t>& indices,
+		      const std::vector<Vertex>& vertices);
+
+// Orders vertices by first use in the index buffer so that fetches walk
+// memory linearly, and drops the unreferenced ones
+void optimizeVertexFetch(std::vector<Vertex>& vertices,
+			 std::vector<uint32_t>& indices);
+
+// Average vertex shader invocations per triangle with a FIFO post-transform
+// cache of cacheSize entries, 3 being the worst
+double computeAcmr(const std::vector<uint32_t>& indices, size_t vertexCount,
+		   uint32_t cacheSize = 16);
+
+} // namespace baldwin
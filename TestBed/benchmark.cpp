@@ -0,0 +1,316 @@
+#include "engine.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+/*
+ * Headless frame-time benchmark. Renders a fixed number of frames offscreen
+ * and reports CPU and GPU frame time statistics as JSON. Runs on software
+ * ICDs too, e.g. VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json
+ *
+ * --draws multiplies the triangle draws to load command recording, compare
+ * runs with and without --serial to see what parallel recording brings.
+ * --frames-in-flight trades latency for throughput, the time the CPU spends
+ * waiting on the GPU each frame is reported as cpu_wait.
+ * --no-async-compute keeps compute passes on the graphics queue, comparing
+ * the gpu times of both runs shows what overlapping them brings.
+ * --tune-compute times every workgroup size of compute kernels before the
+ * run and keeps the fastest, later runs reuse the persisted choice.
+ * --sync-pipelines waits for every pipeline before the first frame, compare
+ * the startup first_frame_ms of both runs.
+ * --target-ms enables dynamic resolution with that GPU frame budget, the
+ * rendered fraction of the resolution is reported as render_scale.
+ * --scene loads a glTF file or a scene cooked by baldwin_cooker and draws
+ * it, frames are only measured once it is uploaded. Its loading throughput
+ * is reported under meshes, compare both formats of the same scene.
+ * --instances draws that many procedural meshes from inside the scene,
+ * culled on the GPU and drawn indirectly, or one CPU draw each with
+ * --cpu-draws. The cpu time should stay flat from 1000 to 1000000 instances
+ * with GPU culling, visible instances are reported under culling.
+ * --no-occlusion only culls GPU instances against the frustum, comparing the
+ * gpu times of both runs on a dense scene, e.g. --instances 1000000, shows
+ * what culling hidden instances saves. Instances culled by each test are
+ * reported under culling.
+ * --no-clusters draws visible instances whole instead of culling their
+ * meshlets, compare the gpu times and triangles_drawn of both runs on dense
+ * meshes, e.g. a cooked glTF scene.
+ *
+ * The JSON goes to stdout, or to --output, and engine logs to stderr.
+ */
+
+struct Options {
+    int frames = 1000;
+    int warmup = 60;
+    int width = 1280;
+    int height = 720;
+    int draws = 1;
+    int framesInFlight = 2;
+    bool serial = false;
+    bool asyncCompute = true;
+    bool tuneCompute = false;
+    bool syncPipelines = false;
+    // 0 keeps the full resolution
+    double targetMs = 0.0;
+    const char* scene = nullptr;
+    int instances = 0;
+    bool cpuDraws = false;
+    bool occlusion = true;
+    bool clusters = true;
+    // Inside the instances, so that most are culled
+    double cameraDistance = 0.5;
+    const char* output = nullptr;
+};
+
+struct Summary {
+    double min = 0.0;
+    double mean = 0.0;
+    double p99 = 0.0;
+};
+
+static Options parseOptions(int argc, char** argv) {
+    Options options{};
+    for (int i = 1; i < argc; i += 2) {
+	// Flags without a value
+	if (std::strcmp(argv[i], "--serial") == 0) {
+	    options.serial = true;
+	    i--;
+	    continue;
+	}
+	if (std::strcmp(argv[i], "--no-async-compute") == 0) {
+	    options.asyncCompute = false;
+	    i--;
+	    continue;
+	}
+	if (std::strcmp(argv[i], "--tune-compute") == 0) {
+	    options.tuneCompute = true;
+	    i--;
+	    continue;
+	}
+	if (std::strcmp(argv[i], "--sync-pipelines") == 0) {
+	    options.syncPipelines = true;
+	    i--;
+	    continue;
+	}
+	if (std::strcmp(argv[i], "--cpu-draws") == 0) {
+	    options.cpuDraws = true;
+	    i--;
+	    continue;
+	}
+	if (std::strcmp(argv[i], "--no-occlusion") == 0) {
+	    options.occlusion = false;
+	    i--;
+	    continue;
+	}
+	if (std::strcmp(argv[i], "--no-clusters") == 0) {
+	    options.clusters = false;
+	    i--;
+	    continue;
+	}
+	if (i + 1 >= argc) {
+	    std::cerr << "Missing value for " << argv[i] << std::endl;
+	    break;
+	}
+
+	if (std::strcmp(argv[i], "--frames") == 0) {
+	    options.frames = std::atoi(argv[i + 1]);
+	} else if (std::strcmp(argv[i], "--warmup") == 0) {
+	    options.warmup = std::atoi(argv[i + 1]);
+	} else if (std::strcmp(argv[i], "--width") == 0) {
+	    options.width = std::atoi(argv[i + 1]);
+	} else if (std::strcmp(argv[i], "--height") == 0) {
+	    options.height = std::atoi(argv[i + 1]);
+	} else if (std::strcmp(argv[i], "--draws") == 0) {
+	    options.draws = std::atoi(argv[i + 1]);
+	} else if (std::strcmp(argv[i], "--frames-in-flight") == 0) {
+	    options.framesInFlight = std::atoi(argv[i + 1]);
+	} else if (std::strcmp(argv[i], "--target-ms") == 0) {
+	    options.targetMs = std::atof(argv[i + 1]);
+	} else if (std::strcmp(argv[i], "--scene") == 0) {
+	    options.scene = argv[i + 1];
+	} else if (std::strcmp(argv[i], "--instances") == 0) {
+	    options.instances = std::atoi(argv[i + 1]);
+	} else if (std::strcmp(argv[i], "--camera-distance") == 0) {
+	    options.cameraDistance = std::atof(argv[i + 1]);
+	} else if (std::strcmp(argv[i], "--output") == 0) {
+	    options.output = argv[i + 1];
+	} else {
+	    std::cerr << "Unknown option " << argv[i] << std::endl;
+	}
+    }
+    return options;
+}
+
+static Summary summarize(std::vector<double> samples) {
+    Summary summary{};
+    if (samples.empty())
+	return summary;
+
+    std::sort(samples.begin(), samples.end());
+    size_t p99Index = static_cast<size_t>(0.99 * (samples.size() - 1));
+    summary.min = samples.front();
+    summary.mean = std::accumulate(samples.begin(), samples.end(), 0.0) /
+		   samples.size();
+    summary.p99 = samples[p99Index];
+    return summary;
+}
+
+static void writeSummary(std::ostream& out, const char* name,
+			 const Summary& summary, size_t count) {
+    out << "  \"" << name << "\": { \"samples\": " << count
+	<< ", \"min_ms\": " << summary.min << ", \"mean_ms\": " << summary.mean
+	<< ", \"p99_ms\": " << summary.p99 << " }";
+}
+
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+    baldwin::RendererSettings settings{
+	.framesInFlight = static_cast<uint32_t>(options.framesInFlight),
+	.headless = true,
+	.parallelRecording = !options.serial,
+	.triangleDraws = static_cast<uint32_t>(options.draws),
+	.asyncCompute = options.asyncCompute,
+	.tuneCompute = options.tuneCompute,
+	.asyncPipelines = !options.syncPipelines,
+	.dynamicResolution = options.targetMs > 0.0,
+	.targetFrameMs = options.targetMs,
+	.scenePath = options.scene ? options.scene : "",
+	.instancedScene = static_cast<uint32_t>(options.instances),
+	.gpuCulling = !options.cpuDraws,
+	.occlusionCulling = options.occlusion,
+	.clusterCulling = options.clusters,
+	.maxInstances = std::max(static_cast<uint32_t>(options.instances),
+				 baldwin::RendererSettings{}.maxInstances),
+	// Procedural meshes are a handful of meshlets each
+	.maxClusters = std::max(4 * static_cast<uint32_t>(options.instances),
+				baldwin::RendererSettings{}.maxClusters)
+    };
+    if (options.instances > 0)
+	settings.cameraDistance = static_cast<float>(options.cameraDistance);
+    baldwin::Engine engine{
+	options.width, options.height, baldwin::RenderAPI::Vulkan, settings
+    };
+
+    std::vector<double> cpuTimes;
+    std::vector<double> gpuTimes;
+    std::vector<double> waitTimes;
+    std::vector<double> renderScales;
+    baldwin::StartupTimings startup{};
+    baldwin::PsoCacheStatistics psos{};
+    baldwin::MeshStatistics meshes{};
+    baldwin::CullStatistics culling{};
+    cpuTimes.reserve(options.frames);
+    gpuTimes.reserve(options.frames);
+    waitTimes.reserve(options.frames);
+    renderScales.reserve(options.frames);
+
+    // The engine logs to stdout, the JSON must be the only thing there
+    std::streambuf* stdoutBuffer = std::cout.rdbuf(std::cerr.rdbuf());
+
+    try {
+	if (!engine.init())
+	    throw std::runtime_error("Could not initialize the engine");
+	for (int i = 0; i < options.warmup; i++) {
+	    engine.runFrame();
+	}
+	// Loading errors are thrown from runFrame
+	bool loadsScene = options.scene || options.instances > 0;
+	while (loadsScene && engine.getMeshStatistics().loadMs == 0.0) {
+	    engine.runFrame();
+	}
+	meshes = engine.getMeshStatistics();
+	// Pipelines compiled in the background are usually ready by now
+	startup = engine.getStartupTimings();
+	psos = engine.getPsoCacheStatistics();
+
+	int lastGpuFrame = engine.getFrameTimings().gpuFrame;
+	for (int i = 0; i < options.frames; i++) {
+	    auto start = std::chrono::steady_clock::now();
+	    engine.runFrame();
+	    auto end = std::chrono::steady_clock::now();
+	    cpuTimes.push_back(
+	      std::chrono::duration<double, std::milli>(end - start).count());
+
+	    // GPU timings come back a few frames late, only keep new ones
+	    baldwin::FrameTimings timings = engine.getFrameTimings();
+	    waitTimes.push_back(timings.cpuWaitMs);
+	    renderScales.push_back(timings.renderScale);
+	    if (timings.gpuFrame > lastGpuFrame) {
+		gpuTimes.push_back(timings.gpuMs);
+		lastGpuFrame = timings.gpuFrame;
+	    }
+	}
+	culling = engine.getCullStatistics();
+	engine.cleanup();
+    } catch (const std::exception& e) {
+	std::cout.rdbuf(stdoutBuffer);
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+    }
+
+    std::cout.rdbuf(stdoutBuffer);
+    std::ofstream file;
+    if (options.output)
+	file.open(options.output);
+    std::ostream& out = options.output ? file : std::cout;
+
+    out << "{\n";
+    out << "  \"frames\": " << options.frames << ",\n";
+    out << "  \"width\": " << options.width << ",\n";
+    out << "  \"height\": " << options.height << ",\n";
+    out << "  \"draws\": " << options.draws << ",\n";
+    out << "  \"parallel_recording\": " << (options.serial ? "false" : "true")
+	<< ",\n";
+    out << "  \"frames_in_flight\": " << options.framesInFlight << ",\n";
+    out << "  \"async_compute\": "
+	<< (options.asyncCompute ? "true" : "false") << ",\n";
+    writeSummary(out, "cpu", summarize(cpuTimes), cpuTimes.size());
+    out << ",\n";
+    writeSummary(out, "cpu_wait", summarize(waitTimes), waitTimes.size());
+    out << ",\n";
+    writeSummary(out, "gpu", summarize(gpuTimes), gpuTimes.size());
+    out << ",\n";
+    out << "  \"target_ms\": " << options.targetMs << ",\n";
+    Summary scales = summarize(renderScales);
+    out << "  \"render_scale\": { \"min\": " << scales.min
+	<< ", \"mean\": " << scales.mean << " },\n";
+    out << "  \"startup\": { \"first_frame_ms\": " << startup.firstFrameMs
+	<< ", \"pipelines_ms\": " << startup.pipelinesMs
+	<< ", \"async_pipelines\": "
+	<< (startup.asyncPipelines ? "true" : "false")
+	<< ", \"pipeline_cache\": \""
+	<< (startup.warmPipelineCache ? "warm" : "cold") << "\" },\n";
+    out << "  \"pso\": { \"graphics\": " << psos.graphicsPipelines
+	<< ", \"compute\": " << psos.computePipelines
+	<< ", \"hits\": " << psos.hits << ", \"misses\": " << psos.misses
+	<< " },\n";
+    out << "  \"meshes\": { \"count\": " << meshes.meshes
+	<< ", \"triangles\": " << meshes.triangles
+	<< ", \"bytes\": " << meshes.bytesLoaded
+	<< ", \"load_ms\": " << meshes.loadMs
+	<< ", \"mb_per_s\": " << meshes.mbPerSecond
+	<< ", \"triangles_per_s\": " << meshes.trianglesPerSecond
+	<< ", \"pool_bytes\": " << meshes.poolBytes << " },\n";
+    out << "  \"culling\": { \"gpu\": "
+	<< (culling.gpuCulling ? "true" : "false")
+	<< ", \"occlusion\": "
+	<< (culling.occlusionCulling ? "true" : "false")
+	<< ", \"cluster\": "
+	<< (culling.clusterCulling ? "true" : "false")
+	<< ", \"instances\": " << culling.instances
+	<< ", \"visible\": " << culling.visibleInstances
+	<< ", \"frustum_culled\": " << culling.frustumCulled
+	<< ", \"occlusion_culled\": " << culling.occlusionCulled
+	<< ", \"clusters\": " << culling.clusters
+	<< ", \"clusters_drawn\": " << culling.clustersDrawn
+	<< ", \"triangles\": " << culling.triangles
+	<< ", \"triangles_drawn\": " << culling.trianglesDrawn << " }";
+    out << "\n}\n";
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+#include "core/job_system.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+/*
+ * Job system micro-benchmark. Measures the cost of scheduling empty jobs and
+ * how a compute bound parallelFor scales from 1 to N threads, then prints the
+ * results as JSON.
+ */
+
+struct Options {
+    uint32_t jobs = 100000;
+    uint32_t elements = 1 << 22;
+    uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    int repeats = 5;
+};
+
+static Options parseOptions(int argc, char** argv) {
+    Options options{};
+    for (int i = 1; i + 1 < argc; i += 2) {
+	if (std::strcmp(argv[i], "--jobs") == 0) {
+	    options.jobs = std::atoi(argv[i + 1]);
+	} else if (std::strcmp(argv[i], "--elements") == 0) {
+	    options.elements = std::atoi(argv[i + 1]);
+	} else if (std::strcmp(argv[i], "--threads") == 0) {
+	    options.maxThreads = std::atoi(argv[i + 1]);
+	} else if (std::strcmp(argv[i], "--repeats") == 0) {
+	    options.repeats = std::atoi(argv[i + 1]);
+	} else {
+	    std::cerr << "Unknown option " << argv[i] << std::endl;
+	}
+    }
+    return options;
+}
+
+// Best of several runs, in ms
+template <typename F>
+static double measure(int repeats, F&& fn) {
+    double best = 1e30;
+    for (int i = 0; i < repeats; i++) {
+	auto start = std::chrono::steady_clock::now();
+	fn();
+	auto end = std::chrono::steady_clock::now();
+	best = std::min(
+	  best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+    std::vector<float> data(options.elements);
+    for (uint32_t i = 0; i < options.elements; i++) {
+	data[i] = static_cast<float>(i);
+    }
+
+    double singleMs = 0.0;
+    std::cout << "{\n  \"results\": [\n";
+    for (uint32_t threads = 1; threads <= options.maxThreads; threads++) {
+	baldwin::JobSystem jobs;
+	jobs.init(threads);
+
+	// Empty jobs, all submitted from the main thread which then helps
+	double scheduleMs = measure(options.repeats, [&]() {
+	    baldwin::JobCounter counter;
+	    for (uint32_t i = 0; i < options.jobs; i++) {
+		jobs.run([]() {}, &counter);
+	    }
+	    jobs.wait(counter);
+	});
+
+	// Enough math per element for the work to dominate
+	double computeMs = measure(options.repeats, [&]() {
+	    jobs.parallelFor(
+	      options.elements, 0, [&data](uint32_t begin, uint32_t end) {
+		  for (uint32_t i = begin; i < end; i++) {
+		      float s = std::sin(data[i]);
+		      float c = std::cos(data[i]);
+		      data[i] = std::sqrt(s * s + c * 0.5f + 1.0f);
+		  }
+	      });
+	});
+	jobs.shutdown();
+
+	if (threads == 1)
+	    singleMs = computeMs;
+	std::cout << "    { \"threads\": " << threads
+		  << ", \"ns_per_job\": " << scheduleMs * 1e6 / options.jobs
+		  << ", \"parallel_for_ms\": " << computeMs
+		  << ", \"speedup\": " << singleMs / computeMs << " }"
+		  << (threads < options.maxThreads ? ",\n" : "\n");
+    }
+    std::cout << "  ]\n}\n";
+
+    return EXIT_SUCCESS;
+}
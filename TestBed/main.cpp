@@ -1,11 +1,18 @@
 #include "engine.hpp"
 #include <iostream>
 
-int main() {
-    baldwin::Engine engine{ 800, 600, baldwin::RenderAPI::Vulkan };
+int main(int argc, char** argv) {
+    // Optional glTF scene to display
+    baldwin::RendererSettings settings{};
+    if (argc > 1)
+	settings.scenePath = argv[1];
+    baldwin::Engine engine{ 800, 600, baldwin::RenderAPI::Vulkan, settings };
 
     try {
-	engine.init();
+	if (!engine.init()) {
+	    std::cerr << "Could not initialize the engine" << std::endl;
+	    return EXIT_FAILURE;
+	}
 	engine.run();
 	engine.cleanup();
     } catch (const std::exception& e) {